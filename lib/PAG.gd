@@ -434,6 +434,31 @@ DeclareGlobalFunction( "CompatibilityMat" );
 ##  <#/GAPDoc>
 DeclareGlobalFunction( "ExpandMatRHS" );
 
+#############################################################################
+##
+#F  WriteKramerMesnerSystem( <file>, <mat>[, <cm>] ) 
+##
+##  <#GAPDoc Label="WriteKramerMesnerSystem">
+##  <ManSection>
+##  <Func Name="WriteKramerMesnerSystem" Arg="file, mat[, cm]"/>
+##
+##  <Description>
+##  Writes the system of linear equations determined by the matrix 
+##  <A>mat</A>, with the right-hand side as the last column, and the 
+##  optional compatibility matrix <A>cm</A> to <A>file</A> in a binary
+##  format. The file contains a header with the dimensions, the nonzero
+##  coefficients stored by columns and the compatibility matrix packed into
+##  bits, as described in <F>src/pagsys.h</F>. The programs <C>solvecm</C>,
+##  <C>solvelibexact</C> and <C>solvediophant</C> recognize this format
+##  and map the file into memory instead of parsing text. It is used by
+##  <Ref Func="SolveKramerMesner"/>. If <A>mat</A> is a list of matrices,
+##  the systems are written one after another to a single batch file and
+##  <A>cm</A> is a list of compatibility matrices.
+##  </Description>
+##  </ManSection>
+##  <#/GAPDoc>
+DeclareGlobalFunction( "WriteKramerMesnerSystem" );
+
 #############################################################################
 ##
 #F  SolveKramerMesner( <mat>[, <cm>][, <opt>] ) 
@@ -451,18 +476,80 @@ DeclareGlobalFunction( "ExpandMatRHS" );
 ##  be chosen explicitly in the record <A>opt</A>. Possible components are:
 ##  <List>
 ##  <Item><A>Solver</A>:=<C>"solvediophant"</C> If defined, <C>solvediophant</C> 
-##  is used.</Item>
+##  is used. If its 64-bit integers overflow, the system is solved again
+##  with the 128-bit version <C>solvediophant128</C>.</Item>
 ##  <Item><A>Solver</A>:=<C>"solvecm"</C> If defined, <C>solvecm</C> is used.</Item>
 ##  <Item><A>Solver</A>:=<C>"libexact"</C> If defined, <C>libexact</C> is used.
 ##  This is P. Kaski and  O. Pottonen's implementation of the Dancing Links
 ##  algorithm, see <Cite Key='KP08'/>. For this solver the coefficients of
-##  <A>mat</A> must be in <M>\{0,1\}</M>!</Item>
+##  <A>mat</A> must be nonnegative integers. Matrices with other coefficients
+##  than <M>0</M> and <M>1</M> are solved by an exact multicover search in
+##  the manner of Dancing Links, which branches on the equation with the
+##  fewest available columns. If a compatibility matrix <A>cm</A> is given,
+##  the columns that are not compatible with a chosen column are removed
+##  from the search.</Item>
+##  <Item><A>Count</A>:=true Only count the solutions with <C>libexact</C>
+##  and return their number. The search stores the residual problems
+##  and their numbers of solutions, so a residual problem that comes up
+##  again on another path is not searched again. This can be much faster
+##  than listing the solutions when there are very many of them. The
+##  options <A>Threads</A> and <A>Progress</A> are not used.</Item>
+##  <Item><A>Threads</A>:=<A>n</A> Run <C>solvecm</C>, <C>libexact</C> or
+##  the enumeration of <C>solvediophant</C> in parallel with 
+##  <A>n</A> threads. The search tree is split into subproblems that are
+##  distributed among the threads.</Item>
+##  <Item><A>RowBranching</A>:=true Instead of trying the columns in 
+##  order, <C>solvecm</C> picks the equation with the fewest available 
+##  columns and branches only on the columns that cover it. This can give 
+##  much smaller search trees.</Item>
+##  <Item><A>Progress</A>:=true The backtracking solvers <C>solvecm</C> 
+##  and <C>libexact</C> periodically print progress lines with the elapsed
+##  time, the number of nodes and solutions per second, the current depth
+##  and the branching factors at each depth of the search tree.</Item>
+##  <Item><A>Profile</A>:=true Let <C>solvediophant</C> measure the phases
+##  of the solution. A record with components <A>Solutions</A> and
+##  <A>Profile</A> is then returned. <A>Profile</A> has the list
+##  <A>Phases</A> of records with the time and the orthogonal defect
+##  before and after the lattice reductions and the nodes per level and
+##  pruning hits of the enumeration.</Item>
 ##  </List>
+##  If <A>mat</A> is a list of matrices, the systems are written to one
+##  batch file and solved by a single run of the solver, which saves
+##  starting a process for each of many small systems. The result is
+##  the list of the solution lists of the systems, or of their numbers
+##  of solutions with <A>Count</A>. In this case 
+##  <A>cm</A> is a list with a compatibility matrix for each system, and
+##  the option <A>Profile</A> is ignored.
 ##  </Description>
 ##  </ManSection>
 ##  <#/GAPDoc>
 DeclareGlobalFunction( "SolveKramerMesner" );
 
+#############################################################################
+##
+#F  EstimateKramerMesner( <mat>[, <cm>][, <opt>] ) 
+##
+##  <#GAPDoc Label="EstimateKramerMesner">
+##  <ManSection>
+##  <Func Name="EstimateKramerMesner" Arg="mat[, cm][, opt]"/>
+##
+##  <Description>
+##  Estimates the size of the search tree of <C>solvecm</C> for the system
+##  determined by the matrix <A>mat</A> and the optional compatibility
+##  matrix <A>cm</A>, without solving it. Random paths from the root are
+##  followed and the numbers of nodes at each depth are estimated by
+##  Knuth's method. Returns a record with components <A>Probes</A>, 
+##  <A>Nodes</A> (estimated number of nodes), <A>StdErr</A> (its standard 
+##  error), <A>Solutions</A>, <A>Time</A> (estimated running time in seconds)
+##  and <A>NodesAtDepth</A>. The optional record <A>opt</A> may contain 
+##  the components <A>Probes</A>:=<A>n</A> (number of random paths, default
+##  1000) and <A>RowBranching</A>:=true, which has the same meaning as in 
+##  <Ref Func="SolveKramerMesner"/>.
+##  </Description>
+##  </ManSection>
+##  <#/GAPDoc>
+DeclareGlobalFunction( "EstimateKramerMesner" );
+
 #############################################################################
 ##
 #F  BaseBlocks( <ksub>, <sol> )
@@ -638,6 +725,8 @@ DeclareGlobalFunction( "MatAut" );
 ##  all points are in the same class.</Item>
 ##  <Item><A>Positions</A>:=<C>true</C>/<C>false</C> Return positions 
 ##  of nonisomorphic designs instead of the designs themselves.</Item>
+##  <Item><A>Threads</A>:=<A>n</A> Compute the canonical forms with
+##  <A>n</A> threads. The result is the same as with one thread.</Item>
 ##  </List>
 ##  </Description>
 ##  </ManSection>
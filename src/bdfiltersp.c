@@ -8,14 +8,24 @@
     with nauty.c, nautil.c, naugraph.c, schreier.c, naurng.c, and 
     nausparse.c.
 
+    With -jN the designs are canonized by N threads while the main thread
+    reads the next batch of designs. The canonical forms are compared in
+    the order of the input, so the output does not depend on N. nauty
+    must be configured with --enable-tls for this.
+
     Vedran Krcadinac (krcko@math.hr), 7.1.2023.
     Department of Mathematics, University of Zagreb, Croatia
 */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "nausparse.h" 
+#include "cfstore.h"
+
+#define MAXTHREADS	256
+#define BATCH		64	/* Designs per thread in a batch */
 
 /****************/
 /* Global stuff */
@@ -29,6 +39,31 @@ int mask=1;  /* An integer mask for options */
    8  Print comments: -c, -C 
 */
 
+int nthreads=1;              /* Number of threads */
+
+int v=0,b=0;                 /* Design parameters */
+int n,m;                     /* Size of the incidence graph */
+const char *readerror;       /* Error of readdesign() */
+
+typedef struct design {      /* A design of a batch: */
+  graph *g;                  /* incidence graph, */
+  graph *cng;                /* canonical form, */
+  double grpsize1;           /* order of the automorphism group */
+  int grpsize2;
+} DESIGN;
+
+typedef struct worker {      /* Workspace of a thread */
+  int *lab,*ptn,*orbits;
+  optionblk options;
+  statsblk stats;
+  sparsegraph sg,cg;
+} WORKER;
+
+WORKER work[MAXTHREADS];
+DESIGN *current;             /* The batch being canonized, NULL at the end */
+long ncurrent,nextdesign;
+pthread_barrier_t batchstart,batchdone;
+
 void printinc(graph *g, int v, int b, int m)
 { int i,j;
   set *gv;
@@ -63,41 +98,142 @@ void printdes(graph *g, int v, int b, int m)
 }
 
 
+void *allocate(size_t size)
+{ void *p;
+
+  p = calloc(size,1);
+  if (p==NULL)
+  { printf("Out of memory!\n");
+    exit(0);
+  }
+  return p;
+}
+
+
+/* Read the next design into g. Returns 1 if there is one, 0 at the end
+   of the input and -1 for an error, which is then in readerror. */
+
+int readdesign(graph *g)
+{ int i,x=0,ok;
+  char c;
+
+  EMPTYGRAPH(g,m,n);
+
+  c=0;
+  ok=1;
+  while (ok==1 && c!='[') ok=scanf("%c",&c);
+  if (ok!=1) return 0;
+
+  for (i=0; i<b; ++i)
+  { /* printf("Block %d: ",i+1); */
+    c=0;
+    while (ok==1 && c!='[') ok=scanf("%c",&c);
+    if (ok!=1)
+    { readerror="Error reading design.";
+      return -1;
+    }
+    c=',';
+    while (ok==1 && c==',')
+    { ok=scanf("%d",&x);
+      if (x<1 || x>v) 
+      { readerror="Error reading point of design.";
+        return -1;
+      }
+      /* printf("%d ",x); */
+      --x;
+      ADDONEEDGE(g,v+i,x,m);
+      c=0;
+      while (ok==1 && c!=']' && c!=',') ok= scanf("%c",&c);
+      if (ok!=1)
+      { readerror="Error reading design.";
+        return -1;
+      }
+    }
+  }
+  return 1;
+}
+
+
+/* Read up to size designs. status is set as by readdesign(). */
+
+long readbatch(DESIGN *d, long size, int *status)
+{ long k;
+
+  for (k=0; k<size && (*status=readdesign(d[k].g))==1; ++k);
+  return k;
+}
+
+
+/* Canonical form of design d in the workspace w of a thread */
+
+void canonize(WORKER *w, DESIGN *d)
+{ int mc;
+
+  /* Convert to sparse graph */
+
+  nauty_to_sg(d->g,&w->sg,m,n);
+
+  /* Call nauty */
+
+  sparsenauty(&w->sg,w->lab,w->ptn,w->orbits,&w->options,&w->stats,&w->cg);
+
+  sg_to_nauty(&w->cg,d->cng,m,&mc);
+  if (m!=mc)
+  { printf("Error: canonical m different!\n");
+    exit(0);
+  }
+  d->grpsize1=w->stats.grpsize1;
+  d->grpsize2=w->stats.grpsize2;
+}
+
+
+/* Canonize the designs of the current batch with workspace w */
+
+void canonbatch(WORKER *w)
+{ long i;
+
+  while ((i=__atomic_fetch_add(&nextdesign,1,__ATOMIC_RELAXED))<ncurrent)
+    canonize(w,current+i);
+}
+
+
+/* Thread function. The threads are kept for all batches, since nauty
+   keeps its workspace in thread-local storage. */
+
+void *workcanon(void *arg)
+{ while (1)
+  { pthread_barrier_wait(&batchstart);
+    if (current==NULL) return NULL;
+    canonbatch((WORKER *)arg);
+    pthread_barrier_wait(&batchdone);
+  }
+}
+
+
 /****************/
 /* Main program */
 /****************/
 
 int main(int argc,char *argv[])
 { 
-  DYNALLSTAT(graph,g,g_sz);
-  DYNALLSTAT(int,lab,lab_sz);
-  DYNALLSTAT(int,ptn,ptn_sz);
-  DYNALLSTAT(int,orbits,orbits_sz);
   static DEFAULTOPTIONS_SPARSEGRAPH(options);
-  statsblk stats;
-  sparsegraph *sgp;
+  pthread_t thread[MAXTHREADS];
 
-  SG_DECL(cg);
-
-  int n,m,mc;
-  graph *cng;
-
-  int b=0,v=0; /* Design parameters */
   int p=0;     /* Point class size for initial coloring */
 
-  int i,j,k,x,ok;
+  int i,j,k,ok,status,cur;
   char c;
   long unsigned int count=0,countout=0;
 
-  /* Tree of canonical representatives */
+  /* Batches of designs */
+
+  DESIGN *batch[2],*d;
+  long nbatch[2],size,l;
+
+  /* Canonical representatives */
 
   int depth;
-  typedef struct node {
-     setword elem;
-     struct node *right;
-     struct node *down;
-  } NODE;
-  NODE *root, *work, *new;
+  CFSTORE store;
 
   /* Command line arguments */
   for(i=1; i<argc; ++i)
@@ -117,6 +253,7 @@ int main(int argc,char *argv[])
         if (argv[i][j] == 'c') mask |= 8;
 	if (argv[i][j] == 'C') mask &= ~8; 
 	if (argv[i][j] == 'p') sscanf(argv[i]+j+1,"%d",&p);
+	if (argv[i][j] == 'j') sscanf(argv[i]+j+1,"%d",&nthreads);
 
         /* Help */
         if ((argv[i][j] == 'h') || (argv[i][j] == 'H') || (argv[i][j] == '?'))
@@ -127,12 +264,18 @@ int main(int argc,char *argv[])
           printf("-i, -I  Print incidence matrices (default no)\n"); 
           printf("-d, -D  Print designs in GAP format (default no)\n"); 
           printf("-pN     Color points in classes of size N (default no)\n");
+          printf("-jN     Canonize with N threads (default N=1)\n");
 	  exit(0);
         }
         ++j;
       }
     }
 
+  if (nthreads<1 || nthreads>MAXTHREADS)
+  { printf("Number of threads must be between 1 and %d.\n",MAXTHREADS);
+    exit(0);
+  }
+
   ok=scanf("%d",&v)==1;
   ok=ok && scanf("%d",&b)==1;
 
@@ -142,29 +285,56 @@ int main(int argc,char *argv[])
   }
 
   options.writeautoms = FALSE;
-  options.schreier = TRUE;
   options.defaultptn = FALSE;
   options.getcanon = TRUE;
+  options.schreier = TRUE;
 
   n=v+b;
   m = SETWORDSNEEDED(n);
   depth = v*m;
+  cfstore_init(&store,depth);
 
   nauty_check(WORDSIZE,m,n,NAUTYVERSIONID);
 
-  DYNALLOC2(graph,g,g_sz,m,n,"malloc");
-  DYNALLOC1(int,lab,lab_sz,n,"malloc");
-  DYNALLOC1(int,ptn,ptn_sz,n,"malloc");
-  DYNALLOC1(int,orbits,orbits_sz,n,"malloc");
-  EMPTYGRAPH(g,m,n);
+  /* Workspaces of the threads */
 
-  for (i=0; i<n; ++i) 
-  { lab[i] = i; 
-    ptn[i] = 1; 
+  for (k=0; k<nthreads; ++k)
+  { work[k].lab=(int *)allocate(n*sizeof(int));
+    work[k].ptn=(int *)allocate(n*sizeof(int));
+    work[k].orbits=(int *)allocate(n*sizeof(int));
+    for (i=0; i<n; ++i) 
+    { work[k].lab[i] = i; 
+      work[k].ptn[i] = 1; 
+    }
+    work[k].ptn[v-1] = 0;
+    work[k].ptn[n-1] = 0;
+    if (p>0) for (i=0; i<v; ++i) if ((i+1)%p==0) work[k].ptn[i]=0;
+    work[k].options=options;
+    SG_INIT(work[k].sg);
+    SG_INIT(work[k].cg);
+  }
+
+  /* One design at a time with one thread, otherwise BATCH designs per
+     thread. Batches are read while the previous one is canonized. */
+
+  size = nthreads>1 ? (long)BATCH*nthreads : 1;
+  for (k=0; k<2; ++k)
+  { batch[k]=(DESIGN *)allocate(size*sizeof(DESIGN));
+    for (l=0; l<size; ++l)
+    { batch[k][l].g=(graph *)allocate((size_t)m*n*sizeof(graph));
+      batch[k][l].cng=(graph *)allocate((size_t)m*n*sizeof(graph));
+    }
+  }
+
+  if (nthreads>1)
+  { pthread_barrier_init(&batchstart,NULL,nthreads+1);
+    pthread_barrier_init(&batchdone,NULL,nthreads+1);
+    for (k=0; k<nthreads; ++k)
+      if (pthread_create(&thread[k],NULL,workcanon,work+k)!=0)
+      { printf("Cannot create thread!\n");
+        exit(0);
+      }
   }
-  ptn[v-1] = 0;
-  ptn[n-1] = 0;
-  if (p>0) for (i=0; i<v; ++i) if ((i+1)%p==0) ptn[i]=0;
 
   if (mask & 6) printf("%d %d\n",v,b);
   if (mask & 2) printf("\n");
@@ -175,177 +345,64 @@ int main(int argc,char *argv[])
   ok=1;
   while (ok==1 && c!='[') ok=scanf("%c",&c);
 
-  while (ok==1)
-  { EMPTYGRAPH(g,m,n);
+  status=ok;
+  cur=0;
+  nbatch[0] = status==1 ? readbatch(batch[0],size,&status) : 0;
 
-    c=0;
-    while (ok==1 && c!='[') ok=scanf("%c",&c);
+  while (nbatch[cur]>0)
+  { /* Canonize the batch while the next one is read */
 
-    if (ok==1) 
-    { i=0;
-      while (i<b)
-      { /* printf("Block %d: ",i+1); */
-        c=0;
-        while (ok==1 && c!='[') ok=scanf("%c",&c);
-        if (ok!=1)
-        { printf("Error reading design.\n");
-          exit(0);
-        }
-        c=',';
-        while (ok==1 && c==',')
-        { ok=scanf("%d",&x);
-          if (x<1 || x>v) 
-          { printf("Error reading point of design.\n");
-            exit(0);
-          }
-          /* printf("%d ",x); */
-          --x;
-          ADDONEEDGE(g,v+i,x,m);
-          c=0;
-          while (ok==1 && c!=']' && c!=',') ok= scanf("%c",&c);
-          if (ok!=1)
-          { printf("Error reading design.\n");
-            exit(0);
-          }
-        }
+    current=batch[cur];
+    ncurrent=nbatch[cur];
+    nextdesign=0;
+    if (nthreads==1) canonbatch(work);
+    else pthread_barrier_wait(&batchstart);
+    nbatch[1-cur] = status==1 ? readbatch(batch[1-cur],size,&status) : 0;
+    if (nthreads>1) pthread_barrier_wait(&batchdone);
 
-        ++i;
-      }
+    /* Memorise canonical representatives in the order of the input */
 
+    for (l=0; l<nbatch[cur]; ++l)
+    { d=batch[cur]+l;
       ++count;
-
-      /* Convert to sparse graph */
-
-      if (count==1) sgp=nauty_to_sg(g,NULL,m,n);
-      else nauty_to_sg(g,sgp,m,n);
-
-      /* Call nauty */
-
-      sparsenauty(sgp,lab,ptn,orbits,&options,&stats,&cg);
-
-      /* printf("Design #%ld. |Aut|=",count);
-      writegroupsize(stdout,stats.grpsize1,stats.grpsize2);
-      printf("\n"); */
-      
-      if (count==1) cng=sg_to_nauty(&cg,NULL,m,&mc);
-      else sg_to_nauty(&cg,cng,m,&mc);
-      if (m!=mc)
-      { printf("Error: canonical m different!\n");
-	exit(0);
-      }
-
-      /* Memorise canonical representative, if necessary */
-
-      /* First design */
-
-      if (count==1)
+      if (cfstore_insert(&store,d->cng)!=0)
       { ++countout;
-	if (mask & 8) 
-	{ printf("Design #%lu. |Aut|=",count); 
-          writegroupsize(stdout,stats.grpsize1,stats.grpsize2);
+        if (mask & 8)
+        { printf("Design #%lu. |Aut|=",count);
+          writegroupsize(stdout,d->grpsize1,d->grpsize2);
           printf(". New, memorised as #%lu.\n",countout);
         }
-        root = (NODE *)malloc(sizeof(NODE));
-        if (root==NULL)
-        { printf("Out of memory!\n");
-          exit(0);
-        }
-        work = root;
-        work->elem = *cng;
-        work->down = NULL;
-        for (i=1; i<depth; ++i)
-        { new = (NODE *)malloc(sizeof(NODE));
-          if (new==NULL)
-          { printf("Out of memory!\n");
-            exit(0);
-	  }
-	  work->right = new;
-	  work = new;
-	  work->elem = *(cng+i);
-          work->down = NULL;
-        }
-        work->right = NULL;
-
-	if (mask & 1) printf("%ld\n",count);
-        if (mask & 2) printinc(g,v,b,m);
+        if (mask & 1) printf("%ld\n",count);
+        if (mask & 2) printinc(d->g,v,b,m);
         if (mask & 4)
-        { printf("[ ");
-          printdes(g,v,b,m);
+        { printf(countout==1 ? "[ " : ",\n");
+          printdes(d->g,v,b,m);
         }
-	fflush(stdout);
-      } 
-
-      /* Not the first design */
-
+        fflush(stdout);
+      }
       else
-      { work = root;
-        k = 0;
-        while ((k<depth) && ((work->elem == *(cng + k)) || (work->down != NULL)))
-          if (work->elem == *(cng + k))
-          { work = work->right;
-	    ++k;
-	  }
-	  else work = work->down;
-
-        if (k<depth) /* Rest of cng needs to be memorised */
-	{ ++countout;
-	  if (mask & 8) 
-	  { printf("Design #%lu. |Aut|=",count); 
-            writegroupsize(stdout,stats.grpsize1,stats.grpsize2);
-            printf(". New, memorised as #%lu.\n",countout);
-          }
-          new = (NODE *)malloc(sizeof(NODE));
-	  if (new==NULL)
-	  { printf("Out of memory!\n");
-	    exit(0);
-	  }
-          work->down = new;
-          work = new;
-          work->elem = *(cng + k);
-          work->down = NULL;
-          for (++k ; k<depth; ++k)
-          { new = (NODE *)malloc(sizeof(NODE));
-            if (new==NULL)
-            { printf("Out of memory!\n");
-	      exit(0);
-	    }
-            work->right = new;
-	    work = new;
-	    work->elem = *(cng + k);
-            work->down = NULL;
-          }
-	  new = (NODE *)malloc(sizeof(NODE));
-	  if (new==NULL)
-	  { printf("Out of memory!\n");
-	    exit(0);
-	  }
-	  work->right = new;
-	  new->elem = countout;
-	  new->right = NULL;
-          new->down = NULL;
-
-	  if (mask & 1) printf("%ld\n",count);
-          if (mask & 2) printinc(g,v,b,m);
-          if (mask & 4)
-          { printf(",\n");
-            printdes(g,v,b,m);
-          }
-	  fflush(stdout);
-
-	}
-	else
-	{ if (mask & 8) 
-	  { printf("Design #%lu. |Aut|=",count); 
-            writegroupsize(stdout,stats.grpsize1,stats.grpsize2);
-            printf(". Not new.\n");
-          }
+      { if (mask & 8)
+        { printf("Design #%lu. |Aut|=",count);
+          writegroupsize(stdout,d->grpsize1,d->grpsize2);
+          printf(". Not new.\n");
         }
       }
-
     }
+    cur=1-cur;
+  }
+
+  if (nthreads>1)
+  { current=NULL;
+    pthread_barrier_wait(&batchstart);
+    for (k=0; k<nthreads; ++k) pthread_join(thread[k],NULL);
+  }
+
+  if (status<0)
+  { printf("%s\n",readerror);
+    exit(0);
   }
 
   if (mask & 4) printf(" ]\n"); 
 
+  cfstore_free(&store);
 }
-
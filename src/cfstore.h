@@ -0,0 +1,144 @@
+/*
+    CFSTORE.H
+
+    Store of canonical forms for the isomorph rejection of bdfiltersp,
+    bdfiltertr, hadfilter and matfilter. A canonical form is a fixed
+    number of setwords of the canonical graph from nauty. The forms are
+    packed one after another into an arena and found through an open
+    addressing hash table keyed by a 128-bit hash of the form. A probe
+    compares the hash first and the form itself only when the hashes
+    agree, so a lookup touches one slot of the table and, if the form is
+    there, one form of the arena.
+
+    Include after nauty.h (or nausparse.h/traces.h), which defines setword.
+*/
+
+#ifndef CFSTORE_H
+#define CFSTORE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct cfslot {
+  unsigned long long h0,h1;     /* Hash of the form */
+  unsigned long index;          /* Index of the form + 1, 0 if empty */
+} CFSLOT;
+
+typedef struct cfstore {
+  size_t words;                 /* Setwords in a form */
+  setword *arena;               /* The forms, one after another */
+  unsigned long nforms,maxforms;
+  CFSLOT *table;
+  unsigned long size;           /* Slots in the table, a power of 2 */
+} CFSTORE;
+
+
+static void *cfstore_realloc(void *p, size_t size)
+{ p = realloc(p,size);
+  if (p==NULL)
+  { printf("Out of memory!\n");
+    exit(0);
+  }
+  return p;
+}
+
+
+static unsigned long long cfstore_mix(unsigned long long x)
+{ x^=x>>30;
+  x*=0xbf58476d1ce4e5b9ULL;
+  x^=x>>27;
+  x*=0x94d049bb133111ebULL;
+  x^=x>>31;
+  return x;
+}
+
+
+/* Two 64-bit hashes of the form with different multipliers */
+
+static void cfstore_hash(const CFSTORE *s, const setword *form, unsigned long long *h0, unsigned long long *h1)
+{ unsigned long long a,b,x;
+  size_t i;
+
+  a=0x9e3779b97f4a7c15ULL^s->words;
+  b=0xc2b2ae3d27d4eb4fULL;
+  for (i=0; i<s->words; ++i)
+  { x=(unsigned long long)form[i];
+    a=cfstore_mix(a^x);
+    b=(b^cfstore_mix(x+i))*0x100000001b3ULL;
+    b^=b>>29;
+  }
+  *h0=cfstore_mix(a);
+  *h1=cfstore_mix(b^a);
+}
+
+
+static void cfstore_init(CFSTORE *s, size_t words)
+{ s->words=words;
+  s->arena=NULL;
+  s->nforms=s->maxforms=0;
+  s->size=1024;
+  s->table=(CFSLOT *)calloc(s->size,sizeof(CFSLOT));
+  if (s->table==NULL)
+  { printf("Out of memory!\n");
+    exit(0);
+  }
+}
+
+
+static void cfstore_free(CFSTORE *s)
+{ free(s->arena);
+  free(s->table);
+  s->arena=NULL;
+  s->table=NULL;
+  s->nforms=s->maxforms=s->size=0;
+}
+
+
+static void cfstore_grow(CFSTORE *s)
+{ CFSLOT *old;
+  unsigned long i,k,oldsize;
+
+  old=s->table;
+  oldsize=s->size;
+  s->size*=2;
+  s->table=(CFSLOT *)calloc(s->size,sizeof(CFSLOT));
+  if (s->table==NULL)
+  { printf("Out of memory!\n");
+    exit(0);
+  }
+  for (i=0; i<oldsize; ++i) if (old[i].index!=0)
+  { k=old[i].h0&(s->size-1);
+    while (s->table[k].index!=0) k=(k+1)&(s->size-1);
+    s->table[k]=old[i];
+  }
+  free(old);
+}
+
+
+/* Add the form if it is not stored yet. Returns its number, starting
+   from 1, if it is new and 0 if it was already there. */
+
+static unsigned long cfstore_insert(CFSTORE *s, const setword *form)
+{ unsigned long long h0,h1;
+  unsigned long k;
+  CFSLOT *t;
+
+  cfstore_hash(s,form,&h0,&h1);
+  for (k=h0&(s->size-1); (t=s->table+k)->index!=0; k=(k+1)&(s->size-1))
+    if (t->h0==h0 && t->h1==h1 &&
+        memcmp(s->arena+(t->index-1)*s->words,form,s->words*sizeof(setword))==0) return 0;
+
+  if (s->nforms==s->maxforms)
+  { s->maxforms = s->maxforms ? 2*s->maxforms : 1024;
+    s->arena=(setword *)cfstore_realloc(s->arena,s->maxforms*s->words*sizeof(setword));
+  }
+  memcpy(s->arena+s->nforms*s->words,form,s->words*sizeof(setword));
+  t->h0=h0;
+  t->h1=h1;
+  t->index=++s->nforms;
+  if (2*s->nforms>s->size) cfstore_grow(s);
+  return s->nforms;
+}
+
+#endif
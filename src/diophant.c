@@ -29,6 +29,13 @@
 #include <string.h> 
 #include <malloc.h> 
 #include <math.h> 
+#include <pthread.h> 
+#include <setjmp.h> 
+#include <stdarg.h> 
+#include <time.h> 
+#include "diophant.h"
+#include "pagsol.h"
+#include "fpkernel.h"
 #if defined(MPREC)
 #include "freelip/lip.h"
 #undef BLAS
@@ -53,8 +60,16 @@ verylong c;
 int p;
 };
 #else
+#if defined(INT128)
+#define COEFFINT __int128
+#define COEFFINT_LIMIT 170141183460469231731687303715884105728.0  /* 2^127 */
+#else
+#define COEFFINT long
+#define COEFFINT_LIMIT 9223372036854775808.0  /* 2^63 */
+#endif
+#define ABS(x) ((x)<0?-(x):(x))
 struct coe{
-long c;
+COEFFINT c;
 int p;
 };
 #endif
@@ -65,41 +80,41 @@ int p;
 /*7:*/
 #line 190 "diophant.w"
 
+/* Everything one call of diophant_solve() works on. S points to it in the
+   calling thread and in its enumeration threads, so independent calls
+   can run one after another or in parallel threads. */
+
+typedef struct diophant_state{
 #if defined(MPREC)
-verylong matrix_factor= 0;
-verylong max_norm= 0;
-verylong max_norm_initial= 0;
-verylong max_up= 0;
-verylong dummy= 0;
+verylong matrix_factor;
+verylong max_norm;
+verylong max_norm_initial;
+verylong max_up;
+verylong dummy;
 #else
-long matrix_factor;
-long max_norm,max_norm_initial,max_up;
+COEFFINT matrix_factor;
+COEFFINT max_norm,max_norm_initial,max_up;
 #endif
 long nom,denom;
 long lastlines_factor;
 
-/*:7*//*8:*/
-#line 205 "diophant.w"
-
 int system_rows,system_columns;
 int lattice_rows,lattice_columns;
 COEFF**lattice;
+int lattice_size;                /* Allocated vectors of lattice */
 int free_RHS;
 int iszeroone;
 #if defined(MPREC)
 verylong*upperbounds;
-verylong upperbounds_max= 0;
-verylong upfac= 0;
-verylong upfac_h= 0;
+verylong upperbounds_max;
+verylong upfac;
+verylong upfac_h;
 #else
 long*upperbounds;
-long upperbounds_max;
-long upfac;
+COEFFINT upperbounds_max;
+COEFFINT upfac;
 #endif
 
-/*:8*//*9:*/
-#line 223 "diophant.w"
-
 int*original_columns;
 int no_original_columns;
 int cut_after_coeff;
@@ -111,11 +126,105 @@ int no_iterates;
 int bkz_beta,bkz_p;
 int SILENT;
 int nboundvars;
-
-/*:9*//*106:*/
+int shard_no,shard_total,shard_split;
+int enum_threads;
+int prune_trials;               /* Extreme pruning with so many bases */
+char*save_lattice_name,*load_lattice_name;
+char*lll_kernel;
+FPKERNEL kernel;                /* Dot product and axpy of the LLL */
+int sol_binary;
+long*fixed_values;
+unsigned long long system_hash[2];  /* Hash of the system for the lattice file */
+
+FILE*fp;                        /* Solution file, may be NULL */
+FILE*log;                       /* Messages, may be NULL */
+DIOPHANT_CALLBACK solution;
+void*data;
+long*solvec;                    /* The current solution */
+int*solbuf;
+int solbuf_size;
+int sol_header;
+
+pthread_mutex_t enum_lock;
+long next_subtree;
+volatile int enum_stop;
+int loop_limit_reached;
+long reduction_solutions;        /* Solutions reported during the reduction */
+int stop;                       /* Stop the reduction, no enumeration */
+
+FILE*profile;                   /* Profile as a GAP record, may be NULL */
+int profile_phases;
+double profile_start,phase_start,phase_defect,tour_start;
+double*tour_time,*tour_defect;  /* BKZ tours of the current phase */
+int tours,tours_size;
+jmp_buf abort;
+}DIOPHANT_STATE;
+
+static __thread DIOPHANT_STATE*S;
+
+/*:7*//*106:*/
 #line 2472 "diophant.w"
 
-static FILE*fp;
+
+/* Errors end the call of diophant_solve(), which returns code */
+static void diophant_abort(int code){
+longjmp(S->abort,code);
+}
+
+/* Progress messages go to the log file of the options, if there is one */
+static void message(const char*format,...){
+va_list args;
+
+if(S->log==NULL)return;
+va_start(args,format);
+vfprintf(S->log,format,args);
+va_end(args);
+}
+
+static void message_flush(){
+if(S->log!=NULL)fflush(S->log);
+}
+
+static void solution_buffer(int n){
+if(n> S->solbuf_size){
+S->solvec= (long*)realloc(S->solvec,n*sizeof(long));
+S->solbuf= (int*)realloc(S->solbuf,n*sizeof(int));
+if(S->solvec==NULL||S->solbuf==NULL){
+message("Out of memory\n");
+diophant_abort(DIOPHANT_ERROR);
+}
+S->solbuf_size= n;
+}
+}
+
+/* Write the solution in S->solvec to the binary solution file and hand
+   it to the callback. Returns 1 if the callback wants to stop.
+   The header of a binary solution file is written with the first solution. */
+static int report_solution(int n){
+int i;
+
+if(S->sol_binary){
+if(!S->sol_header){
+pagsol_header(S->fp,n);
+S->sol_header= 1;
+}
+for(i= 0;i<n;i++)S->solbuf[i]= (int)S->solvec[i];
+pagsol_put(S->fp,S->solbuf,n);
+}
+return S->solution!=NULL&&S->solution(S->solvec,n,S->data)==DIOPHANT_STOP;
+}
+
+/* Number of entries of a printed solution: all original columns, or
+   those up to the last bounded variable */
+static int solution_length(){
+int j,k;
+
+if(S->cut_after_coeff!=-1)return S->cut_after_coeff;
+if(S->nboundvars==0||S->nboundvars==S->system_columns)return S->no_original_columns;
+for(j= k= 0;j<S->no_original_columns&&k<S->nboundvars;j++)
+if(S->original_columns[j]!=0)k++;
+return j;
+}
 
 /*:106*/
 #line 46 "diophant.w"
@@ -124,14 +233,84 @@ static FILE*fp;
 #line 240 "diophant.w"
 
 #if defined(MPREC)
-#define put_to(i,j,val) zcopy(val,&(lattice[i][j+1].c))
-#define smult_lattice(i,j,factor) zmulin(factor,&(lattice[i][j+1].c))
+#define put_to(i,j,val) zcopy(val,&(S->lattice[i][j+1].c))
+#define smult_lattice(i,j,factor) zmulin(factor,&(S->lattice[i][j+1].c))
+#else
+#define put_to(i,j,val) S->lattice[i][j+1].c =  val
+#define smult_lattice(i,j,factor) S->lattice[i][j+1].c =  coeff_mul(S->lattice[i][j+1].c,factor)
+#define sdiv_lattice(i,j,factor) S->lattice[i][j+1].c /=  factor
+#endif
+#define get_entry(i,j) S->lattice[i][j+1].c
+
+#if !defined(MPREC)
+/* Lattice entries are checked for overflow. diophant_solve() then
+   returns DIOPHANT_OVERFLOW, solvediophant stops with exit code 2 and
+   the system has to be solved by a version with larger integers. */
+
+void coeff_overflow(){
+#if defined(INT128)
+fprintf(stderr,"Integer overflow, use the multiprecision version of solvediophant.\n");
+message("Integer overflow, use the multiprecision version of solvediophant.\n");
 #else
-#define put_to(i,j,val) lattice[i][j+1].c =  val
-#define smult_lattice(i,j,factor) lattice[i][j+1].c *=  factor
-#define sdiv_lattice(i,j,factor) lattice[i][j+1].c /=  factor
+fprintf(stderr,"Integer overflow, use solvediophant128.\n");
+message("Integer overflow, use solvediophant128.\n");
+#endif
+message_flush();
+diophant_abort(DIOPHANT_OVERFLOW);
+}
+
+static inline COEFFINT coeff_mul(COEFFINT a,COEFFINT b){
+COEFFINT r;
+if(__builtin_mul_overflow(a,b,&r))coeff_overflow();
+return r;
+}
+
+static inline COEFFINT coeff_add(COEFFINT a,COEFFINT b){
+COEFFINT r;
+if(__builtin_add_overflow(a,b,&r))coeff_overflow();
+return r;
+}
+
+static inline COEFFINT coeff_sub(COEFFINT a,COEFFINT b){
+COEFFINT r;
+if(__builtin_sub_overflow(a,b,&r))coeff_overflow();
+return r;
+}
+
+void fprint_coeff(FILE*f,COEFFINT x){
+char buf[48];
+int i;
+unsigned COEFFINT u;
+
+u= (x<0)?-(unsigned COEFFINT)x:(unsigned COEFFINT)x;
+i= sizeof(buf)-1;
+buf[i]= '\0';
+do{
+buf[--i]= '0'+(int)(u%10);
+u/= 10;
+}while(u> 0);
+if(x<0)buf[--i]= '-';
+fputs(buf+i,f);
+}
+
+int fscan_coeff(FILE*f,COEFFINT*x){
+int ch,neg;
+unsigned COEFFINT u;
+
+do ch= getc(f);while(ch==' '||ch=='\n'||ch=='\t'||ch=='\r');
+neg= (ch=='-');
+if(neg)ch= getc(f);
+if(ch<'0'||ch> '9')return 0;
+u= 0;
+while(ch>='0'&&ch<='9'){
+u= 10*u+(ch-'0');
+ch= getc(f);
+}
+if(ch!=EOF)ungetc(ch,f);
+*x= neg?-(COEFFINT)u:(COEFFINT)u;
+return 1;
+}
 #endif
-#define get_entry(i,j) lattice[i][j+1].c
 
 /*:10*/
 #line 47 "diophant.w"
@@ -144,7 +323,7 @@ static FILE*fp;
 
 void debug_print(char*m,int l){
 if(VERBOSE>=l){
-printf("debug>> %s\n",m);fflush(stdout);
+message("debug>> %s\n",m);message_flush();
 }
 return;
 }
@@ -158,35 +337,37 @@ return;
 #if 1
 void print_lattice(){
 int i,j;
-for(i= 0;i<lattice_columns;i++){
-for(j= 0;j<lattice_rows;j++){
+for(i= 0;i<S->lattice_columns;i++){
+for(j= 0;j<S->lattice_rows;j++){
 #if defined(MPREC)
 zwrite(get_entry(i,j));
-printf(" ");
+message(" ");
 #else
-printf("%ld ",get_entry(i,j));
+if(S->log!=NULL)fprint_coeff(S->log,get_entry(i,j));
+message(" ");
 #endif   
 }
-printf("\n");
+message("\n");
 }
-printf("\n");fflush(stdout);
+message("\n");message_flush();
 return;
 }
 #else
 void print_lattice(){
 int i,j;
-for(j= 0;j<lattice_rows;j++){
-for(i= 0;i<lattice_columns;i++){
+for(j= 0;j<S->lattice_rows;j++){
+for(i= 0;i<S->lattice_columns;i++){
 #if defined(MPREC)
 zwrite(get_entry(i,j));
-printf(" ");
+message(" ");
 #else
-printf("%ld ",get_entry(i,j));
+if(S->log!=NULL)fprint_coeff(S->log,get_entry(i,j));
+message(" ");
 #endif   
 }
-printf("\n");
+message("\n");
 }
-printf("\n");fflush(stdout);
+message("\n");message_flush();
 return;
 }
 #endif
@@ -196,8 +377,8 @@ return;
 /*30:*/
 #line 621 "diophant.w"
 
-long gcd(long n1,long n2){
-long a,b,c;
+COEFFINT gcd(COEFFINT n1,COEFFINT n2){
+COEFFINT a,b,c;
 
 if(n1> n2){
 a= n1;b= n2;
@@ -239,19 +420,22 @@ return;
 
 int cutlattice(){
 int j,i,flag;
+COEFF*swap_vec;
 
 /*33:*/
 #line 685 "diophant.w"
 
 j= 0;
 do{
-if(lattice[j][0].p> system_rows)
+if(S->lattice[j][0].p> S->system_rows)
 j++;
 else{
-for(i= j+1;i<lattice_columns;i++)lattice[i-1]= lattice[i];
-lattice_columns--;
+swap_vec= S->lattice[j];
+for(i= j+1;i<S->lattice_columns;i++)S->lattice[i-1]= S->lattice[i];
+S->lattice[S->lattice_columns-1]= swap_vec;
+S->lattice_columns--;
 }
-}while(j<lattice_columns-1);
+}while(j<S->lattice_columns-1);
 
 /*:33*/
 #line 662 "diophant.w"
@@ -261,37 +445,37 @@ lattice_columns--;
 
 flag= 0;
 #if defined(MPREC)
-for(i= 0;i<lattice_columns;i++)if(!ziszero(get_entry(i,lattice_rows-1))){
+for(i= 0;i<S->lattice_columns;i++)if(!ziszero(get_entry(i,S->lattice_rows-1))){
 #else
-for(i= 0;i<lattice_columns;i++)if(get_entry(i,lattice_rows-1)!=0){
+for(i= 0;i<S->lattice_columns;i++)if(get_entry(i,S->lattice_rows-1)!=0){
 #endif
 flag= 1;
 break;
 }
 if(flag==0){
-printf("Nonhomogenous solution not possible.\n");fflush(stdout);
-exit(1);
+message("Nonhomogenous solution not possible.\n");message_flush();
+diophant_abort(DIOPHANT_ERROR);
 return 0;
 }
 /*:34*/
 #line 663 "diophant.w"
 ;
 
-for(j= 0;j<lattice_columns;j++){
-if(nboundvars==0){
-for(i= system_rows;i<lattice_rows;i++)
-put_to(j,i-system_rows,get_entry(j,i));
+for(j= 0;j<S->lattice_columns;j++){
+if(S->nboundvars==0){
+for(i= S->system_rows;i<S->lattice_rows;i++)
+put_to(j,i-S->system_rows,get_entry(j,i));
 }else{
-for(i= system_rows;i<system_rows+nboundvars;i++)
-put_to(j,i-system_rows,get_entry(j,i));
-for(i= system_rows+system_columns;i<lattice_rows;i++)
-put_to(j,i-system_rows-system_columns+nboundvars,get_entry(j,i));
+for(i= S->system_rows;i<S->system_rows+S->nboundvars;i++)
+put_to(j,i-S->system_rows,get_entry(j,i));
+for(i= S->system_rows+S->system_columns;i<S->lattice_rows;i++)
+put_to(j,i-S->system_rows-S->system_columns+S->nboundvars,get_entry(j,i));
 }
 }
-lattice_rows-= system_rows;
-lattice_rows-= (system_columns-nboundvars);
+S->lattice_rows-= S->system_rows;
+S->lattice_rows-= (S->system_columns-S->nboundvars);
 
-for(j= 0;j<lattice_columns;j++)coeffinit(lattice[j],lattice_rows);
+for(j= 0;j<S->lattice_columns;j++)coeffinit(S->lattice[j],S->lattice_rows);
 
 return 1;
 }
@@ -299,6 +483,329 @@ return 1;
 /*:32*/
 #line 570 "diophant.w"
 ;
+/* Profile: the phases are written to S->profile as records of a GAP
+   list, each with its wall clock time and the orthogonal defect of the
+   basis before and after it. */
+
+static double profile_clock(){
+struct timespec t;
+
+clock_gettime(CLOCK_MONOTONIC,&t);
+return t.tv_sec+1e-9*t.tv_nsec;
+}
+
+/* Logarithm of the orthogonal defect of the first lattice_columns-1
+   vectors, by Gram-Schmidt in floating point */
+static double profile_defect(){
+int i,j,l;
+int s= S->lattice_columns-1,z= S->lattice_rows;
+DOUBLE**bd,*c,norm,defect;
+
+bd= (DOUBLE**)calloc(s,sizeof(DOUBLE*));
+c= (DOUBLE*)calloc(s,sizeof(DOUBLE));
+defect= 0.0;
+for(i= 0;i<s;i++){
+bd[i]= (DOUBLE*)calloc(z,sizeof(DOUBLE));
+#if defined(MPREC)
+for(l= 0;l<z;l++)bd[i][l]= zdoub(get_entry(i,l));
+#else
+for(l= 0;l<z;l++)bd[i][l]= (DOUBLE)get_entry(i,l);
+#endif
+norm= S->kernel.dot(bd[i],bd[i],z);
+for(j= 0;j<i;j++)if(c[j]> 0.0)S->kernel.axpy(bd[i],bd[j],-S->kernel.dot(bd[i],bd[j],z)/c[j],z);
+c[i]= S->kernel.dot(bd[i],bd[i],z);
+if(c[i]> 0.0&&norm> 0.0)defect+= log(norm)-log(c[i]);
+}
+for(i= 0;i<s;i++)free(bd[i]);
+free(bd);
+free(c);
+return defect/2.0;
+}
+
+static void profile_begin(){
+if(S->profile==NULL)return;
+S->tours= 0;
+S->phase_defect= profile_defect();
+S->phase_start= S->tour_start= profile_clock();
+}
+
+/* A BKZ tour with orthogonal defect defect has ended */
+static void profile_tour(double defect){
+double t;
+
+if(S->profile==NULL)return;
+if(S->tours>=S->tours_size){
+S->tours_size= 2*S->tours_size+16;
+S->tour_time= (double*)realloc(S->tour_time,S->tours_size*sizeof(double));
+S->tour_defect= (double*)realloc(S->tour_defect,S->tours_size*sizeof(double));
+}
+t= profile_clock();
+S->tour_time[S->tours]= t-S->tour_start;
+S->tour_defect[S->tours++]= defect;
+S->tour_start= t;
+}
+
+static void profile_end(const char*name){
+int i;
+
+if(S->profile==NULL)return;
+fprintf(S->profile,"%s\n  rec( Name:=\"%s\", Time:=%.3f, DefectBefore:=%.4f, DefectAfter:=%.4f",
+S->profile_phases++> 0?",":"",name,profile_clock()-S->phase_start,
+S->phase_defect,profile_defect());
+if(S->tours> 0){
+fprintf(S->profile,",\n    Tours:=[ ");
+for(i= 0;i<S->tours;i++)
+fprintf(S->profile,"%srec( Time:=%.3f, Defect:=%.4f )",i> 0?", ":"",S->tour_time[i],S->tour_defect[i]);
+fprintf(S->profile," ]");
+}
+fprintf(S->profile," )");
+}
+
+/* The enumeration: nodes[l] loops at level l, and how often the
+   pruning tests were made and successful. cs counts the nodes cut by
+   the radius or by N. */
+static void profile_enumeration(long*nodes,int levels,long loops,long cs,long N,long fipo,
+long only_zeros_no,long only_zeros,long hoelder_no,long hoelder){
+int l;
+
+if(S->profile==NULL)return;
+fprintf(S->profile,"%s\n  rec( Name:=\"enumeration\", Time:=%.3f, Loops:=%ld, Solutions:=%ld,\n    NodesAtLevel:=[ ",
+S->profile_phases++> 0?",":"",profile_clock()-S->phase_start,loops,S->nosolutions);
+for(l= 0;l<levels;l++)fprintf(S->profile,"%s%ld",l> 0?", ":"",nodes[l]);
+fprintf(S->profile," ],\n    Prune:=rec( CS:=rec( Hits:=%ld, Tries:=%ld ), N:=rec( Hits:=%ld, Tries:=%ld ),",
+cs-N,loops,N,loops-cs+N);
+fprintf(S->profile," FinckePohst:=rec( Hits:=%ld, Tries:=%ld ),",fipo,loops-cs);
+fprintf(S->profile," OnlyZeros:=rec( Hits:=%ld, Tries:=%ld ), Hoelder:=rec( Hits:=%ld, Tries:=%ld ) ) )",
+only_zeros,only_zeros_no,hoelder,hoelder_no);
+}
+
+/* Extreme pruning: replace the basis vectors 0..s-1 by a random
+   unimodular combination of them, to be reduced again by lll().
+   Only vectors that are zero in the right-hand side rows are added
+   to others, so the right-hand side is kept in a single vector. */
+
+static void randomize_lattice(int s,int z,unsigned int*seed){
+int i,j,k,l;
+COEFF*swap_vec;
+
+for(i= s-1;i> 0;i--){
+j= rand_r(seed)%(i+1);
+swap_vec= S->lattice[i];
+S->lattice[i]= S->lattice[j];
+S->lattice[j]= swap_vec;
+}
+for(i= 0;i<s;i++){
+for(k= 0;k<3;k++){
+j= rand_r(seed)%s;
+#if defined(MPREC)
+if(j==i||!ziszero(get_entry(j,z-1))||(S->free_RHS&&!ziszero(get_entry(j,z-2))))continue;
+if(rand_r(seed)&1)
+for(l= 1;l<=z;l++)zadd(S->lattice[i][l].c,S->lattice[j][l].c,&(S->lattice[i][l].c));
+else
+for(l= 1;l<=z;l++)zsub(S->lattice[i][l].c,S->lattice[j][l].c,&(S->lattice[i][l].c));
+#else
+if(j==i||get_entry(j,z-1)!=0||(S->free_RHS&&get_entry(j,z-2)!=0))continue;
+if(rand_r(seed)&1)
+for(l= 1;l<=z;l++)S->lattice[i][l].c= coeff_add(S->lattice[i][l].c,S->lattice[j][l].c);
+else
+for(l= 1;l<=z;l++)S->lattice[i][l].c= coeff_sub(S->lattice[i][l].c,S->lattice[j][l].c);
+#endif
+}
+coeffinit(S->lattice[i],z);
+}
+}
+
+/* The reduced lattice is saved as text: a header line, the parameters
+   of the system and of the scaling, the preselected columns and then
+   one line per basis vector. */
+
+#define LATTICE_MAGIC "PAGLATTICE 2"
+
+static unsigned long long hash_mix(unsigned long long x){
+x^= x>>30;
+x*= 0xbf58476d1ce4e5b9ULL;
+x^= x>>27;
+x*= 0x94d049bb133111ebULL;
+x^= x>>31;
+return x;
+}
+
+static void hash_word(unsigned long long x){
+S->system_hash[0]= hash_mix(S->system_hash[0]^x);
+S->system_hash[1]= (S->system_hash[1]^hash_mix(x+0x9e3779b97f4a7c15ULL))*0x100000001b3ULL;
+S->system_hash[1]^= S->system_hash[1]>>29;
+}
+
+#if defined(MPREC)
+static void hash_int(verylong x){
+long i,n;
+
+if(x==NULL){
+hash_word(0);
+return;
+}
+n= labs(x[0]);
+for(i= 0;i<=n;i++)hash_word((unsigned long long)x[i]);
+}
+#else
+static void hash_int(long x){
+hash_word((unsigned long long)x);
+}
+#endif
+
+/* 128-bit hash of the system as given to diophant_solve(): matrix,
+   right-hand side, upper bounds, the selected columns and the values
+   of the columns removed by the presolve. A lattice file is only
+   accepted for a system with the same hash. */
+static void hash_system(DIOPHANT_INT**a_input,DIOPHANT_INT*b_input,DIOPHANT_INT*upperbounds_input){
+int i,j;
+
+S->system_hash[0]= 0x6a09e667f3bcc908ULL;
+S->system_hash[1]= 0xbb67ae8584caa73bULL;
+hash_word(S->system_rows);
+hash_word(S->system_columns);
+for(j= 0;j<S->system_rows;j++){
+for(i= 0;i<S->system_columns;i++)hash_int(a_input[j][i]);
+hash_int(b_input[j]);
+}
+hash_word(upperbounds_input!=NULL);
+if(upperbounds_input!=NULL){
+hash_word(S->nboundvars);
+for(i= 0;i<S->nboundvars;i++)hash_int(upperbounds_input[i]);
+}
+hash_word(S->no_original_columns);
+for(i= 0;i<S->no_original_columns;i++){
+hash_word(S->original_columns[i]);
+if(S->original_columns[i]==0)
+hash_word((S->fixed_values!=NULL)?S->fixed_values[i]:0);
+}
+S->system_hash[0]= hash_mix(S->system_hash[0]);
+S->system_hash[1]= hash_mix(S->system_hash[1]^S->system_hash[0]);
+}
+
+void write_lattice(char*name){
+FILE*f;
+int i,j;
+
+f= fopen(name,"w");
+if(f==NULL){
+fprintf(stderr,"Could not open %s\n",name);
+diophant_abort(DIOPHANT_ERROR);
+}
+fprintf(f,"%s\n",LATTICE_MAGIC);
+fprintf(f,"%d %d %d %d %d\n",S->system_rows,S->system_columns,S->free_RHS,S->nboundvars,S->iszeroone);
+fprintf(f,"%016llx%016llx\n",S->system_hash[0],S->system_hash[1]);
+fprintf(f,"%d %d\n",S->lattice_columns,S->lattice_rows);
+#if defined(MPREC)
+zfwrite(f,S->max_norm);fprintf(f," ");
+zfwrite(f,S->max_norm_initial);fprintf(f," ");
+zfwrite(f,S->max_up);fprintf(f," ");
+zfwrite(f,S->upperbounds_max);
+fprintf(f," %ld\n",S->lastlines_factor);
+#else
+fprint_coeff(f,S->max_norm);fprintf(f," ");
+fprint_coeff(f,S->max_norm_initial);fprintf(f," ");
+fprint_coeff(f,S->max_up);fprintf(f," ");
+fprint_coeff(f,S->upperbounds_max);
+fprintf(f," %ld\n",S->lastlines_factor);
+#endif
+fprintf(f,"%d\n",S->no_original_columns);
+for(i= 0;i<S->no_original_columns;i++)fprintf(f,"%d ",S->original_columns[i]);
+fprintf(f,"\n");
+for(j= 0;j<S->lattice_columns;j++){
+for(i= 0;i<S->lattice_rows;i++){
+#if defined(MPREC)
+zfwrite(f,get_entry(j,i));
+fprintf(f," ");
+#else
+fprint_coeff(f,get_entry(j,i));
+fprintf(f," ");
+#endif
+}
+fprintf(f,"\n");
+}
+if(fclose(f)!=0){
+fprintf(stderr,"Could not write %s\n",name);
+diophant_abort(DIOPHANT_ERROR);
+}
+message("Reduced lattice written to %s\n",name);message_flush();
+}
+
+static void lattice_mismatch(FILE*f,char*name){
+fclose(f);
+fprintf(stderr,"The lattice in %s does not belong to this system.\n",name);
+diophant_abort(DIOPHANT_ERROR);
+}
+
+void read_lattice(char*name){
+FILE*f;
+int i,j,k;
+int h[7];
+unsigned long long hash[2];
+char magic[20];
+#if defined(MPREC)
+verylong v[4];
+for(i= 0;i<4;i++)v[i]= 0;
+#else
+COEFFINT v[4];
+#endif
+
+f= fopen(name,"r");
+if(f==NULL){
+fprintf(stderr,"Could not open %s\n",name);
+diophant_abort(DIOPHANT_ERROR);
+}
+if(fgets(magic,sizeof(magic),f)==NULL||strncmp(magic,LATTICE_MAGIC,strlen(LATTICE_MAGIC))!=0){
+fprintf(stderr,"%s is not a lattice file\n",name);
+fclose(f);
+diophant_abort(DIOPHANT_ERROR);
+}
+for(i= 0;i<5;i++)if(fscanf(f,"%d",&h[i])!=1)lattice_mismatch(f,name);
+if(fscanf(f," %16llx%16llx",&hash[0],&hash[1])!=2||
+hash[0]!=S->system_hash[0]||hash[1]!=S->system_hash[1])
+lattice_mismatch(f,name);
+for(i= 5;i<7;i++)if(fscanf(f,"%d",&h[i])!=1)lattice_mismatch(f,name);
+#if defined(MPREC)
+for(i= 0;i<4;i++)zfread(f,&v[i]);
+if(fscanf(f,"%ld",&S->lastlines_factor)!=1)lattice_mismatch(f,name);
+if(zcompare(v[0],S->max_norm)!=0||zcompare(v[1],S->max_norm_initial)!=0||
+zcompare(v[2],S->max_up)!=0||zcompare(v[3],S->upperbounds_max)!=0)
+lattice_mismatch(f,name);
+#else
+for(i= 0;i<4;i++)if(fscan_coeff(f,&v[i])!=1)lattice_mismatch(f,name);
+if(fscanf(f,"%ld",&S->lastlines_factor)!=1)lattice_mismatch(f,name);
+if(v[0]!=S->max_norm||v[1]!=S->max_norm_initial||v[2]!=S->max_up||v[3]!=S->upperbounds_max)
+lattice_mismatch(f,name);
+#endif
+if(h[0]!=S->system_rows||h[1]!=S->system_columns||h[2]!=S->free_RHS||
+h[3]!=S->nboundvars||h[4]!=S->iszeroone||
+h[5]<2||h[5]> S->lattice_columns||h[6]<2||h[6]> S->lattice_rows)
+lattice_mismatch(f,name);
+if(fscanf(f,"%d",&k)!=1||k!=S->no_original_columns)lattice_mismatch(f,name);
+for(i= 0;i<S->no_original_columns;i++)
+if(fscanf(f,"%d",&k)!=1||k!=S->original_columns[i])lattice_mismatch(f,name);
+
+S->lattice_columns= h[5];
+S->lattice_rows= h[6];
+for(j= 0;j<S->lattice_columns;j++){
+for(i= 0;i<S->lattice_rows;i++){
+#if defined(MPREC)
+if(zfread(f,&(S->lattice[j][i+1].c))==0){
+#else
+if(fscan_coeff(f,&(S->lattice[j][i+1].c))!=1){
+#endif
+fprintf(stderr,"%s is damaged\n",name);
+fclose(f);
+diophant_abort(DIOPHANT_ERROR);
+}
+}
+coeffinit(S->lattice[j],S->lattice_rows);
+}
+fclose(f);
+message("Reduced lattice read from %s\n",name);message_flush();
+}
+
+
 /*35:*/
 #line 715 "diophant.w"
 
@@ -311,20 +818,20 @@ int end;
 static verylong u= 0;
 static verylong s= 0;
 #else
-long u,s;
+COEFFINT u,s;
 #endif
 
 /*36:*/
 #line 745 "diophant.w"
 
 #if defined(MPREC)
-zcopy(get_entry(position,lattice_rows-1),&dummy);
-zabs(&dummy);
-if(zcompare(dummy,max_norm)!=0)return 0;
-if(ziszero(get_entry(position,lattice_rows-1-free_RHS)))return 0;
+zcopy(get_entry(position,S->lattice_rows-1),&S->dummy);
+zabs(&S->dummy);
+if(zcompare(S->dummy,S->max_norm)!=0)return 0;
+if(ziszero(get_entry(position,S->lattice_rows-1-S->free_RHS)))return 0;
 #else
-if(labs(get_entry(position,lattice_rows-1))!=max_norm)return 0;
-if(get_entry(position,lattice_rows-1-free_RHS)==0)return 0;
+if(ABS(get_entry(position,S->lattice_rows-1))!=S->max_norm)return 0;
+if(get_entry(position,S->lattice_rows-1-S->free_RHS)==0)return 0;
 #endif
 /*:36*/
 #line 728 "diophant.w"
@@ -333,111 +840,110 @@ if(get_entry(position,lattice_rows-1-free_RHS)==0)return 0;
 #line 762 "diophant.w"
 
 low= 0;
-up= lattice_rows-1-free_RHS;
+up= S->lattice_rows-1-S->free_RHS;
 #if defined(MPREC)
-if(lattice_columns==system_columns+2+free_RHS){
-for(i= 0;i<system_rows;i++)
+if(S->lattice_columns==S->system_columns+2+S->free_RHS){
+for(i= 0;i<S->system_rows;i++)
 if(!ziszero(get_entry(position,i)))return 0;
-low= system_rows;
+low= S->system_rows;
 }
 
-if(iszeroone){
+if(S->iszeroone){
 for(i= low;i<up;i++){
-zcopy(get_entry(position,i),&dummy);
-zabs(&dummy);
-if(zcompare(dummy,max_norm)!=0)return 0;
+zcopy(get_entry(position,i),&S->dummy);
+zabs(&S->dummy);
+if(zcompare(S->dummy,S->max_norm)!=0)return 0;
 }
 }else{
 for(i= low;i<up;i++){
-zcopy(get_entry(position,i),&dummy);
-zabs(&dummy);
-if(zcompare(dummy,max_norm)==1)return 0;
+zcopy(get_entry(position,i),&S->dummy);
+zabs(&S->dummy);
+if(zcompare(S->dummy,S->max_norm)==1)return 0;
 }
 }
 #else
-if(lattice_columns==system_columns+2+free_RHS){
-for(i= 0;i<system_rows;i++)
+if(S->lattice_columns==S->system_columns+2+S->free_RHS){
+for(i= 0;i<S->system_rows;i++)
 if(get_entry(position,i)!=0)return 0;
-low= system_rows;
+low= S->system_rows;
 }
 
-if(iszeroone){
+if(S->iszeroone){
 for(i= low;i<up;i++)
-if(labs(get_entry(position,i))!=max_norm)return 0;
+if(ABS(get_entry(position,i))!=S->max_norm)return 0;
 }else{
 for(i= low;i<up;i++)
-if(labs(get_entry(position,i))> max_norm)return 0;
+if(ABS(get_entry(position,i))> S->max_norm)return 0;
 }
 #endif
 /*:37*/
 #line 729 "diophant.w"
 ;
+if(S->shard_no!=0)return 1;
 
 #if defined(MPREC)
-zone(&upfac);
-zsdiv(get_entry(position,lattice_rows-1),lastlines_factor,&s);
+zone(&S->upfac);
+zsdiv(get_entry(position,S->lattice_rows-1),S->lastlines_factor,&s);
 #else
-upfac= 1;
-s= get_entry(position,lattice_rows-1)/lastlines_factor;
+S->upfac= 1;
+s= get_entry(position,S->lattice_rows-1)/S->lastlines_factor;
 #endif 
 
 /*38:*/
 #line 801 "diophant.w"
 
 i= low;
-if(cut_after_coeff==-1){
-end= no_original_columns;
-if(nboundvars!=0){
-end= nboundvars;
-}
-}else{
-end= cut_after_coeff;
-}
+end= solution_length();
+solution_buffer(end);
 
 for(j= 0;j<end;j++){
 #if defined(MPREC)
-if(original_columns[j]==0){
+if(S->original_columns[j]==0){
 zzero(&u);
 }else{
-if(!iszeroone)
-zdiv(upperbounds_max,upperbounds[i-low],&upfac,&upfac_h);
+if(!S->iszeroone)
+zdiv(S->upperbounds_max,S->upperbounds[i-low],&S->upfac,&S->upfac_h);
 zsub(get_entry(position,i),s,&u);
-zdiv(u,max_norm_initial,&u,&dummy);
-zdiv(u,upfac,&u,&dummy);
-zsdiv(u,denom,&u);
+zdiv(u,S->max_norm_initial,&u,&S->dummy);
+zdiv(u,S->upfac,&u,&S->dummy);
+zsdiv(u,S->denom,&u);
 zabs(&u);
 i++;
 }
-zwrite(u);
-printf(" ");
+if(S->log!=NULL)zwrite(u);
+message(" ");
+S->solvec[j]= ztoint(u);
 #else
-if(original_columns[j]==0){
-u= 0;
+if(S->original_columns[j]==0){
+u= (S->fixed_values!=NULL)?S->fixed_values[j]:0;
 }else{
-if(!iszeroone)
-upfac= upperbounds_max/upperbounds[i-low];
-u= labs(get_entry(position,i)-s)/(denom*max_norm_initial*upfac);
+if(!S->iszeroone)
+S->upfac= S->upperbounds_max/S->upperbounds[i-low];
+u= ABS(get_entry(position,i)-s)/(S->denom*S->max_norm_initial*S->upfac);
 i++;
 }
-printf("%ld ",u);
-if(!SILENT)fprintf(fp,"%ld ",u);
+message("%ld ",(long)u);
+S->solvec[j]= u;
+if(!S->sol_binary&&!S->SILENT&&S->fp!=NULL)fprintf(S->fp,"%ld ",(long)u);
 #endif 
 }
 
-if(free_RHS){
+if(S->free_RHS){
 #if defined(MPREC)
-zdiv(get_entry(position,up),max_up,&u,&dummy);
-zsdiv(u,lastlines_factor,&u);
+zdiv(get_entry(position,up),S->max_up,&u,&S->dummy);
+zsdiv(u,S->lastlines_factor,&u);
 zabs(&u);
-printf(" L = ");
-zwrite(u);
+message(" L = ");
+if(S->log!=NULL)zwrite(u);
 #else
-u= labs(get_entry(position,up))/(lastlines_factor*max_up);
-printf(" L = %ld",u);
+u= ABS(get_entry(position,up))/(S->lastlines_factor*S->max_up);
+message(" L = %ld",(long)u);
 #endif 
 }
-printf("\n");fflush(stdout);
-fprintf(fp,"\n");
+message("\n");message_flush();
+if(!S->sol_binary&&S->fp!=NULL)fprintf(S->fp,"\n");
+S->reduction_solutions++;
+if(report_solution(end))S->stop= 1;
 
 /*:38*/
 #line 739 "diophant.w"
@@ -445,9 +951,9 @@ fprintf(fp,"\n");
 /*39:*/
 #line 858 "diophant.w"
 
-if(stop_after_solutions==1){
-printf("Stopped in phase 1 after finding a random solution\n");
-exit(0);
+if(S->stop_after_solutions==1){
+message("Stopped in phase 1 after finding a random solution\n");
+S->stop= 1;
 }
 /*:39*/
 #line 740 "diophant.w"
@@ -585,13 +1091,24 @@ int lllalloc(DOUBLE***mu,DOUBLE**c,DOUBLE**N,int s,int z)
 #endif 
 {
 int i,m;
+long stride;
+DOUBLE*block;
 
 if((z<1)||(s<1))return 0;
 
 (*c)= (DOUBLE*)calloc(s,sizeof(DOUBLE));
 (*N)= (DOUBLE*)calloc(s,sizeof(DOUBLE));
-(*mu)= (DOUBLE**)calloc(s,sizeof(DOUBLE*));
-for(i= 0;i<s;i++)(*mu)[i]= (DOUBLE*)calloc(z,sizeof(DOUBLE));
+
+/* The rows of mu lie in one aligned block, the block is kept in mu[s] */
+stride= (z+FPKERNEL_PAD-1)/FPKERNEL_PAD*FPKERNEL_PAD;
+if(posix_memalign((void**)&block,FPKERNEL_ALIGN,s*stride*sizeof(DOUBLE))!=0){
+fprintf(stderr,"Out of memory in lllalloc\n");
+diophant_abort(DIOPHANT_ERROR);
+}
+memset(block,0,s*stride*sizeof(DOUBLE));
+(*mu)= (DOUBLE**)calloc(s+1,sizeof(DOUBLE*));
+for(i= 0;i<s;i++)(*mu)[i]= block+i*stride;
+(*mu)[s]= block;
 
 m= (z> s)?z:s;
 #if defined(MPREC)     
@@ -615,13 +1132,13 @@ int lllfree(DOUBLE**mu,DOUBLE*c,DOUBLE*N,DOUBLE**bs,int s)
 int lllfree(DOUBLE**mu,DOUBLE*c,DOUBLE*N,int s)
 #endif
 {
+#if defined(MPREC)
 int i;
 
-#if defined(MPREC)
 for(i= 0;i<s;++i)free(bs[i]);
 free(bs);
 #endif 
-for(i= 0;i<s;++i)free(mu[i]);
+free(mu[s]);
 free(mu);
 free(N);
 free(c);
@@ -664,7 +1181,7 @@ verylong hv= 0;
 char musch[100];
 DOUBLE*swapd;
 #else
-long musvl;
+COEFFINT musvl;
 #endif
 
 /*:46*//*48:*/
@@ -673,6 +1190,7 @@ long musvl;
 int ii,iii;
 COEFF*swapvl;
 COEFF*bb;
+DOUBLE*mc;
 /*:48*//*55:*/
 #line 1179 "diophant.w"
 
@@ -682,11 +1200,12 @@ int Fi;
 #line 890 "diophant.w"
 ;
 if((z<=1)||(s<=1)){
-printf("Wrong dimensions in lllfp\n");fflush(stdout);
+message("Wrong dimensions in lllfp\n");message_flush();
 return(0);
 }
 
 k= (start> 1)?start:1;
+mc= (DOUBLE*)calloc(s,sizeof(DOUBLE));
 
 /*42:*/
 #line 925 "diophant.w"
@@ -708,9 +1227,9 @@ N[i]= SQRT(ss);
 #line 898 "diophant.w"
 ;
 counter= 0;
-while(k<s){
+while(k<s&&!S->stop){
 #if VERBOSE >  3
-if((counter%500)==0){printf("LLL: %d k:%d\n",counter,k);fflush(stdout);}
+if((counter%500)==0){message("LLL: %d k:%d\n",counter,k);message_flush();}
 counter++;
 #endif
 
@@ -728,8 +1247,9 @@ ss= (DOUBLE)scalarproductlfp(b[k],b[j]);
 #else
 ss= scalarproductlfp(b[k],b[j]);
 #endif 
-for(i= 0;i<j;i++)ss-= mu[j][i]*mu[k][i]*c[i];
+ss-= S->kernel.dot(mu[j],mc,j);
 mu[k][j]= ss/c[j];
+mc[j]= mu[k][j]*c[j];
 c[k]-= ss*mu[k][j];
 }
 /*:44*/
@@ -749,12 +1269,13 @@ mus= ROUND(mu[k][j]);
 sprintf(musch,"%.0f",mus);
 zsread(musch,&musvl);
 #else
-musvl= (long)mus;
+if(!(fabs(mus)<COEFFINT_LIMIT))coeff_overflow();
+musvl= (COEFFINT)mus;
 #endif    
 if(fabs(mus)> TWOTAUHALF){
 Fc= 1;
 #if 0     
-printf("correct possible rounding errors\n");fflush(stdout);
+message("correct possible rounding errors\n");message_flush();
 #endif     
 }
 
@@ -785,7 +1306,7 @@ if((b[k][i-1].p!=i)&&(ziszero(bb->c)!=1))
 for(ii= i-1;(b[k][ii].p==iii)&&(ii>=0);ii--)b[k][ii].p= i;
 else if(ziszero(bb->c)==1){
 #else
-bb->c-= b[j][i].c;
+bb->c= coeff_sub(bb->c,b[j][i].c);
 iii= bb->p;
 if((b[k][i-1].p!=i)&&(bb->c!=0))
 for(ii= i-1;(b[k][ii].p==iii)&&(ii>=0);ii--)b[k][ii].p= i;
@@ -795,7 +1316,7 @@ for(ii= i-1;(b[k][ii].p==i)&&(ii>=0);ii--)b[k][ii].p= iii;
 }
 i= b[j][i].p;
 }
-for(i= 0;i<j;i++)mu[k][i]-= mu[j][i];
+S->kernel.axpy(mu[k],mu[j],-1.0,j);
 /*:50*/
 #line 1045 "diophant.w"
 ;
@@ -815,7 +1336,7 @@ if((b[k][i-1].p!=i)&&(ziszero(bb->c)!=1))
 for(ii= i-1;(b[k][ii].p==iii)&&(ii>=0);ii--)b[k][ii].p= i;
 else if(ziszero(bb->c)==1){
 #else
-bb->c+= b[j][i].c;
+bb->c= coeff_add(bb->c,b[j][i].c);
 iii= bb->p;
 if((b[k][i-1].p!=i)&&(bb->c!=0))
 for(ii= i-1;(b[k][ii].p==iii)&&(ii>=0);ii--)b[k][ii].p= i;
@@ -825,7 +1346,7 @@ for(ii= i-1;(b[k][ii].p==i)&&(ii>=0);ii--)b[k][ii].p= iii;
 }
 i= b[j][i].p;
 }
-for(i= 0;i<j;i++)mu[k][i]+= mu[j][i];
+S->kernel.axpy(mu[k],mu[j],1.0,j);
 /*:51*/
 #line 1049 "diophant.w"
 ;
@@ -846,7 +1367,7 @@ if((b[k][i-1].p!=i)&&(ziszero(bb->c)!=1))
 for(ii= i-1;(b[k][ii].p==iii)&&(ii>=0);ii--)b[k][ii].p= i;
 else if(ziszero(bb->c)==1){
 #else
-bb->c-= b[j][i].c*musvl;
+bb->c= coeff_sub(bb->c,coeff_mul(b[j][i].c,musvl));
 iii= bb->p;
 if((b[k][i-1].p!=i)&&(bb->c!=0))
 for(ii= i-1;(b[k][ii].p==iii)&&(ii>=0);ii--)b[k][ii].p= i;
@@ -856,10 +1377,7 @@ for(ii= i-1;(b[k][ii].p==i)&&(ii>=0);ii--)b[k][ii].p= iii;
 }
 i= b[j][i].p;
 }
-#if 0
-daxpy(j,-mus,mu[k],1,mu[j],1);
-#endif
-for(i= 0;i<j;i++)mu[k][i]-= mu[j][i]*mus;
+S->kernel.axpy(mu[k],mu[j],-mus,j);
 /*:52*/
 #line 1053 "diophant.w"
 ;
@@ -898,8 +1416,8 @@ k= (k-1> 1)?k-1:1;
 if(N[k]<-EPSILON){
 fprintf(stderr,"Nk negativ! contact the author.\n");
 fflush(stderr);
-printf("Nk negativ! contact the author.\n");fflush(stdout);
-exit(0);
+message("Nk negativ! contact the author.\n");message_flush();
+diophant_abort(DIOPHANT_ERROR);
 }
 if(N[k]<0.5){
 swapvl= b[k];
@@ -1002,6 +1520,7 @@ k= (k-1> 1)?k-1:1;
 ;
 #endif  
 }
+free(mc);
 return(1);
 
 }
@@ -1046,8 +1565,8 @@ lllfree(mu,c,N,bs,s);
 #else
 lllalloc(&mu,&c,&N,s,z);
 r= lllfp(b,mu,c,N,1,s,z,quality);
-printf("Orthogonal defect: %f\n",orthogonal_defect(b,c,s,z));
-fflush(stdout);
+message("Orthogonal defect: %f\n",orthogonal_defect(b,c,s,z));
+message_flush();
 lllfree(mu,c,N,s);
 #endif 
 
@@ -1079,11 +1598,11 @@ lllalloc(&mu,&c,&N,s,z);
 r= lllfp(b,mu,c,N,1,s,z,quality);
 #endif
 
-printf("   Orthogonal defect: %f\n",orthogonal_defect(b,c,s,z));
-fflush(stdout);
+message("   Orthogonal defect: %f\n",orthogonal_defect(b,c,s,z));
+message_flush();
 
 
-for(runs= 1;runs<no_iterates;runs++){
+for(runs= 1;runs<no_iterates&&!S->stop;runs++){
 
 
 for(j= s-1;j> 0;j--){
@@ -1103,8 +1622,8 @@ r= lllfp(b,mu,c,N,bs,1,s,z,quality);
 #else
 r= lllfp(b,mu,c,N,1,s,z,quality);
 #endif  
-printf("%d: Orthogonal defect: %f\n",runs,orthogonal_defect(b,c,s,z));
-fflush(stdout);
+message("%d: Orthogonal defect: %f\n",runs,orthogonal_defect(b,c,s,z));
+message_flush();
 }
 
 #if defined(MPREC) 
@@ -1187,8 +1706,8 @@ int SCHNITT= 10;
 if(c[start_block]<=EPSILON){
 fprintf(stderr,"Hier ist was faul! start_block=%d %f\n",start_block,
 (double)c[start_block]);fflush(stderr);
-printf("Hier ist was faul! start_block=%d %f\n",start_block,
-(double)c[start_block]);fflush(stdout);exit(0);
+message("Hier ist was faul! start_block=%d %f\n",start_block,
+(double)c[start_block]);message_flush();diophant_abort(DIOPHANT_ERROR);
 }
 
 us= (long*)calloc(s+1,sizeof(long));
@@ -1301,7 +1820,10 @@ DOUBLE new_cj;
 /*:69*//*71:*/
 #line 1659 "diophant.w"
 
-int g,ui,q,swapi,j;
+int g,ui,q,j;
+#if !defined(MPREC)
+COEFFINT swapi;
+#endif
 COEFF*swapvl;
 
 /*:71*/
@@ -1310,10 +1832,10 @@ COEFF*swapvl;
 
 last= s-2;
 if(last<1){
-printf("BKZ: the number of basis vectors is too small.\n");
-printf("Probably the number of rows is less or equal");
-printf(" to number of columns in the original system\n");
-printf("Maybe you have to increase c0 (the first parameter)!\n");
+message("BKZ: the number of basis vectors is too small.\n");
+message("Probably the number of rows is less or equal");
+message(" to number of columns in the original system\n");
+message("Maybe you have to increase c0 (the first parameter)!\n");
 return 0;
 }
 
@@ -1334,14 +1856,17 @@ lllfp(b,mu,c,N,1,s,z,delta);
 #endif 
 
 start_block= zaehler= -1;
-while(zaehler<last){
+while(zaehler<last&&!S->stop){
 
 start_block++;
-if(start_block==last)start_block= 0;
+if(start_block==last){
+start_block= 0;
+profile_tour(orthogonal_defect(b,c,s-1,z));
+}
 end_block= (start_block+beta-1<last)?start_block+beta-1:last;
 
 #if 0
-printf("start_block=%d, end_block=%d\n",start_block,end_block);
+message("start_block=%d, end_block=%d\n",start_block,end_block);
 #endif
 new_cj= enumerate(mu,c,u,s,start_block,end_block,p);
 
@@ -1366,7 +1891,8 @@ zadd(b[last+1][l].c,hv,&(b[last+1][l].c));
 #else
 for(l= 1;l<=z;l++)b[last+1][l].c= 0;
 for(i= start_block;i<=end_block;i++)
-for(l= 1;l<=z;l++)b[last+1][l].c+= b[i][l].c*u[i];
+for(l= 1;l<=z;l++)
+b[last+1][l].c= coeff_add(b[last+1][l].c,coeff_mul(b[i][l].c,u[i]));
 #endif  
 coeffinit(b[last+1],z);
 solutiontest(last+1);
@@ -1393,7 +1919,7 @@ zadd(b[last+1][j].c,hv,&(b[last+1][j].c));
 for(j= 1;j<=z;j++)b[last+1][j].c= 0;
 for(i= start_block;i<=end_block;i++){
 if(u[i]!=0)for(j= 1;j<=z;j++)
-b[last+1][j].c+= u[i]*b[i][j].c;
+b[last+1][j].c= coeff_add(b[last+1][j].c,coeff_mul(u[i],b[i][j].c));
 }
 #endif 
 g= end_block;
@@ -1417,7 +1943,7 @@ zcopy(hv,&(b[i][j].c));
 #else
 for(j= 1;j<=z;j++){
 swapi= b[g][j].c;
-b[g][j].c= q*b[g][j].c+b[i][j].c;
+b[g][j].c= coeff_add(coeff_mul(q,b[g][j].c),b[i][j].c);
 b[i][j].c= swapi;
 }
 #endif  
@@ -1447,8 +1973,8 @@ lllfp(b,mu,c,N,start_block-1,h+1,z,delta);
 
 if(N[h]<-EPSILON){
 fprintf(stderr,"NN negativ\n");fflush(stderr);
-printf("NN negativ\n");fflush(stdout);
-exit(0);
+message("NN negativ\n");message_flush();
+diophant_abort(DIOPHANT_ERROR);
 }
 #if defined(ORIGINAL_SCHNORR_EUCHNER)
 /*74:*/
@@ -1459,8 +1985,8 @@ swapvl= b[h];
 for(i= h+1;i<=last+1;i++)b[i-1]= b[i];
 b[last+1]= swapvl;
 }else{
-printf("Not linear dependent; %f\n",(double)(N[h-1]));fflush(stdout);
-exit(0);
+message("Not linear dependent; %f\n",(double)(N[h-1]));message_flush();
+diophant_abort(DIOPHANT_ERROR);
 }
 
 /*:74*/
@@ -1487,8 +2013,9 @@ zaehler++;
 }
 }
 
-printf("bkz: Orthogonal defect: %f\n",orthogonal_defect(b,c,s-1,z));
-fflush(stdout);
+profile_tour(orthogonal_defect(b,c,s-1,z));
+message("bkz: Orthogonal defect: %f\n",orthogonal_defect(b,c,s-1,z));
+message_flush();
 
 #if defined(MPREC)
 lllfree(mu,c,N,bs,s);
@@ -1512,37 +2039,36 @@ return 1;
 /*80:*/
 #line 1987 "diophant.w"
 
-#if 0
-static FILE*fp;
-#endif
 
 /*:80*//*84:*/
 #line 2064 "diophant.w"
 
-#if defined(FINCKEPOHST)
-DOUBLE**muinv;
-#endif 
-int*upb,*lowb;
-long fipo_success;
-
-/*:84*//*86:*/
-#line 2080 "diophant.w"
+__thread long fipo_success;
 
-#if defined(MPREC)
-verylong dummy1= 0;
-verylong dummy2= 0;
-#endif 
-/*:86*//*91:*/
-#line 2161 "diophant.w"
+/*:84*//*95:*/
+#line 2292 "diophant.w"
 
-DOUBLE dum1,dum2;
+__thread long only_zeros_no,only_zeros_success,hoelder_no,hoelder_success;
+__thread long cs_success;
+__thread long N_success;
 
-/*:91*//*95:*/
-#line 2292 "diophant.w"
+/* Parallel enumeration: each thread walks the top of the tree down to
+   shard_level and searches the subtrees there nobody has claimed yet.
+   The counters above are per thread and summed at the end. */
 
+typedef struct{
+DIOPHANT_STATE*state;
+DOUBLE**mu,*c,*N,**bd,*bound,Fq;    /* cs[level] has to stay below bound[level] */
+#if defined(FINCKEPOHST)
+DOUBLE*fipo_u,*fipo_l;
+#endif
+int*first_nonzero_in_column,*firstp;
+int columns,rows,start_level,shard_level;
+long loops,*nodes;                /* Loops at each level */
 long only_zeros_no,only_zeros_success,hoelder_no,hoelder_success;
-long cs_success;
-long N_success;
+long cs_success,N_success,fipo_success;
+}ENUMJOB;
+
 
 /*:95*/
 #line 1937 "diophant.w"
@@ -1622,12 +2148,12 @@ for(l= 0;l<rows;l++)N[i]+= fabs(bd[i][l]);
 N[i]/= c[i];
 N[i]*= Fq;
 #if VERBOSE >  0  
-printf("%f ",(double)c[i]);
+message("%f ",(double)c[i]);
 #endif
 
 }
 #if VERBOSE >  0
-printf("\n\n");fflush(stdout);
+message("\n\n");message_flush();
 #endif
 
 return;
@@ -1719,12 +2245,12 @@ N[i]*= Fq;
 
 for(j= columns-1;j>=i;j--)mu[j][i]/= mu[i][i];
 #if VERBOSE >  -1
-printf("%6.3f ",(double)c[i]);
-if(i> 0&&i%15==0)printf("\n");
+message("%6.3f ",(double)c[i]);
+if(i> 0&&i%15==0)message("\n");
 #endif
 }
 #if VERBOSE >  -1
-printf("\n\n");fflush(stdout);
+message("\n\n");message_flush();
 #endif
 
 return;
@@ -1837,7 +2363,7 @@ int f;
 
 only_zeros_no++;
 
-if(iszeroone){
+if(S->iszeroone){
 for(i= 0;i<first_nonzero_in_column[firstp[level]];i++){
 f= first_nonzero_in_column[firstp[level]+1+i];
 if(fabs(fabs(w[f])-Fq)> 0.5){
@@ -1877,11 +2403,11 @@ long upfac;
 #endif
 
 if(fabs(fabs(w[rows-1])-Fq)> 0.5)return 0;
-upper= rows-1-free_RHS;
-if(free_RHS&&fabs(fabs(w[upper])-Fq)> 0.5)return 0;
-nosolutions++;
+upper= rows-1-S->free_RHS;
+if(S->free_RHS&&fabs(fabs(w[upper])-Fq)> 0.5)return 0;
+S->nosolutions++;
 
-if(!SILENT){
+if(!S->SILENT){
 #if defined(MPREC)
 zone(&upfac);
 #else
@@ -1889,55 +2415,53 @@ upfac= 1;
 #endif
 s= ROUND(w[rows-1]);
 i= 0;
-if(cut_after_coeff==-1){
-end= no_original_columns;
-if(nboundvars!=0){
-end= nboundvars;
-}
-}else{
-end= cut_after_coeff;
-}
+end= solution_length();
+solution_buffer(end);
 
 for(j= 0;j<end;j++){
-if(original_columns[j]==0){
-u= 0;
+if(S->original_columns[j]==0){
+u= (S->fixed_values!=NULL)?S->fixed_values[j]:0;
 }else{
 #if defined(MPREC)
-if(!iszeroone)
-zdiv(upperbounds_max,upperbounds[i],&upfac,&upfac_h);
-zmul(max_norm_initial,upfac,&dummy);
-zsmul(dummy,denom,&dummy);
+if(!S->iszeroone)
+zdiv(S->upperbounds_max,S->upperbounds[i],&upfac,&upfac_h);
+zmul(S->max_norm_initial,upfac,&dummy);
+zsmul(dummy,S->denom,&dummy);
 u= labs((ROUND(w[i])-s)/zdoub(dummy));
 #else
-if(!iszeroone)
-upfac= upperbounds_max/upperbounds[i];
+if(!S->iszeroone)
+upfac= S->upperbounds_max/S->upperbounds[i];
 
-u= labs((ROUND(w[i])-s)/(denom*max_norm_initial*upfac));
+u= labs((ROUND(w[i])-s)/(S->denom*S->max_norm_initial*upfac));
 #endif
 i++;
 }
-printf("%ld",u);
-fprintf(fp,"%ld",u);
-if(!iszeroone){
-printf(" ");
-fprintf(fp," ");
+message("%ld",u);
+S->solvec[j]= u;
+if(!S->sol_binary&&S->fp!=NULL)fprintf(S->fp,"%ld",u);
+if(!S->iszeroone){
+message(" ");
+if(!S->sol_binary&&S->fp!=NULL)fprintf(S->fp," ");
 }
 }
 
-if(free_RHS){
+if(S->free_RHS){
 #if defined(MPREC)
-u= labs((long)ROUND(w[upper]))/(long)zdoub(max_up);
+u= labs((long)ROUND(w[upper]))/(long)zdoub(S->max_up);
 #else
-u= labs((long)ROUND(w[upper]))/max_up;
+u= labs((long)ROUND(w[upper]))/S->max_up;
 #endif  
-printf(" L = %ld",u);
+message(" L = %ld",u);
 }
 
-printf("\n");fflush(stdout);
-fprintf(fp,"\n");fflush(fp);
+message("\n");message_flush();
+if(!S->sol_binary&&S->fp!=NULL){
+fprintf(S->fp,"\n");fflush(S->fp);
+}
+if(report_solution(end))S->enum_stop= 1;
 }
-if(nosolutions%10000==0){
-printf("%ld\n",nosolutions);fflush(stdout);
+if(S->nosolutions%10000==0){
+message("%ld\n",S->nosolutions);message_flush();
 }
 return 1;
 }
@@ -1962,21 +2486,21 @@ FILE*ff;
 ff= fopen("basis.ine","w");
 fprintf(ff,"H-representation\n");
 fprintf(ff,"begin\n");
-fprintf(ff,"%d %d integer\n",2*(lattice_rows),lattice_columns+1-1);
-for(i= 0;i<lattice_rows;i++){
-if(i==lattice_rows-2)
+fprintf(ff,"%d %d integer\n",2*(S->lattice_rows),S->lattice_columns+1-1);
+for(i= 0;i<S->lattice_rows;i++){
+if(i==S->lattice_rows-2)
 divisor= 1;
 else
-divisor= max_norm;
+divisor= S->max_norm;
 
-fprintf(ff,"%ld ",max_norm/divisor);
-for(j= 0;j<lattice_columns-1;j++)
-fprintf(ff,"%ld ",-get_entry(j,i)/divisor);
+fprintf(ff,"%ld ",(long)(S->max_norm/divisor));
+for(j= 0;j<S->lattice_columns-1;j++)
+fprintf(ff,"%ld ",(long)(-get_entry(j,i)/divisor));
 fprintf(ff,"\n");
 
-fprintf(ff,"%ld ",max_norm/divisor);
-for(j= 0;j<lattice_columns-1;j++)
-fprintf(ff,"%ld ",get_entry(j,i)/divisor);
+fprintf(ff,"%ld ",(long)(S->max_norm/divisor));
+for(j= 0;j<S->lattice_columns-1;j++)
+fprintf(ff,"%ld ",(long)(get_entry(j,i)/divisor));
 fprintf(ff,"\n");
 fflush(ff);
 }
@@ -2003,54 +2527,54 @@ ff= fopen("basis.lpt","w");
 fprintf(ff,"Maximize x0\n");
 fprintf(ff,"Subject To\n");
 
-for(i= 0;i<lattice_rows-1;i++){
-if(i==lattice_rows-2)
+for(i= 0;i<S->lattice_rows-1;i++){
+if(i==S->lattice_rows-2)
 divisor= 1;
 else
-divisor= max_norm;
+divisor= S->max_norm;
 
 fprintf(ff,"rowup%d: ",i);
-for(j= 0;j<lattice_columns-1;j++){
+for(j= 0;j<S->lattice_columns-1;j++){
 if(get_entry(j,i)<0)
-fprintf(ff,"%ldx%d ",get_entry(j,i)/divisor,j);
+fprintf(ff,"%ldx%d ",(long)(get_entry(j,i)/divisor),j);
 if(get_entry(j,i)> 0)
-fprintf(ff,"+%ldx%d ",get_entry(j,i)/divisor,j);
+fprintf(ff,"+%ldx%d ",(long)(get_entry(j,i)/divisor),j);
 if(j%10==0)fprintf(ff,"\n\t");
 }
-fprintf(ff," <= %ld\n",max_norm/divisor);
+fprintf(ff," <= %ld\n",(long)(S->max_norm/divisor));
 
 fprintf(ff,"rowlow%d: ",i);
-for(j= 0;j<lattice_columns-1;j++){
+for(j= 0;j<S->lattice_columns-1;j++){
 if(get_entry(j,i)<0)
-fprintf(ff,"%ldx%d ",get_entry(j,i)/divisor,j);
+fprintf(ff,"%ldx%d ",(long)(get_entry(j,i)/divisor),j);
 if(get_entry(j,i)> 0)
-fprintf(ff,"+%ldx%d ",get_entry(j,i)/divisor,j);
+fprintf(ff,"+%ldx%d ",(long)(get_entry(j,i)/divisor),j);
 if(j%10==0)fprintf(ff,"\n\t");
 }
-fprintf(ff," >= %ld\n",-max_norm/divisor);
+fprintf(ff," >= %ld\n",(long)(-S->max_norm/divisor));
 }
-i= lattice_rows-1;
-divisor= max_norm;
+i= S->lattice_rows-1;
+divisor= S->max_norm;
 fprintf(ff,"rowup%d: ",i);
-for(j= 0;j<lattice_columns-1;j++){
+for(j= 0;j<S->lattice_columns-1;j++){
 if(get_entry(j,i)<0)
-fprintf(ff,"%ldx%d ",get_entry(j,i)/divisor,j);
+fprintf(ff,"%ldx%d ",(long)(get_entry(j,i)/divisor),j);
 if(get_entry(j,i)> 0)
-fprintf(ff,"+%ldx%d ",get_entry(j,i)/divisor,j);
+fprintf(ff,"+%ldx%d ",(long)(get_entry(j,i)/divisor),j);
 if(j%10==0)fprintf(ff,"\n\t");
 }
-fprintf(ff," = %ld\n",max_norm/divisor);
+fprintf(ff," = %ld\n",(long)(S->max_norm/divisor));
 
 
 
 fprintf(ff,"bounds\n");
-for(j= 0;j<lattice_columns-1;j++){
+for(j= 0;j<S->lattice_columns-1;j++){
 fprintf(ff,"%0.0f <= x%d <= %0.0f\n",ceil(low[j]),j,floor(up[j]));
 }
 fprintf(ff,"Integer\n");
 fprintf(ff,"x0\n");
 #if 0 
-for(j= 0;j<lattice_columns-1;j++){
+for(j= 0;j<S->lattice_columns-1;j++){
 fprintf(ff,"x%d\n",j);
 }
 #endif 
@@ -2063,93 +2587,49 @@ fclose(ff);
 #line 1943 "diophant.w"
 ;
 
-DOUBLE explicit_enumeration(COEFF**lattice,int columns,int rows)
-{
-/*81:*/
-#line 1992 "diophant.w"
+/* Subtree number index at shard_level belongs to this run and thread */
 
-int level,level_max;
-int i,j,l,m;
-long loops;
+static int claim_subtree(long index){
+int mine;
+
+if(index%S->shard_total!=S->shard_no)return 0;
+if(S->enum_threads<=1)return 1;
+pthread_mutex_lock(&S->enum_lock);
+mine= (S->next_subtree<=index);
+if(mine)S->next_subtree= index+1;
+pthread_mutex_unlock(&S->enum_lock);
+return mine;
+}
 
-DOUBLE*y,*cs,*us;
+static void*enum_worker(void*arg){
+ENUMJOB*job= (ENUMJOB*)arg;
+int level,level_max;
+int i,l;
+int columns= job->columns,rows= job->rows;
+long loops,shard_index;
 
+DOUBLE*y,*cs,*us,**w;
 long*delta,*d,*eta,*v;
-int*first_nonzero,*first_nonzero_in_column,*firstp;
-
-DOUBLE*N,**mu,*c,**w,**bd;
 
-DOUBLE Fd,Fq;
+DOUBLE**mu= job->mu,*c= job->c,*N= job->N,**bd= job->bd;
+DOUBLE*bound= job->bound,Fq= job->Fq;
 DOUBLE dum;
-COEFF*swap_vec;
-
+int*first_nonzero_in_column= job->first_nonzero_in_column,*firstp= job->firstp;
 #if defined(FINCKEPOHST)
-DOUBLE*fipo,*fipo_u,*fipo_l;
+DOUBLE*fipo_u= job->fipo_u,*fipo_l= job->fipo_l;
 #endif
 
-/*:81*/
-#line 1947 "diophant.w"
-;
-
-/*82:*/
-#line 2013 "diophant.w"
-
-printf("Dimension of solution space (k): %d compared to s-z+2: %d\n",
-columns,system_columns-system_rows+1+free_RHS);
-fflush(stdout);
-
-if(columns<system_columns-system_rows+1+free_RHS){
-fprintf(stderr,"LLL didn't succeed in computing a basis of the kernel.\n");
-fprintf(stderr,"Please increase c0 (the first parameter)!\n");
-printf("LLL didn't succeed in computing a basis of the kernel.\n");
-printf("Please increase c0 (the first parameter)!\n");
-return 0;
-}
-
-
-/*:82*/
-#line 1949 "diophant.w"
-;
-/*83:*/
-#line 2029 "diophant.w"
-
-#if defined(MPREC)
-lllalloc(&mu,&c,&N,&bd,columns,rows);
-#else
-lllalloc(&mu,&c,&N,columns,rows);
-m= (rows> columns)?rows:columns;
-bd= (DOUBLE**)calloc(m,sizeof(DOUBLE*));
-for(i= 0;i<m;i++)bd[i]= (DOUBLE*)calloc(rows,sizeof(DOUBLE));
-#endif 
-
+S= job->state;
 us= (DOUBLE*)calloc(columns+1,sizeof(DOUBLE));
 cs= (DOUBLE*)calloc(columns+1,sizeof(DOUBLE));
 y= (DOUBLE*)calloc(columns+1,sizeof(DOUBLE));
 delta= (long*)calloc(columns+1,sizeof(long));
 d= (long*)calloc(columns+1,sizeof(long));
-first_nonzero= (int*)calloc(rows,sizeof(int));
-first_nonzero_in_column= (int*)calloc(columns+rows+1,sizeof(int));
-if(first_nonzero_in_column==NULL)return(0);
-firstp= (int*)calloc(columns+1,sizeof(int));
-
 eta= (long*)calloc(columns+1,sizeof(long));
 v= (long*)calloc(columns+1,sizeof(long));
 w= (DOUBLE**)calloc(columns+1,sizeof(DOUBLE*));
 for(i= 0;i<=columns;i++)w[i]= (DOUBLE*)calloc(rows,sizeof(DOUBLE));
 
-#if defined(FINCKEPOHST)
-fipo= (DOUBLE*)calloc(columns+1,sizeof(DOUBLE));
-fipo_u= (DOUBLE*)calloc(columns+1,sizeof(DOUBLE));
-fipo_l= (DOUBLE*)calloc(columns+1,sizeof(DOUBLE));
-muinv= (DOUBLE**)calloc(columns,sizeof(DOUBLE*));
-for(i= 0;i<columns;++i)muinv[i]= (DOUBLE*)calloc(rows,sizeof(DOUBLE));
-#endif
-upb= (int*)calloc(columns+1,sizeof(int));
-lowb= (int*)calloc(columns+1,sizeof(int));
-
-/*:83*/
-#line 1950 "diophant.w"
-;
 /*85:*/
 #line 2072 "diophant.w"
 
@@ -2161,21 +2641,265 @@ for(l= 0;l<rows;l++)w[i][l]= 0.0;
 }
 
 /*:85*/
-#line 1951 "diophant.w"
-;
-/*89:*/
-#line 2123 "diophant.w"
+#line 2297 "diophant.w"
 
-if(free_RHS){
-i= 0;
-#if defined(MPREC)
-for(j= columns-1;j>=0;j--)if(!ziszero(get_entry(j,rows-2)))i++;
-#else
-for(j= columns-1;j>=0;j--)if(get_entry(j,rows-2)!=0)i++;
-#endif
-printf("Number of nonzero entries in the second last row: %d\n",i);
-fflush(stdout);
-}
+only_zeros_no= only_zeros_success= 0;
+hoelder_no= hoelder_success= 0;
+cs_success= N_success= fipo_success= 0;
+loops= shard_index= 0;
+
+level= job->start_level;
+level_max= level;
+us[level]= v[level]= 1;
+
+/*98:*/
+#line 2327 "diophant.w"
+
+do{
+/*97:*/
+#line 2310 "diophant.w"
+
+loops++;
+job->nodes[level]++;
+if((S->stop_after_loops> 0)&&(S->stop_after_loops<=loops))goto afterloop;
+if(S->enum_stop)goto afterloop;
+#if VERBOSE >  -1
+if(loops%1000000==0){
+#if defined(FINCKEPOHST)
+message("%ld loops, solutions: %ld, fipo: %ld\n",\
+loops,S->nosolutions,fipo_success);
+#else   
+message("%ld loops, solutions: %ld\n",loops,S->nosolutions);
+#endif   
+message_flush();
+}
+#endif
+
+
+/*:97*/
+#line 2329 "diophant.w"
+;
+/*99:*/
+#line 2377 "diophant.w"
+
+dum= us[level]+y[level];
+cs[level]= cs[level+1]+dum*dum*c[level];
+/*:99*/
+#line 2330 "diophant.w"
+;
+
+if((cs[level]<bound[level])&&(!prune0(fabs(dum),N[level]))){
+#if defined(FINCKEPOHST)
+#if 0
+if(fabs(us[level])> fipo[level]*(1.0+EPSILON)){
+#endif
+if(level!=columns-1&&
+(us[level]> fipo_u[level]+EPSILON||
+us[level]<fipo_l[level]-EPSILON)
+){
+fipo_success++;
+goto side_step;
+}
+
+#endif
+compute_w(w,bd,dum,level,rows);
+
+if(level> 0){
+/*100:*/
+#line 2383 "diophant.w"
+
+if(prune_only_zeros(w[level],level,rows,Fq,first_nonzero_in_column,firstp))
+goto side_step;
+
+if(prune(w[level],cs[level],rows,Fq)){
+if(eta[level]==1)goto step_back;
+eta[level]= 1;
+delta[level]*= -1;
+if(delta[level]*d[level]>=0)delta[level]+= d[level];
+us[level]= v[level]+delta[level];
+}else{
+if(level==job->shard_level&&(S->shard_total> 1||S->enum_threads> 1)&&
+!claim_subtree(shard_index++))
+goto side_step;
+level--;
+eta[level]= 0;
+delta[level]= 0;
+dum= compute_y(mu,us,level,level_max);
+y[level]= dum;
+v[level]= (long)ROUND(-dum);
+us[level]= v[level];
+d[level]= (v[level]> -y[level])?-1:1;
+}
+/*:100*/
+#line 2349 "diophant.w"
+;
+}else{
+/*101:*/
+#line 2404 "diophant.w"
+
+if(exacttest(w[0],rows,Fq)==1){
+pthread_mutex_lock(&S->enum_lock);
+if(!S->enum_stop){
+print_solution(w[level],rows,Fq);
+if((S->stop_after_solutions> 0)&&(S->stop_after_solutions<=S->nosolutions))
+S->enum_stop= 1;
+}
+pthread_mutex_unlock(&S->enum_lock);
+#if 0     
+for(i= 0;i<columns;i++){
+message("%0.0f ",us[i]);
+}
+message("\n");
+#endif     
+if(S->enum_stop)goto afterloop;
+}
+goto side_step;
+/*:101*/
+#line 2351 "diophant.w"
+;
+}
+}else{
+cs_success++;
+step_back:
+
+level++;
+if(level_max<level)level_max= level;
+side_step:
+
+
+
+
+if(eta[level]==0){
+delta[level]*= -1;
+if(delta[level]*d[level]>=0)delta[level]+= d[level];
+}else{
+delta[level]+= (delta[level]*d[level]>=0)?d[level]:-d[level];
+}
+us[level]= v[level]+delta[level];
+}
+}while(level<columns);
+afterloop:
+
+/*:98*/
+
+job->loops= loops;
+job->only_zeros_no= only_zeros_no;
+job->only_zeros_success= only_zeros_success;
+job->hoelder_no= hoelder_no;
+job->hoelder_success= hoelder_success;
+job->cs_success= cs_success;
+job->N_success= N_success;
+job->fipo_success= fipo_success;
+
+free(us);
+free(cs);
+free(y);
+free(delta);
+free(d);
+free(eta);
+free(v);
+for(l= 0;l<=columns;l++)free(w[l]);
+free(w);
+return NULL;
+}
+
+DOUBLE explicit_enumeration(COEFF**lattice,int columns,int rows)
+{
+/*81:*/
+#line 1992 "diophant.w"
+
+int level;
+int i,j,l,m;
+long loops;
+
+int*first_nonzero,*first_nonzero_in_column,*firstp;
+
+DOUBLE*N,**mu,*c,**bd,*bound;
+long*nodes;
+
+DOUBLE Fd,Fq;
+DOUBLE dum;
+COEFF*swap_vec;
+
+#if defined(FINCKEPOHST)
+DOUBLE*fipo,*fipo_u,*fipo_l;
+DOUBLE**muinv;
+#endif
+#if defined(MPREC)
+verylong dummy1= 0;
+verylong dummy2= 0;
+#endif
+DOUBLE dum1,dum2;
+
+int shard_level;
+int threads;
+ENUMJOB*jobs;
+pthread_t*tids;
+
+/*:81*/
+#line 1947 "diophant.w"
+;
+
+/*82:*/
+#line 2013 "diophant.w"
+
+message("Dimension of solution space (k): %d compared to s-z+2: %d\n",
+columns,S->system_columns-S->system_rows+1+S->free_RHS);
+message_flush();
+
+if(columns<S->system_columns-S->system_rows+1+S->free_RHS){
+fprintf(stderr,"LLL didn't succeed in computing a basis of the kernel.\n");
+fprintf(stderr,"Please increase c0 (the first parameter)!\n");
+message("LLL didn't succeed in computing a basis of the kernel.\n");
+message("Please increase c0 (the first parameter)!\n");
+return 0;
+}
+
+
+/*:82*/
+#line 1949 "diophant.w"
+;
+/*83:*/
+#line 2029 "diophant.w"
+
+#if defined(MPREC)
+lllalloc(&mu,&c,&N,&bd,columns,rows);
+#else
+lllalloc(&mu,&c,&N,columns,rows);
+m= (rows> columns)?rows:columns;
+bd= (DOUBLE**)calloc(m,sizeof(DOUBLE*));
+for(i= 0;i<m;i++)bd[i]= (DOUBLE*)calloc(rows,sizeof(DOUBLE));
+#endif 
+
+first_nonzero= (int*)calloc(rows,sizeof(int));
+first_nonzero_in_column= (int*)calloc(columns+rows+1,sizeof(int));
+if(first_nonzero_in_column==NULL)return(0);
+firstp= (int*)calloc(columns+1,sizeof(int));
+
+#if defined(FINCKEPOHST)
+fipo= (DOUBLE*)calloc(columns+1,sizeof(DOUBLE));
+fipo_u= (DOUBLE*)calloc(columns+1,sizeof(DOUBLE));
+fipo_l= (DOUBLE*)calloc(columns+1,sizeof(DOUBLE));
+muinv= (DOUBLE**)calloc(columns,sizeof(DOUBLE*));
+for(i= 0;i<columns;++i)muinv[i]= (DOUBLE*)calloc(rows,sizeof(DOUBLE));
+#endif
+
+/*:83*/
+#line 1950 "diophant.w"
+;
+/*89:*/
+#line 2123 "diophant.w"
+
+if(S->free_RHS){
+i= 0;
+#if defined(MPREC)
+for(j= columns-1;j>=0;j--)if(!ziszero(get_entry(j,rows-2)))i++;
+#else
+for(j= columns-1;j>=0;j--)if(get_entry(j,rows-2)!=0)i++;
+#endif
+message("Number of nonzero entries in the second last row: %d\n",i);
+message_flush();
+}
 
 i= 0;
 #if defined(MPREC)
@@ -2183,8 +2907,8 @@ for(j= columns-1;j>=0;j--)if(!ziszero(get_entry(j,rows-1)))i++;
 #else
 for(j= columns-1;j>=0;j--)if(get_entry(j,rows-1)!=0)i++;
 #endif
-printf("Number of nonzero entries in the last row: %d\n",i);
-fflush(stdout);
+message("Number of nonzero entries in the last row: %d\n",i);
+message_flush();
 
 /*:89*/
 #line 1952 "diophant.w"
@@ -2202,7 +2926,7 @@ zabs(&dummy1);
 zabs(&dummy2);
 if(zcompare(dummy1,dummy2)==1){
 #else
-if(labs(get_entry(l,rows-1))> labs(get_entry(j,rows-1))){
+if(ABS(get_entry(l,rows-1))> ABS(get_entry(j,rows-1))){
 #endif
 swap_vec= lattice[l];
 for(i= l+1;i<=j;i++)lattice[i-1]= lattice[i];
@@ -2219,14 +2943,14 @@ lattice[j]= swap_vec;
 #line 2149 "diophant.w"
 
 #if defined(MPREC)
-Fq= zdoub(max_norm);
+Fq= zdoub(S->max_norm);
 #else
-Fq= (DOUBLE)max_norm;
+Fq= (DOUBLE)S->max_norm;
 #endif 
 Fd= (rows*Fq*Fq)*(1.0+EPSILON);
 #if VERBOSE >  0
-printf("Fq: %f\n",(double)Fq);
-printf("Fd: %f\n",(double)Fd);
+message("Fq: %f\n",(double)Fq);
+message("Fd: %f\n",(double)Fd);
 #endif
 
 /*:90*/
@@ -2258,7 +2982,7 @@ fipo_success= 0;
 inverse(mu,muinv,columns);
 
 #if VERBOSE >  -1 
-printf("\n");fflush(stdout);
+message("\n");message_flush();
 #endif 
 
 for(i= 0;i<columns;i++){
@@ -2279,7 +3003,7 @@ if(dum1<fipo[i])fipo[i]= dum1;
 
 
 #if VERBOSE >  -1 
-printf("%f ",fipo[i]);
+message("%f ",fipo[i]);
 #endif
 #endif
 
@@ -2308,12 +3032,12 @@ fipo_l[i]+= 1.0;
 if(fipo[i]<fipo_u[i])fipo_u[i]= fipo[i];
 if(-fipo[i]> fipo_l[i])fipo_l[i]= -fipo[i];
 #endif  
-printf("%d %d\n",(int)ceil(fipo_l[i]),(int)floor(fipo_u[i]));
+message("%d %d\n",(int)ceil(fipo_l[i]),(int)floor(fipo_u[i]));
 
 }
 #if VERBOSE >  -1 
-printf("\n");fflush(stdout);
-printf("\n");fflush(stdout);
+message("\n");message_flush();
+message("\n");message_flush();
 #endif
 
 /*:93*/
@@ -2359,7 +3083,7 @@ fipo_success= 0;
 inverse(mu,muinv,columns);
 
 #if VERBOSE >  -1 
-printf("\n");fflush(stdout);
+message("\n");message_flush();
 #endif 
 
 for(i= 0;i<columns;i++){
@@ -2380,7 +3104,7 @@ if(dum1<fipo[i])fipo[i]= dum1;
 
 
 #if VERBOSE >  -1 
-printf("%f ",fipo[i]);
+message("%f ",fipo[i]);
 #endif
 #endif
 
@@ -2409,12 +3133,12 @@ fipo_l[i]+= 1.0;
 if(fipo[i]<fipo_u[i])fipo_u[i]= fipo[i];
 if(-fipo[i]> fipo_l[i])fipo_l[i]= -fipo[i];
 #endif  
-printf("%d %d\n",(int)ceil(fipo_l[i]),(int)floor(fipo_u[i]));
+message("%d %d\n",(int)ceil(fipo_l[i]),(int)floor(fipo_u[i]));
 
 }
 #if VERBOSE >  -1 
-printf("\n");fflush(stdout);
-printf("\n");fflush(stdout);
+message("\n");message_flush();
+message("\n");message_flush();
 #endif
 
 /*:93*/
@@ -2465,133 +3189,93 @@ first_nonzero_in_column[j]= 0;
 
 level= first_nonzero[rows-1];
 if(level<0)level= 0;
-level_max= level;
-us[level]= v[level]= 1;
+
+/* Extreme pruning (Gama, Nguyen, Regev): below the top level, where the
+   right-hand side is fixed, the bound grows linearly from c[level] to Fd
+   at level 0. This cuts off most of the tree and most of the solutions,
+   diophant_solve() tries other bases if none is found. */
+
+bound= (DOUBLE*)calloc(columns+1,sizeof(DOUBLE));
+nodes= (long*)calloc(columns+1,sizeof(long));
+for(l= 0;l<=columns;l++)bound[l]= Fd;
+if(S->prune_trials> 0&&level> 0&&c[level]<Fd)
+for(l= 0;l<level;l++)bound[l]= c[level]+(Fd-c[level])*(level-l)/level;
+
+shard_level= level-S->shard_split;
+if(shard_level<1)shard_level= 1;
+threads= (level<shard_level)?1:S->enum_threads;
+S->next_subtree= 0;
+S->enum_stop= 0;
 
 only_zeros_no= only_zeros_success= 0;
 hoelder_no= hoelder_success= 0;
-cs_success= nosolutions= loops= 0;
+cs_success= S->nosolutions= loops= 0;
 N_success= 0;
 
+if(S->shard_total> 1){
+message("Shard %d of %d, split at level %d\n",S->shard_no,S->shard_total,shard_level);
+message_flush();
+
+if(level<shard_level&&S->shard_no!=0)goto afterloop;
+}
+
 /*:96*/
 #line 1978 "diophant.w"
 ;
 /*98:*/
 #line 2327 "diophant.w"
 
-do{
-/*97:*/
-#line 2310 "diophant.w"
-
-loops++;
-if((stop_after_loops> 0)&&(stop_after_loops<=loops))goto afterloop;
-#if VERBOSE >  -1
-if(loops%1000000==0){
-#if defined(FINCKEPOHST)
-printf("%ld loops, solutions: %ld, fipo: %ld\n",\
-loops,nosolutions,fipo_success);
-#else   
-printf("%ld loops, solutions: %ld\n",loops,nosolutions);
-#endif   
-fflush(stdout);
-}
-#endif
-
-
-/*:97*/
-#line 2329 "diophant.w"
-;
-/*99:*/
-#line 2377 "diophant.w"
-
-dum= us[level]+y[level];
-cs[level]= cs[level+1]+dum*dum*c[level];
-/*:99*/
-#line 2330 "diophant.w"
-;
-
-if((cs[level]<Fd)&&(!prune0(fabs(dum),N[level]))){
+if(threads> 1){
+message("Enumeration with %d threads, split at level %d\n",threads,shard_level);
+message_flush();
+}
+jobs= (ENUMJOB*)calloc(threads,sizeof(ENUMJOB));
+tids= (pthread_t*)calloc(threads,sizeof(pthread_t));
+for(i= 0;i<threads;i++){
+jobs[i].state= S;
+jobs[i].mu= mu;
+jobs[i].c= c;
+jobs[i].N= N;
+jobs[i].bd= bd;
+jobs[i].bound= bound;
+jobs[i].Fq= Fq;
 #if defined(FINCKEPOHST)
-#if 0
-if(fabs(us[level])> fipo[level]*(1.0+EPSILON)){
+jobs[i].fipo_u= fipo_u;
+jobs[i].fipo_l= fipo_l;
 #endif
-if(level!=columns-1&&
-(us[level]> fipo_u[level]+EPSILON||
-us[level]<fipo_l[level]-EPSILON)
-){
-fipo_success++;
-goto side_step;
+jobs[i].first_nonzero_in_column= first_nonzero_in_column;
+jobs[i].firstp= firstp;
+jobs[i].columns= columns;
+jobs[i].rows= rows;
+jobs[i].start_level= level;
+jobs[i].shard_level= shard_level;
+jobs[i].nodes= (long*)calloc(columns+1,sizeof(long));
 }
-
-#endif
-compute_w(w,bd,dum,level,rows);
-
-if(level> 0){
-/*100:*/
-#line 2383 "diophant.w"
-
-if(prune_only_zeros(w[level],level,rows,Fq,first_nonzero_in_column,firstp))
-goto side_step;
-
-if(prune(w[level],cs[level],rows,Fq)){
-if(eta[level]==1)goto step_back;
-eta[level]= 1;
-delta[level]*= -1;
-if(delta[level]*d[level]>=0)delta[level]+= d[level];
-us[level]= v[level]+delta[level];
-}else{
-level--;
-eta[level]= 0;
-delta[level]= 0;
-dum= compute_y(mu,us,level,level_max);
-y[level]= dum;
-v[level]= (long)ROUND(-dum);
-us[level]= v[level];
-d[level]= (v[level]> -y[level])?-1:1;
-}
-/*:100*/
-#line 2349 "diophant.w"
-;
-}else{
-/*101:*/
-#line 2404 "diophant.w"
-
-if(exacttest(w[0],rows,Fq)==1){
-print_solution(w[level],rows,Fq);
-#if 0     
-for(i= 0;i<columns;i++){
-printf("%0.0f ",us[i]);
-}
-printf("\n");
-#endif     
-if((stop_after_solutions> 0)&&(stop_after_solutions<=nosolutions))
-goto afterloop;
+for(i= 1;i<threads;i++)
+if(pthread_create(&tids[i],NULL,enum_worker,&jobs[i])!=0){
+fprintf(stderr,"Cannot start thread %d\n",i);
+threads= i;
 }
-goto side_step;
-/*:101*/
-#line 2351 "diophant.w"
-;
-}
-}else{
-cs_success++;
-step_back:
-
-level++;
-if(level_max<level)level_max= level;
-side_step:
-
+enum_worker(&jobs[0]);
+for(i= 1;i<threads;i++)pthread_join(tids[i],NULL);
 
-
-
-if(eta[level]==0){
-delta[level]*= -1;
-if(delta[level]*d[level]>=0)delta[level]+= d[level];
-}else{
-delta[level]+= (delta[level]*d[level]>=0)?d[level]:-d[level];
-}
-us[level]= v[level]+delta[level];
-}
-}while(level<columns);
+only_zeros_no= only_zeros_success= 0;
+hoelder_no= hoelder_success= 0;
+cs_success= N_success= fipo_success= 0;
+for(i= 0;i<threads;i++){
+loops+= jobs[i].loops;
+for(l= 0;l<=columns;l++)nodes[l]+= jobs[i].nodes[l];
+only_zeros_no+= jobs[i].only_zeros_no;
+only_zeros_success+= jobs[i].only_zeros_success;
+hoelder_no+= jobs[i].hoelder_no;
+hoelder_success+= jobs[i].hoelder_success;
+cs_success+= jobs[i].cs_success;
+N_success+= jobs[i].N_success;
+fipo_success+= jobs[i].fipo_success;
+}
+for(i= 0;i<threads;i++)free(jobs[i].nodes);
+free(jobs);
+free(tids);
 afterloop:
 
 /*:98*/
@@ -2601,35 +3285,27 @@ afterloop:
 /*102:*/
 #line 2418 "diophant.w"
 
-printf("Prune_cs: %ld\n",cs_success);
-printf("Prune_only_zeros: %ld of %ld\n",only_zeros_success,only_zeros_no);
-printf("Prune_hoelder: %ld of %ld\n",hoelder_success,hoelder_no);
-printf("Prune_N: %ld\n",N_success);
+message("Prune_cs: %ld\n",cs_success);
+message("Prune_only_zeros: %ld of %ld\n",only_zeros_success,only_zeros_no);
+message("Prune_hoelder: %ld of %ld\n",hoelder_success,hoelder_no);
+message("Prune_N: %ld\n",N_success);
 #if defined(FINCKEPOHST)
-printf("Fincke-Pohst: %ld\n",fipo_success);
+message("Fincke-Pohst: %ld\n",fipo_success);
 #endif 
-printf("Loops: %ld\n",loops);
-if((stop_after_solutions<=nosolutions&&stop_after_solutions> 0)||
-(stop_after_loops<=loops&&stop_after_loops> 0)){
-printf("Stopped after number of solutions: %ld\n",nosolutions);
-
-if((stop_after_loops<=loops&&stop_after_loops> 0)){
-/*105:*/
-#line 2468 "diophant.w"
+message("Loops: %ld\n",loops);
+profile_enumeration(nodes,columns,loops,cs_success,N_success,fipo_success,
+only_zeros_no,only_zeros_success,hoelder_no,hoelder_success);
+if((S->stop_after_solutions<=S->nosolutions&&S->stop_after_solutions> 0)||
+(S->stop_after_loops<=loops&&S->stop_after_loops> 0)){
+message("Stopped after number of solutions: %ld\n",S->nosolutions);
 
-if(SILENT)fprintf(fp,"%ld solutions\n",nosolutions);
-fflush(fp);
-
-/*:105*/
-#line 2432 "diophant.w"
-;
-exit(1);
-}
+if((S->stop_after_loops<=loops&&S->stop_after_loops> 0))
+S->loop_limit_reached= 1;
 
 }else{
-printf("Total number of solutions: %ld\n",nosolutions);
+message("Total number of solutions: %ld\n",S->nosolutions);
 }
-printf("\n");fflush(stdout);
+message("\n");message_flush();
 
 /*:102*/
 #line 1981 "diophant.w"
@@ -2637,32 +3313,31 @@ printf("\n");fflush(stdout);
 /*103:*/
 #line 2441 "diophant.w"
 
-free(us);
-free(cs);
-free(y);
-free(delta);
-free(d);
 free(first_nonzero);
 free(first_nonzero_in_column);
 free(firstp);
-free(eta);
-free(v);
-for(l= 0;l<=columns;l++)free(w[l]);
-free(w);
+free(bound);
+free(nodes);
 #if defined(FINCKEPOHST)
 free(fipo);
+free(fipo_u);
+free(fipo_l);
+for(i= 0;i<columns;++i)free(muinv[i]);
+free(muinv);
 #endif 
 #if defined(MPREC)
 lllfree(mu,c,N,bd,columns);
 #else
 lllfree(mu,c,N,columns);
+for(i= 0;i<m;i++)free(bd[i]);
+free(bd);
 #endif 
 
 /*:103*/
 #line 1982 "diophant.w"
 ;
 
-return 1;
+return S->nosolutions;
 }
 
 /*:79*/
@@ -2676,55 +3351,94 @@ return 1;
 /*:2*//*3:*/
 #line 52 "diophant.w"
 
+/* Default options: BKZ with block size 80 and p=18, 0/1 variables,
+   one thread and no output at all */
+
+void diophant_options_init(DIOPHANT_OPTIONS*opt){
+memset(opt,0,sizeof(DIOPHANT_OPTIONS));
 #if defined(MPREC)
-long diophant(verylong**a_input,verylong*b_input,verylong*upperbounds_input,
-int no_columns,int no_rows,
-verylong factor_input,verylong norm_input,
-int silent,int iterate,int iterate_no,
-int bkz_beta_input,int bkz_p_input,
-int stop_after_sol_input,int stop_after_loops_input,
-int free_RHS_input,int*org_col_input,int no_org_col_input,
-int cut_after,int nboundedvars,FILE*solfile)
-#else
-long diophant(long**a_input,long*b_input,long*upperbounds_input,
-int no_columns,int no_rows,
-long factor_input,long norm_input,
-int silent,int iterate,int iterate_no,
-int bkz_beta_input,int bkz_p_input,
-int stop_after_sol_input,int stop_after_loops_input,
-int free_RHS_input,int*org_col_input,int no_org_col_input,
-int cut_after,int nboundedvars,FILE*solfile)
+zintoz(10000,&opt->factor);
+zintoz(1,&opt->maxnorm);
+#else
+opt->factor= 10000;
+opt->maxnorm= 1;
 #endif
+opt->bkz_beta= 80;
+opt->bkz_p= 18;
+opt->cut_after= -1;
+opt->threads= 1;
+opt->shard_total= 1;
+opt->shard_split= 3;
+}
+
+/* Solve the system with the options opt. Returns the number of
+   solutions or one of the negative DIOPHANT_ values. */
+
+long diophant_solve(DIOPHANT_INT**a_input,DIOPHANT_INT*b_input,
+DIOPHANT_INT*upperbounds_input,int no_columns,int no_rows,
+const DIOPHANT_OPTIONS*opt)
 {
 int i,j;
 COEFF*swap_vec;
+DIOPHANT_STATE state,*caller;
+long result;
+int trial;
+unsigned int seed;
+
+memset(&state,0,sizeof(state));
+caller= S;
+S= &state;
+pthread_mutex_init(&S->enum_lock,NULL);
+result= setjmp(S->abort);
+if(result!=0)goto finish;
 
 /*11:*/
 #line 253 "diophant.w"
 
 #if defined(MPREC)
-zcopy(factor_input,&matrix_factor);
-zcopy(norm_input,&max_norm);
+zcopy(opt->factor,&S->matrix_factor);
+zcopy(opt->maxnorm,&S->max_norm);
 #else
-matrix_factor= factor_input;
-max_norm= norm_input;
+S->matrix_factor= opt->factor;
+S->max_norm= opt->maxnorm;
 #endif
-if(iterate){
-no_iterates= iterate_no;
+S->iterate= opt->iterate;
+if(S->iterate){
+S->no_iterates= opt->iterate_no;
 }else{
-bkz_beta= bkz_beta_input;
-bkz_p= bkz_p_input;
-}
-SILENT= silent;
-stop_after_solutions= stop_after_sol_input;
-stop_after_loops= stop_after_loops_input;
-free_RHS= free_RHS_input;
-nom= 1;
-denom= 2;
-
-system_rows= no_rows;
-system_columns= no_columns;
-nboundvars= nboundedvars;
+S->bkz_beta= opt->bkz_beta;
+S->bkz_p= opt->bkz_p;
+}
+S->SILENT= opt->silent;
+S->stop_after_solutions= opt->stop_after_solutions;
+S->stop_after_loops= opt->stop_after_loops;
+S->free_RHS= opt->free_RHS;
+S->nom= 1;
+S->denom= 2;
+
+S->system_rows= no_rows;
+S->system_columns= no_columns;
+S->nboundvars= opt->nboundedvars;
+
+S->shard_no= opt->shard_no;
+S->shard_total= opt->shard_total;
+S->shard_split= opt->shard_split;
+S->enum_threads= (opt->threads> 1)?opt->threads:1;
+S->prune_trials= opt->prune_trials;
+S->profile= opt->profile;
+if(S->profile!=NULL){
+S->profile_start= profile_clock();
+fprintf(S->profile,"return rec( Phases:=[");
+}
+S->lll_kernel= opt->kernel;
+S->save_lattice_name= opt->save_lattice;
+S->load_lattice_name= opt->load_lattice;
+S->fixed_values= opt->fixed_values;
+S->fp= opt->solfile;
+S->sol_binary= opt->binary&&opt->solfile!=NULL&&!opt->silent;
+S->log= opt->log;
+S->solution= opt->solution;
+S->data= opt->data;
 
 /*:11*/
 #line 76 "diophant.w"
@@ -2732,16 +3446,27 @@ nboundvars= nboundedvars;
 /*12:*/
 #line 283 "diophant.w"
 
-lattice_rows= system_rows+system_columns+1;
-lattice_columns= system_columns+2;
+S->lattice_rows= S->system_rows+S->system_columns+1;
+S->lattice_columns= S->system_columns+2;
 
-if(free_RHS){
-lattice_rows++;
-lattice_columns++;
+if(S->free_RHS){
+S->lattice_rows++;
+S->lattice_columns++;
 }else{
-printf("The RHS is fixed !\n");fflush(stdout);
+message("The RHS is fixed !\n");message_flush();
+}
+S->cut_after_coeff= opt->cut_after;
+
+i= fpkernel_init(&S->kernel,S->lll_kernel);
+if(i==0){
+fprintf(stderr,"Unknown LLL kernel '%s', use plain, avx2 or avx512\n",S->lll_kernel);
+diophant_abort(DIOPHANT_ERROR);
 }
-cut_after_coeff= cut_after;
+if(i<0)fprintf(stderr,"LLL kernel %s is not supported by this processor, using %s\n",
+S->lll_kernel,S->kernel.name);
+#if VERBOSE >  0
+message("LLL kernel: %s\n",S->kernel.name);message_flush();
+#endif
 
 /*:12*/
 #line 77 "diophant.w"
@@ -2749,13 +3474,14 @@ cut_after_coeff= cut_after;
 /*13:*/
 #line 296 "diophant.w"
 
-lattice= (COEFF**)calloc(lattice_columns,sizeof(COEFF*));
-for(j= 0;j<lattice_columns;j++){
-lattice[j]= (COEFF*)calloc(lattice_rows+1,sizeof(COEFF));
+S->lattice= (COEFF**)calloc(S->lattice_columns,sizeof(COEFF*));
+S->lattice_size= S->lattice_columns;
+for(j= 0;j<S->lattice_columns;j++){
+S->lattice[j]= (COEFF*)calloc(S->lattice_rows+1,sizeof(COEFF));
 #if defined(MPREC)
-for(i= 0;i<=lattice_rows;i++)zzero(&(lattice[j][i].c));
+for(i= 0;i<=S->lattice_rows;i++)zzero(&(S->lattice[j][i].c));
 #else
-for(i= 0;i<=lattice_rows;i++)lattice[j][i].c= 0;
+for(i= 0;i<=S->lattice_rows;i++)S->lattice[j][i].c= 0;
 #endif  
 }
 /*:13*/
@@ -2765,22 +3491,22 @@ for(i= 0;i<=lattice_rows;i++)lattice[j][i].c= 0;
 #line 308 "diophant.w"
 
 #if defined(MPREC)
-for(j= 0;j<system_rows;j++){
-for(i= 0;i<system_columns;i++){
-zcopy(a_input[j][i],&(lattice[i][j+1].c));
-smult_lattice(i,j,matrix_factor);
+for(j= 0;j<S->system_rows;j++){
+for(i= 0;i<S->system_columns;i++){
+zcopy(a_input[j][i],&(S->lattice[i][j+1].c));
+smult_lattice(i,j,S->matrix_factor);
 }
-zcopy(b_input[j],&(lattice[system_columns][j+1].c));
-smult_lattice(system_columns,j,matrix_factor);
+zcopy(b_input[j],&(S->lattice[S->system_columns][j+1].c));
+smult_lattice(S->system_columns,j,S->matrix_factor);
 }
 #else
-for(j= 0;j<system_rows;j++){
-for(i= 0;i<system_columns;i++){
-lattice[i][j+1].c= a_input[j][i];
-smult_lattice(i,j,matrix_factor);
+for(j= 0;j<S->system_rows;j++){
+for(i= 0;i<S->system_columns;i++){
+S->lattice[i][j+1].c= a_input[j][i];
+smult_lattice(i,j,S->matrix_factor);
 }
-lattice[system_columns][j+1].c= b_input[j];
-smult_lattice(system_columns,j,matrix_factor);
+S->lattice[S->system_columns][j+1].c= b_input[j];
+smult_lattice(S->system_columns,j,S->matrix_factor);
 }
 #endif 
 /*:14*/
@@ -2790,42 +3516,44 @@ smult_lattice(system_columns,j,matrix_factor);
 #line 341 "diophant.w"
 
 #if defined(MPREC)
-zone(&upperbounds_max);
-iszeroone= 1;
+zone(&S->upperbounds_max);
+S->iszeroone= 1;
 if(upperbounds_input==NULL){
-printf("No upper bounds: 0/1 variables are assumed \n");fflush(stdout);
+message("No upper bounds: 0/1 variables are assumed \n");message_flush();
 }else{
-upperbounds= (verylong*)calloc(system_columns,sizeof(verylong));
-for(i= 0;i<system_columns;i++)zone(&upperbounds[i]);
-for(i= 0;i<nboundvars;i++){
-upperbounds[i]= 0;
-zcopy(upperbounds_input[i],&(upperbounds[i]));
-if(zscompare(upperbounds[i],0)!=0){
-zgcd(upperbounds_max,upperbounds[i],&dummy);
-zmulin(upperbounds[i],&upperbounds_max);
-zdiv(upperbounds_max,dummy,&upperbounds_max,&dummy);
+S->upperbounds= (verylong*)calloc(S->system_columns,sizeof(verylong));
+for(i= 0;i<S->system_columns;i++)zone(&S->upperbounds[i]);
+for(i= 0;i<S->nboundvars;i++){
+S->upperbounds[i]= 0;
+zcopy(upperbounds_input[i],&(S->upperbounds[i]));
+if(zscompare(S->upperbounds[i],0)!=0){
+zgcd(S->upperbounds_max,S->upperbounds[i],&S->dummy);
+zmulin(S->upperbounds[i],&S->upperbounds_max);
+zdiv(S->upperbounds_max,S->dummy,&S->upperbounds_max,&S->dummy);
 }
 }
-if(zscompare(upperbounds_max,1)==1)iszeroone= 0;
-printf("upper bounds found. Max=");
-zwriteln(upperbounds_max);fflush(stdout);
+if(zscompare(S->upperbounds_max,1)==1)S->iszeroone= 0;
+message("upper bounds found. Max=");
+zwriteln(S->upperbounds_max);message_flush();
 }
 #else
-upperbounds_max= 1;
-iszeroone= 1;
+S->upperbounds_max= 1;
+S->iszeroone= 1;
 if(upperbounds_input==NULL){
-printf("No upper bounds: 0/1 variables are assumed \n");fflush(stdout);
+message("No upper bounds: 0/1 variables are assumed \n");message_flush();
 }else{
-upperbounds= (long*)calloc(system_columns,sizeof(long));
-for(i= 0;i<system_columns;i++)upperbounds[i]= 1;
-for(i= 0;i<nboundvars;i++){
-upperbounds[i]= upperbounds_input[i];
-if(upperbounds[i]!=0){
-upperbounds_max*= upperbounds[i]/gcd(upperbounds[i],upperbounds_max);
+S->upperbounds= (long*)calloc(S->system_columns,sizeof(long));
+for(i= 0;i<S->system_columns;i++)S->upperbounds[i]= 1;
+for(i= 0;i<S->nboundvars;i++){
+S->upperbounds[i]= upperbounds_input[i];
+if(S->upperbounds[i]!=0){
+S->upperbounds_max= coeff_mul(S->upperbounds_max,S->upperbounds[i]/gcd(S->upperbounds[i],S->upperbounds_max));
 }
 }
-if(upperbounds_max> 1)iszeroone= 0;
-printf("upper bounds found. Max=%ld\n",upperbounds_max);fflush(stdout);
+if(S->upperbounds_max> 1)S->iszeroone= 0;
+message("upper bounds found. Max=");
+if(S->log!=NULL)fprint_coeff(S->log,S->upperbounds_max);
+message("\n");message_flush();
 }
 #endif
 /*:15*/
@@ -2834,17 +3562,19 @@ printf("upper bounds found. Max=%ld\n",upperbounds_max);fflush(stdout);
 /*16:*/
 #line 385 "diophant.w"
 
-if(org_col_input!=NULL)no_original_columns= no_org_col_input;
-else no_original_columns= system_columns;
+if(opt->original_columns!=NULL)S->no_original_columns= opt->no_original_columns;
+else S->no_original_columns= S->system_columns;
 
-original_columns= (int*)calloc(no_original_columns,sizeof(int));
+S->original_columns= (int*)calloc(S->no_original_columns,sizeof(int));
 
-if(org_col_input!=NULL)
-for(i= 0;i<no_original_columns;i++)original_columns[i]= org_col_input[i];
+if(opt->original_columns!=NULL)
+for(i= 0;i<S->no_original_columns;i++)S->original_columns[i]= opt->original_columns[i];
 else{
-for(i= 0;i<no_original_columns;i++)original_columns[i]= 1;
-printf("No preselected columns \n");fflush(stdout);
+for(i= 0;i<S->no_original_columns;i++)S->original_columns[i]= 1;
+message("No preselected columns \n");message_flush();
 }
+if(S->save_lattice_name!=NULL||S->load_lattice_name!=NULL)
+hash_system(a_input,b_input,upperbounds_input);
 
 /*:16*/
 #line 81 "diophant.w"
@@ -2853,160 +3583,176 @@ printf("No preselected columns \n");fflush(stdout);
 #line 406 "diophant.w"
 
 #if defined(MPREC)
-for(j= system_rows;j<lattice_rows;j++){
-zsmul(max_norm,denom,&(lattice[j-system_rows][j+1].c));
-zsmul(max_norm,nom,&(lattice[lattice_columns-2][j+1].c));
+for(j= S->system_rows;j<S->lattice_rows;j++){
+zsmul(S->max_norm,S->denom,&(S->lattice[j-S->system_rows][j+1].c));
+zsmul(S->max_norm,S->nom,&(S->lattice[S->lattice_columns-2][j+1].c));
 }
-zcopy(max_norm,&(lattice[system_columns+free_RHS][lattice_rows].c));
+zcopy(S->max_norm,&(S->lattice[S->system_columns+S->free_RHS][S->lattice_rows].c));
 
-if(free_RHS){
-zone(&(lattice[system_columns][lattice_rows-1].c));
-zzero(&(lattice[system_columns+1][lattice_rows-1].c));
+if(S->free_RHS){
+zone(&(S->lattice[S->system_columns][S->lattice_rows-1].c));
+zzero(&(S->lattice[S->system_columns+1][S->lattice_rows-1].c));
 }
-zcopy(max_norm,&(lattice[system_columns+free_RHS][lattice_rows].c));
+zcopy(S->max_norm,&(S->lattice[S->system_columns+S->free_RHS][S->lattice_rows].c));
 #else
-for(j= system_rows;j<lattice_rows;j++){
-put_to(j-system_rows,j,denom*max_norm);
-put_to(lattice_columns-2,j,nom*max_norm);
+for(j= S->system_rows;j<S->lattice_rows;j++){
+put_to(j-S->system_rows,j,coeff_mul(S->denom,S->max_norm));
+put_to(S->lattice_columns-2,j,coeff_mul(S->nom,S->max_norm));
 }
-put_to(system_columns+free_RHS,lattice_rows-1,max_norm);
+put_to(S->system_columns+S->free_RHS,S->lattice_rows-1,S->max_norm);
 
-if(free_RHS){
-put_to(system_columns,lattice_rows-2,1);
-put_to(system_columns+1,lattice_rows-2,0);
+if(S->free_RHS){
+put_to(S->system_columns,S->lattice_rows-2,1);
+put_to(S->system_columns+1,S->lattice_rows-2,0);
 }
-put_to(system_columns+free_RHS,lattice_rows-1,max_norm);
+put_to(S->system_columns+S->free_RHS,S->lattice_rows-1,S->max_norm);
 #endif
-for(i= 0;i<lattice_columns-1;i++)coeffinit(lattice[i],lattice_rows);
+for(i= 0;i<S->lattice_columns-1;i++)coeffinit(S->lattice[i],S->lattice_rows);
 /*:17*/
 #line 82 "diophant.w"
 ;
 /*104:*/
 #line 2463 "diophant.w"
 
-fp= solfile;
-if(SILENT)fprintf(fp,"SILENT\n");
-fflush(fp);
+if(S->fp!=NULL){
+if(S->SILENT)fprintf(S->fp,"SILENT\n");
+fflush(S->fp);
+}
+solution_buffer(solution_length());
 
 /*:104*/
 #line 83 "diophant.w"
 ;
 #if 0
-printf("Before scaling\n");
+message("Before scaling\n");
 print_lattice();
 #endif
 /*18:*/
 #line 441 "diophant.w"
 
 #if defined(MPREC)
-zcopy(max_norm,&max_norm_initial);
-zone(&max_up);
-if(!iszeroone){
-for(j= 0;j<nboundvars;j++){
-if(zscompare(upperbounds[j],0)!=0){
-zdiv(upperbounds_max,upperbounds[j],&upfac,&upfac_h);
-smult_lattice(j,j+system_rows,upfac);
-smult_lattice(system_columns+free_RHS,j+system_rows,upperbounds_max);
+zcopy(S->max_norm,&S->max_norm_initial);
+zone(&S->max_up);
+if(!S->iszeroone){
+for(j= 0;j<S->nboundvars;j++){
+if(zscompare(S->upperbounds[j],0)!=0){
+zdiv(S->upperbounds_max,S->upperbounds[j],&S->upfac,&S->upfac_h);
+smult_lattice(j,j+S->system_rows,S->upfac);
+smult_lattice(S->system_columns+S->free_RHS,j+S->system_rows,S->upperbounds_max);
 }
 }
-zcopy(upperbounds_max,&max_up);
-zmulin(max_up,&max_norm);
+zcopy(S->upperbounds_max,&S->max_up);
+zmulin(S->max_up,&S->max_norm);
 #else
-max_norm_initial= max_norm;
-max_up= 1;
-if(!iszeroone){
-for(j= 0;j<nboundvars;j++){
-if(upperbounds[j]!=0){
-upfac= upperbounds_max/upperbounds[j];
-smult_lattice(j,j+system_rows,(long)upfac);
-smult_lattice(system_columns+free_RHS,j+system_rows,upperbounds_max);
+S->max_norm_initial= S->max_norm;
+S->max_up= 1;
+if(!S->iszeroone){
+for(j= 0;j<S->nboundvars;j++){
+if(S->upperbounds[j]!=0){
+S->upfac= S->upperbounds_max/S->upperbounds[j];
+smult_lattice(j,j+S->system_rows,S->upfac);
+smult_lattice(S->system_columns+S->free_RHS,j+S->system_rows,S->upperbounds_max);
 }
 }
-max_up= upperbounds_max;
-max_norm*= max_up;
+S->max_up= S->upperbounds_max;
+S->max_norm= coeff_mul(S->max_norm,S->max_up);
 #endif
-if(free_RHS)
-smult_lattice(system_columns,lattice_rows-2,max_up);
+if(S->free_RHS)
+smult_lattice(S->system_columns,S->lattice_rows-2,S->max_up);
 
-smult_lattice(system_columns+free_RHS,lattice_rows-1,max_up);
+smult_lattice(S->system_columns+S->free_RHS,S->lattice_rows-1,S->max_up);
 }
 /*:18*/
 #line 88 "diophant.w"
 ;
 #if 0
-printf("After scaling\n");
+message("After scaling\n");
 print_lattice();
 #endif
+if(S->load_lattice_name!=NULL){
+read_lattice(S->load_lattice_name);
+goto reduced;
+}
 /*19:*/
 #line 477 "diophant.w"
 
-swap_vec= lattice[lattice_columns-2];
-for(i= lattice_columns-2;i> 0;i--)lattice[i]= lattice[i-1];
-lattice[0]= swap_vec;
+swap_vec= S->lattice[S->lattice_columns-2];
+for(i= S->lattice_columns-2;i> 0;i--)S->lattice[i]= S->lattice[i-1];
+S->lattice[0]= swap_vec;
 /*:19*/
 #line 93 "diophant.w"
 ;
 /*20:*/
 #line 483 "diophant.w"
 
-lastlines_factor= 1;
-printf("\n");fflush(stdout);
-lll(lattice,lattice_columns-1,lattice_rows,LLLCONST_LOW);
+S->lastlines_factor= 1;
+message("\n");message_flush();
+profile_begin();
+lll(S->lattice,S->lattice_columns-1,S->lattice_rows,LLLCONST_LOW);
+profile_end("lll");
+if(S->stop)goto stopped;
 
 /*:20*/
 #line 94 "diophant.w"
 ;
 #if 0
-printf("After first reduction\n");
+message("After first reduction\n");
 print_lattice();
 #endif
 /*22:*/
 #line 503 "diophant.w"
 
+profile_begin();
 if(cutlattice()){
-printf("First reduction successful\n");fflush(stdout);
+message("First reduction successful\n");message_flush();
 }else{
-printf("First reduction not successful\n");fflush(stdout);
-return 0;
+message("First reduction not successful\n");message_flush();
+profile_end("cutlattice");
+goto finish;
 }
 
-for(j= 0;j<lattice_columns-1;j++)solutiontest(j);
+for(j= 0;j<S->lattice_columns-1&&!S->stop;j++)solutiontest(j);
+profile_end("cutlattice");
+if(S->stop)goto stopped;
 /*:22*/
 #line 99 "diophant.w"
 ;
 #if 0
-printf("After cutting\n");
+message("After cutting\n");
 print_lattice();
 #endif
 /*21:*/
 #line 490 "diophant.w"
 
-lastlines_factor= 1;
-lll(lattice,lattice_columns-1,lattice_rows,LLLCONST_HIGH);
-printf("Second reduction successful\n");fflush(stdout);
+S->lastlines_factor= 1;
+profile_begin();
+lll(S->lattice,S->lattice_columns-1,S->lattice_rows,LLLCONST_HIGH);
+profile_end("lll");
+if(S->stop)goto stopped;
+message("Second reduction successful\n");message_flush();
 
 /*:21*/
 #line 104 "diophant.w"
 ;
 #if 0
-printf("After second reduction\n");
+message("After second reduction\n");
 print_lattice();
 #endif
 #if 0
 /*23:*/
 #line 520 "diophant.w"
 
-lastlines_factor= LASTLINESFACTOR;
+S->lastlines_factor= LASTLINESFACTOR;
 #if defined(MPREC)
-for(i= 0;i<lattice_columns;i++)
-zsmul(lattice[i][lattice_rows].c,lastlines_factor,&(lattice[i][lattice_rows].c));
-if(free_RHS)
-for(i= 0;i<lattice_columns;i++)
-zsmul(lattice[i][lattice_rows-1].c,lastlines_factor,&(lattice[i][lattice_rows-1].c));
+for(i= 0;i<S->lattice_columns;i++)
+zsmul(S->lattice[i][S->lattice_rows].c,S->lastlines_factor,&(S->lattice[i][S->lattice_rows].c));
+if(S->free_RHS)
+for(i= 0;i<S->lattice_columns;i++)
+zsmul(S->lattice[i][S->lattice_rows-1].c,S->lastlines_factor,&(S->lattice[i][S->lattice_rows-1].c));
 #else
-for(i= 0;i<lattice_columns;i++)smult_lattice(i,lattice_rows-1,lastlines_factor);
-if(free_RHS)
-for(i= 0;i<lattice_columns;i++)smult_lattice(i,lattice_rows-2,lastlines_factor);
+for(i= 0;i<S->lattice_columns;i++)smult_lattice(i,S->lattice_rows-1,S->lastlines_factor);
+if(S->free_RHS)
+for(i= 0;i<S->lattice_columns;i++)smult_lattice(i,S->lattice_rows-2,S->lastlines_factor);
 #endif
 
 /*:23*/
@@ -3015,12 +3761,14 @@ for(i= 0;i<lattice_columns;i++)smult_lattice(i,lattice_rows-2,lastlines_factor);
 /*25:*/
 #line 551 "diophant.w"
 
-printf("\n");fflush(stdout);
-if(iterate)
-iteratedlll(lattice,lattice_columns-1,lattice_rows,no_iterates,LLLCONST_HIGH);
+message("\n");message_flush();
+profile_begin();
+if(S->iterate)
+iteratedlll(S->lattice,S->lattice_columns-1,S->lattice_rows,S->no_iterates,LLLCONST_HIGH);
 else
-bkz(lattice,lattice_columns,lattice_rows,LLLCONST_HIGH,bkz_beta,bkz_p);
-printf("Third reduction successful\n");fflush(stdout);
+bkz(S->lattice,S->lattice_columns,S->lattice_rows,LLLCONST_HIGH,S->bkz_beta,S->bkz_p);
+profile_end(S->iterate?"iteratedlll":"bkz");
+message("Third reduction successful\n");message_flush();
 
 /*:25*/
 #line 111 "diophant.w"
@@ -3029,44 +3777,88 @@ printf("Third reduction successful\n");fflush(stdout);
 #line 536 "diophant.w"
 
 #if defined(MPREC)
-for(i= 0;i<lattice_columns;i++)
-zsdiv(lattice[i][lattice_rows].c,lastlines_factor,&(lattice[i][lattice_rows].c));
-if(free_RHS)
-for(i= 0;i<lattice_columns;i++)
-zsdiv(lattice[i][lattice_rows-1].c,lastlines_factor,&(lattice[i][lattice_rows-1].c));
+for(i= 0;i<S->lattice_columns;i++)
+zsdiv(S->lattice[i][S->lattice_rows].c,S->lastlines_factor,&(S->lattice[i][S->lattice_rows].c));
+if(S->free_RHS)
+for(i= 0;i<S->lattice_columns;i++)
+zsdiv(S->lattice[i][S->lattice_rows-1].c,S->lastlines_factor,&(S->lattice[i][S->lattice_rows-1].c));
 #else
-for(i= 0;i<lattice_columns;i++)sdiv_lattice(i,lattice_rows-1,lastlines_factor);
-if(free_RHS)
-for(i= 0;i<lattice_columns;i++)sdiv_lattice(i,lattice_rows-2,lastlines_factor);
+for(i= 0;i<S->lattice_columns;i++)sdiv_lattice(i,S->lattice_rows-1,S->lastlines_factor);
+if(S->free_RHS)
+for(i= 0;i<S->lattice_columns;i++)sdiv_lattice(i,S->lattice_rows-2,S->lastlines_factor);
 #endif
 
 /*:24*/
 #line 112 "diophant.w"
 ;
 #endif 
+if(S->save_lattice_name!=NULL)write_lattice(S->save_lattice_name);
+reduced:
 #if 0
-printf("Before enumeration\n");
+message("Before enumeration\n");
 print_lattice();
 #endif
 /*26:*/
 #line 560 "diophant.w"
 
-printf("\n");fflush(stdout);
-nosolutions= explicit_enumeration(lattice,lattice_columns-1,lattice_rows);
+message("\n");message_flush();
+if(S->prune_trials> 0&&S->reduction_solutions> 0)goto stopped;
+for(trial= 1;;trial++){
+profile_begin();
+S->nosolutions= explicit_enumeration(S->lattice,S->lattice_columns-1,S->lattice_rows);
+if(S->prune_trials<=0||S->nosolutions> 0||S->loop_limit_reached)break;
+if(trial>=S->prune_trials){
+message("Extreme pruning found no solution with %d bases, there may still be solutions\n",trial);
+message_flush();
+break;
+}
+message("Extreme pruning: no solution with basis %d, randomizing the basis\n",trial);
+message_flush();
+seed= trial;
+profile_begin();
+randomize_lattice(S->lattice_columns-1,S->lattice_rows,&seed);
+lll(S->lattice,S->lattice_columns-1,S->lattice_rows,LLLCONST_HIGH);
+profile_end("randomize");
+if(S->stop||S->reduction_solutions> 0)goto stopped;
+}
 
 /*:26*/
 #line 118 "diophant.w"
 ;
+goto enumerated;
+stopped:
+S->nosolutions= S->reduction_solutions;
+enumerated:
 /*105:*/
 #line 2468 "diophant.w"
 
-if(SILENT)fprintf(fp,"%ld solutions\n",nosolutions);
-fflush(fp);
+if(S->fp!=NULL){
+if(S->SILENT)fprintf(S->fp,"%ld solutions\n",S->nosolutions);
+fflush(S->fp);
+}
 
 /*:105*/
 #line 119 "diophant.w"
 ;
-
-return nosolutions;
+result= S->loop_limit_reached?DIOPHANT_STOPPED:S->nosolutions;
+
+finish:
+if(S->profile!=NULL){
+fprintf(S->profile,"\n  ],\n  Time:=%.3f, Result:=%ld );\n",profile_clock()-S->profile_start,result);
+fflush(S->profile);
+}
+free(S->tour_time);
+free(S->tour_defect);
+if(S->lattice!=NULL){
+for(j= 0;j<S->lattice_size;j++)free(S->lattice[j]);
+free(S->lattice);
+}
+free(S->upperbounds);
+free(S->original_columns);
+free(S->solvec);
+free(S->solbuf);
+pthread_mutex_destroy(&S->enum_lock);
+S= caller;
+return result;
 }
 /*:3*/
@@ -3,27 +3,60 @@
 
 #ifndef _DIOPHANT_H
 #define _DIOPHANT_H
+#include <stdio.h>
 #if defined(MPREC)
 #include "freelip/lip.h"
 #undef BLAS
-extern long diophant(verylong**a_input,verylong*b_input,verylong*upperbounds_input,
-int no_columns,int no_rows,
-verylong factor_input,verylong norm_input,
-int silent,int iterate,int iterate_no,
-int bkz_beta_input,int bkz_p_input,
-int stop_after_sol_input,int stop_after_loops_input,
-int free_RHS_input,int*org_col_input,int no_org_col_input,
-int cut_after,int nboundedvars,FILE*solfile);
+#define DIOPHANT_INT verylong
 #else
-extern long diophant(long**a_input,long*b_input,long*upperbounds_input,
-int no_columns,int no_rows,
-long factor_input,long norm_input,
-int silent,int iterate,int iterate_no,
-int bkz_beta_input,int bkz_p_input,
-int stop_after_sol_input,int stop_after_loops_input,
-int free_RHS_input,int*org_col_input,int no_org_col_input,
-int cut_after,int nboundedvars,FILE*solfile);
+#define DIOPHANT_INT long
 #endif
+
+/* Return values of diophant_solve() besides the number of solutions */
+#define DIOPHANT_ERROR -1       /* Wrong input, numerical or file error */
+#define DIOPHANT_OVERFLOW -2    /* Integer overflow in the reduction */
+#define DIOPHANT_STOPPED -3     /* Loop limit reached */
+
+/* Return values of the solution callback */
+#define DIOPHANT_CONTINUE 0
+#define DIOPHANT_STOP 1
+
+/* Called for every solution x[0..n-1] in the original columns. Calls
+   are serialized, also with several enumeration threads. */
+typedef int(*DIOPHANT_CALLBACK)(const long*x,int n,void*data);
+
+typedef struct diophant_options{
+DIOPHANT_INT factor;            /* Scaling of the equations, -c */
+DIOPHANT_INT maxnorm;           /* -maxnorm */
+int iterate,iterate_no;         /* Iterated LLL with iterate_no runs, */
+int bkz_beta,bkz_p;             /*   otherwise BKZ with these parameters */
+int silent;                     /* Only count the solutions */
+long stop_after_solutions;      /* 0: no limit */
+long stop_after_loops;
+int free_RHS;
+int cut_after;                  /* Print only so many columns, -1: all */
+int nboundedvars;               /* The first nboundedvars are bounded */
+int*original_columns;           /* Columns of the solutions, 0 for */
+int no_original_columns;        /*   removed ones; NULL: all columns */
+long*fixed_values;              /* Values of removed columns, NULL: 0 */
+int threads;                    /* Enumeration threads */
+int prune_trials;               /* Extreme pruning with up to so many */
+                                /*   random bases, 0: full enumeration */
+int shard_no,shard_total,shard_split;
+char*kernel;                    /* LLL kernel, NULL: the fastest */
+char*save_lattice,*load_lattice;
+FILE*solfile;                   /* Solutions are written here if not NULL */
+int binary;                     /*   in the format of pagsol.h */
+DIOPHANT_CALLBACK solution;     /* Called for every solution if not NULL */
+void*data;                      /*   with this pointer */
+FILE*log;                       /* Progress messages, NULL: none */
+FILE*profile;                   /* Times of the phases as a GAP record */
+}DIOPHANT_OPTIONS;
+
+extern void diophant_options_init(DIOPHANT_OPTIONS*opt);
+extern long diophant_solve(DIOPHANT_INT**a_input,DIOPHANT_INT*b_input,
+DIOPHANT_INT*upperbounds_input,int no_columns,int no_rows,
+const DIOPHANT_OPTIONS*opt);
 #endif
 
 /*:4*/
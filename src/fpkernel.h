@@ -0,0 +1,155 @@
+/*
+    FPKERNEL.H
+
+    Dot product and axpy on contiguous double vectors for the Gram-Schmidt
+    coefficients of the LLL and BKZ reduction in diophant.c.
+    fpkernel_init() selects AVX-512 or AVX2 versions at run time, other
+    machines use the plain loops. The selection is kept in an FPKERNEL,
+    so solves in different threads can use different kernels.
+
+    The vector versions add up the dot product in a different order than
+    the plain loop, so the reduced bases can differ in the last bits of
+    the Gram-Schmidt coefficients. No fused multiply-add is used.
+*/
+
+#ifndef FPKERNEL_H
+#define FPKERNEL_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define FPKERNEL_X86 1
+#endif
+
+#define FPKERNEL_ALIGN 64       /* Alignment of the vectors in bytes */
+#define FPKERNEL_PAD 8          /* Rows are padded to a multiple of this */
+
+typedef double (*FPDOT)(const double *, const double *, int);
+typedef void (*FPAXPY)(double *, const double *, double, int);
+
+typedef struct fpkernel {
+  FPDOT dot;                    /* Dot product of v and w */
+  FPAXPY axpy;                  /* y += a*x */
+  const char *name;
+} FPKERNEL;
+
+
+static double fpdot_plain(const double *v, const double *w, int n)
+{ double r;
+  int i;
+
+  r=0.0;
+  for (i=0; i<n; ++i) r+=v[i]*w[i];
+  return r;
+}
+
+
+static void fpaxpy_plain(double *y, const double *x, double a, int n)
+{ int i;
+
+  for (i=0; i<n; ++i) y[i]+=a*x[i];
+}
+
+
+#if defined(FPKERNEL_X86)
+
+__attribute__((target("avx2")))
+static double fpdot_avx2(const double *v, const double *w, int n)
+{ __m256d s0,s1;
+  double t[4],r;
+  int i;
+
+  s0=_mm256_setzero_pd();
+  s1=_mm256_setzero_pd();
+  for (i=0; i+8<=n; i+=8)
+  { s0=_mm256_add_pd(s0,_mm256_mul_pd(_mm256_loadu_pd(v+i),_mm256_loadu_pd(w+i)));
+    s1=_mm256_add_pd(s1,_mm256_mul_pd(_mm256_loadu_pd(v+i+4),_mm256_loadu_pd(w+i+4)));
+  }
+  _mm256_storeu_pd(t,_mm256_add_pd(s0,s1));
+  r=(t[0]+t[1])+(t[2]+t[3]);
+  for (; i<n; ++i) r+=v[i]*w[i];
+  return r;
+}
+
+
+__attribute__((target("avx2")))
+static void fpaxpy_avx2(double *y, const double *x, double a, int n)
+{ __m256d av;
+  int i;
+
+  av=_mm256_set1_pd(a);
+  for (i=0; i+4<=n; i+=4)
+    _mm256_storeu_pd(y+i,_mm256_add_pd(_mm256_loadu_pd(y+i),_mm256_mul_pd(av,_mm256_loadu_pd(x+i))));
+  for (; i<n; ++i) y[i]+=a*x[i];
+}
+
+
+__attribute__((target("avx512f")))
+static double fpdot_avx512(const double *v, const double *w, int n)
+{ __m512d s0,s1;
+  double r;
+  int i;
+
+  s0=_mm512_setzero_pd();
+  s1=_mm512_setzero_pd();
+  for (i=0; i+16<=n; i+=16)
+  { s0=_mm512_add_pd(s0,_mm512_mul_pd(_mm512_loadu_pd(v+i),_mm512_loadu_pd(w+i)));
+    s1=_mm512_add_pd(s1,_mm512_mul_pd(_mm512_loadu_pd(v+i+8),_mm512_loadu_pd(w+i+8)));
+  }
+  if (i+8<=n)
+  { s0=_mm512_add_pd(s0,_mm512_mul_pd(_mm512_loadu_pd(v+i),_mm512_loadu_pd(w+i)));
+    i+=8;
+  }
+  r=_mm512_reduce_add_pd(_mm512_add_pd(s0,s1));
+  for (; i<n; ++i) r+=v[i]*w[i];
+  return r;
+}
+
+
+__attribute__((target("avx512f")))
+static void fpaxpy_avx512(double *y, const double *x, double a, int n)
+{ __m512d av;
+  int i;
+
+  av=_mm512_set1_pd(a);
+  for (i=0; i+8<=n; i+=8)
+    _mm512_storeu_pd(y+i,_mm512_add_pd(_mm512_loadu_pd(y+i),_mm512_mul_pd(av,_mm512_loadu_pd(x+i))));
+  for (; i<n; ++i) y[i]+=a*x[i];
+}
+
+#endif
+
+
+/* Select the kernels: name is "plain", "avx2", "avx512" or NULL for
+   the fastest one the processor supports. A kernel the processor does
+   not support is replaced by the fastest one it does. Returns 1 if k
+   is the requested kernel, -1 if it was replaced and 0 for an unknown
+   name. */
+
+static int fpkernel_init(FPKERNEL *k, const char *name)
+{ k->dot=fpdot_plain;
+  k->axpy=fpaxpy_plain;
+  k->name="plain";
+  if (name!=NULL && strcmp(name,"plain")!=0 && strcmp(name,"avx2")!=0 && strcmp(name,"avx512")!=0) return 0;
+  if (name!=NULL && strcmp(name,"plain")==0) return 1;
+#if defined(FPKERNEL_X86)
+  __builtin_cpu_init();
+  if ((name==NULL || strcmp(name,"avx512")==0) && __builtin_cpu_supports("avx512f"))
+  { k->dot=fpdot_avx512;
+    k->axpy=fpaxpy_avx512;
+    k->name="avx512";
+    return 1;
+  }
+  if (__builtin_cpu_supports("avx2"))
+  { k->dot=fpdot_avx2;
+    k->axpy=fpaxpy_avx2;
+    k->name="avx2";
+    return (name==NULL || strcmp(name,"avx2")==0) ? 1 : -1;
+  }
+#endif
+  return name==NULL ? 1 : -1;
+}
+
+#endif
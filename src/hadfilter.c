@@ -15,6 +15,7 @@
 #include <stdlib.h>
 
 #include "traces.h" 
+#include "cfstore.h"
 
 /****************/
 /* Global stuff */
@@ -47,19 +48,14 @@ int main(int argc,char *argv[])
 
   int v=0; /* Order of the Hadamard matrices */
 
-  int i,j,k,x,ok;
+  int i,j,x,ok;
   char c;
   long unsigned int count=0,countout=0;
 
-  /* Tree of canonical representatives */
+  /* Canonical representatives */
 
   int depth;
-  typedef struct node {
-     setword elem;
-     struct node *right;
-     struct node *down;
-  } NODE;
-  NODE *root, *work, *new;
+  CFSTORE store;
 
   /* Command line arguments */
   for(i=1; i<argc; ++i)
@@ -102,6 +98,7 @@ int main(int argc,char *argv[])
   n=4*v;
   m = SETWORDSNEEDED(n);
   depth = 2*v*m;
+  cfstore_init(&store,depth);
 
   nauty_check(WORDSIZE,m,n,NAUTYVERSIONID);
 
@@ -189,104 +186,27 @@ int main(int argc,char *argv[])
 
       /* Memorise canonical representative, if necessary */
 
-      /* First design */
-
-      if (count==1)
+      if (cfstore_insert(&store,cng)!=0)
       { ++countout;
-	if (mask & 8) 
-	{ printf("Matrix #%lu. |Aut|=",count); 
+        if (mask & 8)
+        { printf("Matrix #%lu. |Aut|=",count);
           writegroupsize(stdout,stats.grpsize1,stats.grpsize2);
           printf(". New, memorised as #%lu.\n",countout);
         }
-        root = (NODE *)malloc(sizeof(NODE));
-        if (root==NULL)
-        { printf("Out of memory!\n");
-          exit(0);
-        }
-        work = root;
-        work->elem = *cng;
-        work->down = NULL;
-        for (i=1; i<depth; ++i)
-        { new = (NODE *)malloc(sizeof(NODE));
-          if (new==NULL)
-          { printf("Out of memory!\n");
-            exit(0);
-	  }
-	  work->right = new;
-	  work = new;
-	  work->elem = *(cng+i);
-          work->down = NULL;
-        }
-        work->right = NULL;
-
-	printf("%ld\n",count);
-	fflush(stdout);
-      } 
-
-      /* Not the first design */
-
+        printf("%ld\n",count);
+        fflush(stdout);
+      }
       else
-      { work = root;
-        k = 0;
-        while ((k<depth) && ((work->elem == *(cng + k)) || (work->down != NULL)))
-          if (work->elem == *(cng + k))
-          { work = work->right;
-	    ++k;
-	  }
-	  else work = work->down;
-
-        if (k<depth) /* Rest of cng needs to be memorised */
-	{ ++countout;
-	  if (mask & 8) 
-	  { printf("Matrix #%lu. |Aut|=",count); 
-            writegroupsize(stdout,stats.grpsize1,stats.grpsize2);
-            printf(". New, memorised as #%lu.\n",countout);
-          }
-          new = (NODE *)malloc(sizeof(NODE));
-	  if (new==NULL)
-	  { printf("Out of memory!\n");
-	    exit(0);
-	  }
-          work->down = new;
-          work = new;
-          work->elem = *(cng + k);
-          work->down = NULL;
-          for (++k ; k<depth; ++k)
-          { new = (NODE *)malloc(sizeof(NODE));
-            if (new==NULL)
-            { printf("Out of memory!\n");
-	      exit(0);
-	    }
-            work->right = new;
-	    work = new;
-	    work->elem = *(cng + k);
-            work->down = NULL;
-          }
-	  new = (NODE *)malloc(sizeof(NODE));
-	  if (new==NULL)
-	  { printf("Out of memory!\n");
-	    exit(0);
-	  }
-	  work->right = new;
-	  new->elem = countout;
-	  new->right = NULL;
-          new->down = NULL;
-
-	  printf("%ld\n",count);
-	  fflush(stdout);
-
-	}
-	else
-	{ if (mask & 8) 
-	  { printf("Matrix #%lu. |Aut|=",count); 
-            writegroupsize(stdout,stats.grpsize1,stats.grpsize2);
-            printf(". Not new.\n");
-          }
+      { if (mask & 8)
+        { printf("Matrix #%lu. |Aut|=",count);
+          writegroupsize(stdout,stats.grpsize1,stats.grpsize2);
+          printf(". Not new.\n");
         }
       }
 
     }
   }
 
+  cfstore_free(&store);
 }
 
@@ -0,0 +1,595 @@
+/*
+    MCOVER.H
+
+    Exact multicover search for systems A x = b with nonnegative integer
+    coefficients and 0/1 variables, in the manner of the dancing links
+    of libexact: the search picks an uncovered row with the fewest
+    available columns and branches on its columns in increasing order.
+    Below column j the smaller columns of the row are excluded, so every
+    solution is found once. A column is available while each of its
+    coefficients fits into what is left of the right-hand side of its
+    row, and a row whose available columns cannot add up to its
+    right-hand side ends the branch.
+
+    The interface follows libexact: mcover_solve() returns the next
+    solution as the list of its columns, the level function is called
+    on every node and can cut it, the filter function is called after
+    every choice on the available columns and can drop them, and
+    mcover_reset() restarts the search.
+*/
+
+#ifndef MCOVER_H
+#define MCOVER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef int mcover_level_t(void *, int, const int *);
+typedef int mcover_filter_t(void *, int, const int *, int);
+
+typedef struct mcover {
+  int m,n;
+  int *colptr,*colrow,*colcoef; /* Nonzeros of column j: colrow/colcoef[colptr[j]..colptr[j+1]-1] */
+  int *rowptr,*rowcol,*rowcoef; /* Nonzeros of row i by increasing columns */
+  int *b;                       /* What is left of the right-hand side */
+  int *cnt;                     /* Available columns of each row */
+  long *sum;                    /* and the sum of their coefficients */
+  int left;                     /* Rows with b>0 */
+  int fail;                     /* A row cannot be covered any more */
+  char *out;                    /* Column is not available */
+  int *undo,nundo;              /* Columns made unavailable, in order */
+  int *soln;                    /* Chosen columns */
+  int *lrow,*lpos,*lmark,*cmark; /* Per level: row, next position, marks of undo */
+  int level,started;
+  mcover_level_t *level_f;
+  void *level_p;
+  mcover_filter_t *filter_f;
+  void *filter_p;
+} MCOVER;
+
+
+static void *mcover_alloc_array(size_t size)
+{ void *p;
+
+  p = calloc(size>0 ? size : 1,1);
+  if (p==NULL)
+  { printf("Out of memory!\n");
+    exit(0);
+  }
+  return p;
+}
+
+
+/* Make column j unavailable */
+
+static void mcover_drop(MCOVER *M, int j)
+{ int k,i;
+
+  M->out[j]=1;
+  M->undo[M->nundo++]=j;
+  for (k=M->colptr[j]; k<M->colptr[j+1]; ++k)
+  { i=M->colrow[k];
+    --M->cnt[i];
+    M->sum[i]-=M->colcoef[k];
+    if (M->sum[i]<M->b[i]) M->fail=1;
+  }
+}
+
+
+/* Make the columns dropped after mark available again */
+
+static void mcover_restore(MCOVER *M, int mark)
+{ int j,k,i;
+
+  while (M->nundo>mark)
+  { j=M->undo[--M->nundo];
+    M->out[j]=0;
+    for (k=M->colptr[j]; k<M->colptr[j+1]; ++k)
+    { i=M->colrow[k];
+      ++M->cnt[i];
+      M->sum[i]+=M->colcoef[k];
+    }
+  }
+}
+
+
+/* Choose column j. The columns that no longer fit are dropped.
+   Returns 0 if a row cannot be covered any more. */
+
+static int mcover_choose(MCOVER *M, int j)
+{ int k,l,i;
+
+  for (k=M->colptr[j]; k<M->colptr[j+1]; ++k)
+  { i=M->colrow[k];
+    M->b[i]-=M->colcoef[k];
+    if (M->b[i]==0) --M->left;
+  }
+  M->fail=0;
+  mcover_drop(M,j);
+  for (k=M->colptr[j]; k<M->colptr[j+1]; ++k)
+  { i=M->colrow[k];
+    for (l=M->rowptr[i]; l<M->rowptr[i+1]; ++l)
+      if (!M->out[M->rowcol[l]] && M->rowcoef[l]>M->b[i]) mcover_drop(M,M->rowcol[l]);
+  }
+  return !M->fail;
+}
+
+
+static void mcover_unchoose(MCOVER *M, int j, int mark)
+{ int k,i;
+
+  mcover_restore(M,mark);
+  for (k=M->colptr[j]; k<M->colptr[j+1]; ++k)
+  { i=M->colrow[k];
+    if (M->b[i]==0) ++M->left;
+    M->b[i]+=M->colcoef[k];
+  }
+}
+
+
+/* The system with m rows, n columns, right-hand side rhs and the
+   nonzero coefficients coef[k] in row entry[2*k] and column entry[2*k+1].
+   Returns NULL for a negative coefficient or right-hand side. */
+
+static MCOVER *mcover_alloc(int m, int n, const int *rhs, int nentries, const int *entry, const int *coef)
+{ MCOVER *M;
+  int i,j,k,l;
+
+  for (i=0; i<m; ++i) if (rhs[i]<0) return NULL;
+  for (k=0; k<nentries; ++k) if (coef[k]<0) return NULL;
+
+  M = (MCOVER *)mcover_alloc_array(sizeof(MCOVER));
+  M->m=m;
+  M->n=n;
+  M->colptr = (int *)mcover_alloc_array((n+1)*sizeof(int));
+  M->rowptr = (int *)mcover_alloc_array((m+1)*sizeof(int));
+  M->colrow = (int *)mcover_alloc_array(nentries*sizeof(int));
+  M->colcoef = (int *)mcover_alloc_array(nentries*sizeof(int));
+  M->rowcol = (int *)mcover_alloc_array(nentries*sizeof(int));
+  M->rowcoef = (int *)mcover_alloc_array(nentries*sizeof(int));
+  M->b = (int *)mcover_alloc_array(m*sizeof(int));
+  M->cnt = (int *)mcover_alloc_array(m*sizeof(int));
+  M->sum = (long *)mcover_alloc_array(m*sizeof(long));
+  M->out = (char *)mcover_alloc_array(n);
+  M->undo = (int *)mcover_alloc_array(n*sizeof(int));
+  M->soln = (int *)mcover_alloc_array((n+1)*sizeof(int));
+  M->lrow = (int *)mcover_alloc_array((n+1)*sizeof(int));
+  M->lpos = (int *)mcover_alloc_array((n+1)*sizeof(int));
+  M->lmark = (int *)mcover_alloc_array((n+1)*sizeof(int));
+  M->cmark = (int *)mcover_alloc_array((n+1)*sizeof(int));
+
+  /* Counting sort of the nonzeros by columns and by rows */
+
+  for (k=0; k<nentries; ++k) if (coef[k]!=0)
+  { ++M->colptr[entry[2*k+1]+1];
+    ++M->rowptr[entry[2*k]+1];
+  }
+  for (j=0; j<n; ++j) M->colptr[j+1]+=M->colptr[j];
+  for (i=0; i<m; ++i) M->rowptr[i+1]+=M->rowptr[i];
+  for (k=0; k<nentries; ++k) if (coef[k]!=0)
+  { l=M->colptr[entry[2*k+1]]++;
+    M->colrow[l]=entry[2*k];
+    M->colcoef[l]=coef[k];
+  }
+  for (j=n; j>0; --j) M->colptr[j]=M->colptr[j-1];
+  M->colptr[0]=0;
+  for (j=0; j<n; ++j) for (k=M->colptr[j]; k<M->colptr[j+1]; ++k)
+  { l=M->rowptr[M->colrow[k]]++;
+    M->rowcol[l]=j;
+    M->rowcoef[l]=M->colcoef[k];
+  }
+  for (i=m; i>0; --i) M->rowptr[i]=M->rowptr[i-1];
+  M->rowptr[0]=0;
+
+  /* Columns without nonzeros are never chosen, like in libexact */
+
+  for (i=0; i<m; ++i)
+  { M->b[i]=rhs[i];
+    if (rhs[i]>0) ++M->left;
+    for (k=M->rowptr[i]; k<M->rowptr[i+1]; ++k)
+    { ++M->cnt[i];
+      M->sum[i]+=M->rowcoef[k];
+    }
+  }
+  for (j=0; j<n; ++j)
+  { if (M->colptr[j]==M->colptr[j+1]) M->out[j]=1;
+    for (k=M->colptr[j]; k<M->colptr[j+1] && !M->out[j]; ++k)
+      if (M->colcoef[k]>M->b[M->colrow[k]]) mcover_drop(M,j);
+  }
+  M->nundo=0;
+  return M;
+}
+
+
+static void mcover_free(MCOVER *M)
+{ free(M->colptr);
+  free(M->rowptr);
+  free(M->colrow);
+  free(M->colcoef);
+  free(M->rowcol);
+  free(M->rowcoef);
+  free(M->b);
+  free(M->cnt);
+  free(M->sum);
+  free(M->out);
+  free(M->undo);
+  free(M->soln);
+  free(M->lrow);
+  free(M->lpos);
+  free(M->lmark);
+  free(M->cmark);
+  free(M);
+}
+
+
+static void mcover_level(MCOVER *M, mcover_level_t *f, void *p)
+{ M->level_f=f;
+  M->level_p=p;
+}
+
+
+static void mcover_filter(MCOVER *M, mcover_filter_t *f, void *p)
+{ M->filter_f=f;
+  M->filter_p=p;
+}
+
+
+/* Drop the available columns rejected by the filter function at level l.
+   Returns 0 if a row cannot be covered any more. */
+
+static int mcover_filtercols(MCOVER *M, int l)
+{ int j;
+
+  if (M->filter_f==NULL) return 1;
+  M->fail=0;
+  for (j=0; j<M->n; ++j)
+    if (!M->out[j] && !M->filter_f(M->filter_p,l,M->soln,j)) mcover_drop(M,j);
+  return !M->fail;
+}
+
+
+/* Start the search again from the root */
+
+static void mcover_reset(MCOVER *M)
+{ if (!M->started) return;
+  while (M->level>0)
+  { --M->level;
+    mcover_unchoose(M,M->soln[M->level],M->cmark[M->level]);
+  }
+  mcover_restore(M,0);
+  M->started=0;
+}
+
+
+/* The next solution: its size and the list of its columns, or NULL when
+   the search is finished. The list is valid until the next call. */
+
+static const int *mcover_solve(MCOVER *M, int *size)
+{ int l,i,r,p,j;
+
+  l=M->level;
+  if (M->started) goto up;
+  M->started=1;
+  l=0;
+  for (i=0; i<M->m; ++i) if (M->b[i]>M->sum[i]) goto finished;
+
+node:
+  if (M->level_f!=NULL && !M->level_f(M->level_p,l,M->soln)) goto up;
+  if (M->left==0)
+  { M->level=l;
+    *size=l;
+    return M->soln;
+  }
+
+  /* The uncovered row with the fewest available columns */
+
+  r=-1;
+  for (i=0; i<M->m; ++i) if (M->b[i]>0 && (r<0 || M->cnt[i]<M->cnt[r])) r=i;
+  M->lrow[l]=r;
+  M->lpos[l]=M->rowptr[r];
+  M->lmark[l]=M->nundo;
+
+next:
+  r=M->lrow[l];
+  for (p=M->lpos[l]; p<M->rowptr[r+1] && M->out[M->rowcol[p]]; ++p);
+  if (p==M->rowptr[r+1])
+  { mcover_restore(M,M->lmark[l]);
+    goto up;
+  }
+  j=M->rowcol[p];
+  M->lpos[l]=p+1;
+  M->soln[l]=j;
+  M->cmark[l]=M->nundo;
+  if (mcover_choose(M,j) && mcover_filtercols(M,l+1))
+  { ++l;
+    goto node;
+  }
+  goto exclude;
+
+up:
+  if (l==0) goto finished;
+  --l;
+  j=M->soln[l];
+
+  /* Exclude j from the following branches of the level. Once a row
+     cannot be covered without the excluded columns, none of them can. */
+
+exclude:
+  mcover_unchoose(M,j,M->cmark[l]);
+  M->fail=0;
+  mcover_drop(M,j);
+  if (!M->fail) goto next;
+  mcover_restore(M,M->lmark[l]);
+  goto up;
+
+finished:
+  M->level=0;
+  M->started=0;
+  mcover_restore(M,0);
+  return NULL;
+}
+
+
+/*********************************************/
+/* Counting with memoized residual problems */
+/*********************************************/
+
+/* The number of solutions is counted by a binary recursion: the first
+   available column of the row with the fewest available columns is
+   either chosen or excluded. The residual problem after a sequence of
+   such steps is given by what is left of the right-hand side and by the
+   set of available columns, so its number of solutions is stored under
+   this key and found again when the same residual problem comes up on
+   another path (as in the DXZ algorithm of Nishino et al.). Up to limit
+   bytes of keys are stored; beyond that the search goes on without new
+   entries and the count stays exact.
+
+   Optionally the recursion builds a decision diagram of all solutions in
+   the manner of a ZDD: node k>=2 has a column, a lo child (the column is
+   not in the solution) and a hi child (it is); 0 is the empty set and 1
+   the set with the empty solution. Nodes whose hi child is 0 are left
+   out and equal nodes are shared, so every solution is the set of
+   columns of the hi edges on a path from the root to 1. */
+
+typedef struct mcover_count {
+  unsigned long long count;     /* Number of solutions */
+  int overflow;                 /* It does not fit into 64 bits */
+  int root;                     /* Root of the diagram */
+  int *col,*lo,*hi;             /* Nodes of the diagram */
+  long nnodes,maxnodes;
+  long *ztable,zsize;           /* Unique table of the nodes, index+1 or 0 */
+  int zdd;                      /* Build the diagram */
+  int keylen;                   /* Ints in a key: b[] and the bits of out[] */
+  int *key,*scratch;            /* Keys of the entries */
+  unsigned long long *memo;     /* Number of solutions of the residual problem */
+  int *memonode;                /* and the root of its diagram */
+  long nmemo,maxmemo,hits;
+  long *table,size;             /* Hash table of the entries, index+1 or 0 */
+  size_t limit;
+} MCOVER_COUNT;
+
+
+static unsigned long mcover_hash(const int *key, int len)
+{ unsigned long h;
+  int i;
+
+  h=14695981039346656037UL;
+  for (i=0; i<len; ++i)
+  { h^=(unsigned)key[i];
+    h*=1099511628211UL;
+  }
+  return h^(h>>29);
+}
+
+
+/* Key of the current residual problem in C->scratch */
+
+static void mcover_key(MCOVER *M, MCOVER_COUNT *C)
+{ int i,j,*k;
+
+  k=C->scratch;
+  for (i=0; i<M->m; ++i) k[i]=M->b[i];
+  k+=M->m;
+  for (i=0; i<C->keylen-M->m; ++i) k[i]=0;
+  for (j=0; j<M->n; ++j) if (!M->out[j]) k[j/32]|=1U<<(j%32);
+}
+
+
+/* Entry of the key in C->scratch, -1 if there is none. *slot gets the
+   place of the key in the hash table. */
+
+static long mcover_lookup(MCOVER_COUNT *C, long *slot)
+{ long s,e;
+
+  if (C->size==0) return -1;
+  s=mcover_hash(C->scratch,C->keylen)&(C->size-1);
+  while ((e=C->table[s])!=0)
+  { if (memcmp(C->key+(e-1)*C->keylen,C->scratch,C->keylen*sizeof(int))==0)
+    { *slot=s;
+      return e-1;
+    }
+    s=(s+1)&(C->size-1);
+  }
+  *slot=s;
+  return -1;
+}
+
+
+static void mcover_remember(MCOVER_COUNT *C, unsigned long long count, int node)
+{ long s,e;
+
+  if ((size_t)(C->nmemo+1)*C->keylen*sizeof(int)>C->limit) return;
+  if (2*(C->nmemo+1)>C->size)
+  { free(C->table);
+    C->size = C->size ? 2*C->size : 1024;
+    C->table = (long *)mcover_alloc_array(C->size*sizeof(long));
+    for (e=0; e<C->nmemo; ++e)
+    { s=mcover_hash(C->key+e*C->keylen,C->keylen)&(C->size-1);
+      while (C->table[s]!=0) s=(s+1)&(C->size-1);
+      C->table[s]=e+1;
+    }
+  }
+  if (C->nmemo==C->maxmemo)
+  { C->maxmemo = C->maxmemo ? 2*C->maxmemo : 1024;
+    C->key = (int *)realloc(C->key,C->maxmemo*C->keylen*sizeof(int));
+    C->memo = (unsigned long long *)realloc(C->memo,C->maxmemo*sizeof(unsigned long long));
+    C->memonode = (int *)realloc(C->memonode,C->maxmemo*sizeof(int));
+    if (C->key==NULL || C->memo==NULL || C->memonode==NULL)
+    { printf("Out of memory!\n");
+      exit(0);
+    }
+  }
+  mcover_lookup(C,&s);
+  e=C->nmemo++;
+  memcpy(C->key+e*C->keylen,C->scratch,C->keylen*sizeof(int));
+  C->memo[e]=count;
+  C->memonode[e]=node;
+  C->table[s]=e+1;
+}
+
+
+/* The node (j,lo,hi) of the diagram */
+
+static int mcover_node(MCOVER_COUNT *C, int j, int lo, int hi)
+{ long s,e,k;
+  int t[3],u[3];
+
+  if (hi==0) return lo;
+  if (!C->zdd) return 0;
+  t[0]=j;
+  t[1]=lo;
+  t[2]=hi;
+  if (2*(C->nnodes+1)>C->zsize)
+  { free(C->ztable);
+    C->zsize = C->zsize ? 2*C->zsize : 1024;
+    C->ztable = (long *)mcover_alloc_array(C->zsize*sizeof(long));
+    for (k=2; k<C->nnodes; ++k)
+    { u[0]=C->col[k];
+      u[1]=C->lo[k];
+      u[2]=C->hi[k];
+      s=mcover_hash(u,3)&(C->zsize-1);
+      while (C->ztable[s]!=0) s=(s+1)&(C->zsize-1);
+      C->ztable[s]=k+1;
+    }
+  }
+  s=mcover_hash(t,3)&(C->zsize-1);
+  while ((e=C->ztable[s])!=0)
+  { --e;
+    if (C->col[e]==j && C->lo[e]==lo && C->hi[e]==hi) return e;
+    s=(s+1)&(C->zsize-1);
+  }
+  if (C->nnodes==C->maxnodes)
+  { C->maxnodes*=2;
+    C->col = (int *)realloc(C->col,C->maxnodes*sizeof(int));
+    C->lo = (int *)realloc(C->lo,C->maxnodes*sizeof(int));
+    C->hi = (int *)realloc(C->hi,C->maxnodes*sizeof(int));
+    if (C->col==NULL || C->lo==NULL || C->hi==NULL || C->maxnodes>0x7fffffff)
+    { printf("Out of memory!\n");
+      exit(0);
+    }
+  }
+  e=C->nnodes++;
+  C->col[e]=j;
+  C->lo[e]=lo;
+  C->hi[e]=hi;
+  C->ztable[s]=e+1;
+  return e;
+}
+
+
+/* Number of solutions of the residual problem at level l and the root
+   of their diagram in *node */
+
+static unsigned long long mcover_countrec(MCOVER *M, MCOVER_COUNT *C, int l, int *node)
+{ unsigned long long hi,lo;
+  int i,r,p,j,mark,hinode,lonode;
+  long e,slot;
+
+  if (M->left==0)
+  { *node=1;
+    return 1;
+  }
+  mcover_key(M,C);
+  e=mcover_lookup(C,&slot);
+  if (e>=0)
+  { ++C->hits;
+    *node=C->memonode[e];
+    return C->memo[e];
+  }
+
+  r=-1;
+  for (i=0; i<M->m; ++i) if (M->b[i]>0 && (r<0 || M->cnt[i]<M->cnt[r])) r=i;
+  for (p=M->rowptr[r]; p<M->rowptr[r+1] && M->out[M->rowcol[p]]; ++p);
+  if (p==M->rowptr[r+1])
+  { *node=0;
+    return 0;
+  }
+  j=M->rowcol[p];
+  mark=M->nundo;
+
+  /* Choose j */
+
+  hi=0;
+  hinode=0;
+  M->soln[l]=j;
+  if (mcover_choose(M,j) && mcover_filtercols(M,l+1)) hi=mcover_countrec(M,C,l+1,&hinode);
+  mcover_unchoose(M,j,mark);
+
+  /* Exclude j */
+
+  lo=0;
+  lonode=0;
+  M->fail=0;
+  mcover_drop(M,j);
+  if (!M->fail) lo=mcover_countrec(M,C,l,&lonode);
+  mcover_restore(M,mark);
+
+  if (__builtin_add_overflow(hi,lo,&hi)) C->overflow=1;
+  *node=mcover_node(C,j,lonode,hinode);
+  mcover_key(M,C);
+  mcover_remember(C,hi,*node);
+  return hi;
+}
+
+
+/* Count the solutions, and build their diagram if zdd is set. At most
+   limit bytes are used for the stored residual problems. */
+
+static MCOVER_COUNT *mcover_count(MCOVER *M, int zdd, size_t limit)
+{ MCOVER_COUNT *C;
+  int i;
+
+  C = (MCOVER_COUNT *)mcover_alloc_array(sizeof(MCOVER_COUNT));
+  C->zdd=zdd;
+  C->limit=limit;
+  C->keylen=M->m+(M->n+31)/32;
+  C->scratch = (int *)mcover_alloc_array(C->keylen*sizeof(int));
+  C->maxnodes=1024;
+  C->nnodes=2;
+  C->col = (int *)mcover_alloc_array(C->maxnodes*sizeof(int));
+  C->lo = (int *)mcover_alloc_array(C->maxnodes*sizeof(int));
+  C->hi = (int *)mcover_alloc_array(C->maxnodes*sizeof(int));
+  C->col[0]=C->col[1]=-1;
+
+  mcover_reset(M);
+  for (i=0; i<M->m; ++i) if (M->b[i]>M->sum[i]) return C;
+  C->count=mcover_countrec(M,C,0,&C->root);
+  return C;
+}
+
+
+static void mcover_count_free(MCOVER_COUNT *C)
+{ free(C->col);
+  free(C->lo);
+  free(C->hi);
+  free(C->ztable);
+  free(C->key);
+  free(C->scratch);
+  free(C->memo);
+  free(C->memonode);
+  free(C->table);
+  free(C);
+}
+
+#endif
@@ -15,14 +15,61 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "pagsol.h"
+
+
+/* Read the next solution: its nonzero columns into sol, their number
+   into nsol and the length of the vector into count. The file is text,
+   or binary if rowlength>0. Returns 0 at the end of the file. */
+
+int readsolution(FILE *infile, int rowlength, int *vec, int *sol, int *nsol, int *count)
+{ int i,ok;
+  char c;
+
+  *nsol=0;
+  *count=0;
+  if (rowlength>0)
+  { ok=pagsol_get(infile,vec,rowlength);
+    if (ok<0)
+    { printf("Error - damaged binary solution file!\n");
+      exit(0);
+    }
+    if (ok==0) return 0;
+    for (i=0; i<rowlength; ++i) if (vec[i])
+    { sol[(*nsol)++]=i;
+      if (*nsol==MAXSOL)
+      { printf("Increase MAXSOL!\n");
+        exit(0);
+      }
+    }
+    *count=rowlength;
+    return 1;
+  }
+
+  while (fscanf(infile,"%c",&c)==1)
+  { if (c==49) 
+    { sol[*nsol]=*count;
+      ++*count; 
+      ++*nsol;
+      if (*nsol==MAXSOL)
+      { printf("Increase MAXSOL!\n");
+        exit(0);
+      }
+    }
+    if (c==48) ++*count;
+    if (c==10) return 1;
+  }
+  return 0;
+}
+
 
 /****************/
 /* Main program */
 /****************/
 
 int main(int argc,char *argv[])
-{ int i,i2,j,ok,count,first,first2;
-  char c,path[1000];
+{ int i,i2,j,ok,count,first,first2,rowlength,*vec;
+  char path[1000];
   int sol[MAXSOL],nsol;
   long int countsol=0,countgood=0;
   FILE *infile, *outfile;
@@ -120,85 +167,69 @@ int main(int argc,char *argv[])
   fprintf(outfile,"return [\n");
   first=1;
 
-  ok=1; 
-  count=0;
-  nsol=0;
-  while (ok==1)
-  { ok=fscanf(infile,"%c",&c);
-
-    /* printf("%d *%c* %d\n",ok,c,c); */
-
-    if (ok==1) 
-    { if (c==49) 
-      { sol[nsol]=count;
-	++count; 
-	++nsol;
-	if (nsol==MAXSOL)
-        { printf("Increase MAXSOL!\n");
-          exit(0);
-        }
+  rowlength=pagsol_check(infile);
+  if (rowlength<0)
+  { printf("Error - damaged binary solution file!\n");
+    exit(0);
+  }
+  if (rowlength==PAGSOL_BATCH)
+  { printf("Error - batch solution files are not supported!\n");
+    exit(0);
+  }
+  vec=(int *)malloc((rowlength+1)*sizeof(int));
+
+  while (readsolution(infile,rowlength,vec,sol,&nsol,&count))
+  { ++countsol;
+    if (count!=norb)
+    { printf("Error - solution vector of wrong lentgh!\n");
+      exit(0);
+    }
+
+    /* Process solution */
+
+    for (i=0; i<v; ++i) for (j=0; j<v; ++j)
+    { p1[i][j]=0;
+      p2[i][j]=0;
+      p3[i][j]=0;
+    }
+    /* printf("Solution no. %ld:\n",countsol);
+    for (i=0; i<nsol; ++i) printf("%d ",sol[i]);
+    printf("\n"); */
+    for (i=0; i<nsol; ++i) for (j=0; j<orbs[sol[i]]; ++j) 
+    { /* printf("(%d,%d,%d)\n",orb[sol[i]][j][0],orb[sol[i]][j][1],orb[sol[i]][j][2]); */
+      p1[orb[sol[i]][j][0]][orb[sol[i]][j][1]]=1;
+      p2[orb[sol[i]][j][0]][orb[sol[i]][j][2]]=1;
+      p3[orb[sol[i]][j][1]][orb[sol[i]][j][2]]=1; 
+    }
+    tst=1;
+    for (i=0; tst && i<v; ++i) for (j=i; tst && j<v; ++j)
+    { sum1=0;
+      sum2=0;
+      sum3=0;
+      for (i2=0; i2<v; ++i2) 
+      { sum1+=p1[i][i2]*p1[j][i2];
+        sum2+=p2[i][i2]*p2[j][i2];
+        sum3+=p3[i][i2]*p3[j][i2];
       }
+      if (i==j) tst=(sum1==k && sum2==k && sum3==k);
+      else tst=(sum1==lambda && sum2==lambda && sum3==lambda);
+    }
 
-      if (c==48) ++count;
-
-      if (c==10)
-      { ++countsol;
-        if (count!=norb)
-        { printf("Error - solution vector of wrong lentgh!\n");
-          exit(0);
-        }
-
-	/* Process solution */
-
-        for (i=0; i<v; ++i) for (j=0; j<v; ++j)
-	{ p1[i][j]=0;
-          p2[i][j]=0;
-	  p3[i][j]=0;
-        }
-	/* printf("Solution no. %ld:\n",countsol);
-	for (i=0; i<nsol; ++i) printf("%d ",sol[i]);
-	printf("\n"); */
-	for (i=0; i<nsol; ++i) for (j=0; j<orbs[sol[i]]; ++j) 
-        { /* printf("(%d,%d,%d)\n",orb[sol[i]][j][0],orb[sol[i]][j][1],orb[sol[i]][j][2]); */
-	  p1[orb[sol[i]][j][0]][orb[sol[i]][j][1]]=1;
-          p2[orb[sol[i]][j][0]][orb[sol[i]][j][2]]=1;
-          p3[orb[sol[i]][j][1]][orb[sol[i]][j][2]]=1; 
-        }
-	tst=1;
-        for (i=0; tst && i<v; ++i) for (j=i; tst && j<v; ++j)
-        { sum1=0;
-          sum2=0;
-	  sum3=0;
-          for (i2=0; i2<v; ++i2) 
-	  { sum1+=p1[i][i2]*p1[j][i2];
-	    sum2+=p2[i][i2]*p2[j][i2];
-	    sum3+=p3[i][i2]*p3[j][i2];
-          }
-	  if (i==j) tst=(sum1==k && sum2==k && sum3==k);
-	  else tst=(sum1==lambda && sum2==lambda && sum3==lambda);
-        }
-
-	if (tst) 
-	{ ++countgood;
-          if (first) first=0;
-	  else fprintf(outfile,",\n");
-	  first2=1;
-	  fprintf(outfile,"[");
-	  for (i=0; i<nsol; ++i) for (j=0; j<orbs[sol[i]]; ++j) 
-          { if (first2) first2=0;
-            else fprintf(outfile,",");
-            fprintf(outfile,"[%d,%d,%d]",orb[sol[i]][j][0]+1,orb[sol[i]][j][1]+1,orb[sol[i]][j][2]+1);
-          }
-	  fprintf(outfile,"]");
-        }
-
-	/* End processing */
-
-        count=0;
-	nsol=0;
+    if (tst) 
+    { ++countgood;
+      if (first) first=0;
+      else fprintf(outfile,",\n");
+      first2=1;
+      fprintf(outfile,"[");
+      for (i=0; i<nsol; ++i) for (j=0; j<orbs[sol[i]]; ++j) 
+      { if (first2) first2=0;
+        else fprintf(outfile,",");
+        fprintf(outfile,"[%d,%d,%d]",orb[sol[i]][j][0]+1,orb[sol[i]][j][1]+1,orb[sol[i]][j][2]+1);
       }
+      fprintf(outfile,"]");
     }
 
+    /* End processing */
   }
 
   fprintf(outfile,"\n];\n");
@@ -0,0 +1,199 @@
+/*
+    PAGSOL.H
+
+    Binary format for solution files of solvecm, solvelibexact and
+    solvediophant. The file starts with the 8 bytes PAGSOL_MAGIC and the
+    length n of the solution vectors. Every solution is then written as
+    the number of its nonzero entries followed by the entries. An entry is
+    the gap to the previous nonzero column, shifted left by one bit; the
+    lowest bit is set if the value is not 1 and the value follows.
+    All numbers are unsigned varints: 7 bits per byte, low bits first,
+    the high bit of a byte is set if more bytes follow.
+
+    A file without solutions may be empty. Files are written through
+    stdio with a large buffer and are not flushed after every solution.
+
+    The solutions of a batch of systems are written to one file that
+    starts with PAGSOL_BATCH_MAGIC. Every system begins with 0, its
+    number and the length n of its vectors; a solution is written as
+    above, with the number of nonzero entries increased by 1.
+*/
+
+#ifndef PAGSOL_H
+#define PAGSOL_H
+
+#include <stdio.h>
+#include <string.h>
+
+#define PAGSOL_MAGIC	"PAGSOL\001\n"
+#define PAGSOL_BATCH_MAGIC	"PAGSOL\002\n"
+#define PAGSOL_BUFSIZE	(1<<20)
+
+
+static inline void pagsol_putvar(FILE *f, unsigned long x)
+{ while (x>=128)
+  { putc((int)(x & 127) | 128,f);
+    x >>= 7;
+  }
+  putc((int)x,f);
+}
+
+
+/* Returns 0 at the end of the file */
+
+static inline int pagsol_getvar(FILE *f, unsigned long *x)
+{ int c,shift;
+
+  *x=0;
+  shift=0;
+  do
+  { c=getc(f);
+    if (c==EOF || shift>=64) return 0;
+    *x |= (unsigned long)(c & 127) << shift;
+    shift+=7;
+  } while (c & 128);
+  return 1;
+}
+
+
+/* Write the header for vectors of length n */
+
+static inline void pagsol_header(FILE *f, int n)
+{ fputs(PAGSOL_MAGIC,f);
+  pagsol_putvar(f,n);
+}
+
+
+/* Start a binary solution file of vectors of length n, with the header
+   unless the file is being appended to. Call right after fopen, before
+   anything is written to the file. */
+
+static inline void pagsol_start(FILE *f, int n, int header)
+{ setvbuf(f,NULL,_IOFBF,PAGSOL_BUFSIZE);
+  if (header) pagsol_header(f,n);
+}
+
+
+/* Write the entries of vec, with k+shift for the number k of nonzeros */
+
+static inline void pagsol_putvec(FILE *f, const int *vec, int n, int shift)
+{ int i,k,last;
+
+  for (i=k=0; i<n; ++i) if (vec[i]) ++k;
+  pagsol_putvar(f,k+shift);
+  last=-1;
+  for (i=0; i<n; ++i) if (vec[i])
+  { pagsol_putvar(f,((unsigned long)(i-last-1) << 1) | (vec[i]!=1));
+    if (vec[i]!=1) pagsol_putvar(f,vec[i]);
+    last=i;
+  }
+}
+
+
+/* Write the solution vector vec of length n */
+
+static inline void pagsol_put(FILE *f, const int *vec, int n)
+{ pagsol_putvec(f,vec,n,0);
+}
+
+
+/* Start a batch solution file */
+
+static inline void pagsol_batch_start(FILE *f)
+{ setvbuf(f,NULL,_IOFBF,PAGSOL_BUFSIZE);
+  fputs(PAGSOL_BATCH_MAGIC,f);
+}
+
+
+/* The following solutions belong to system number id with length n */
+
+static inline void pagsol_batch_system(FILE *f, int id, int n)
+{ pagsol_putvar(f,0);
+  pagsol_putvar(f,id);
+  pagsol_putvar(f,n);
+}
+
+
+/* Write a solution of the current system */
+
+static inline void pagsol_batch_put(FILE *f, const int *vec, int n)
+{ pagsol_putvec(f,vec,n,1);
+}
+
+
+/* Check whether f is a binary solution file. Returns the length of the
+   vectors, 0 for a text file and -1 for a damaged header. A batch file
+   is reported as length PAGSOL_BATCH. Only the first character of a text
+   file is read and it is pushed back. */
+
+#define PAGSOL_BATCH	1000000001
+
+static inline int pagsol_check(FILE *f)
+{ char magic[8];
+  unsigned long n;
+  int c;
+
+  c=getc(f);
+  if (c==EOF) return 0;
+  if (c!=PAGSOL_MAGIC[0])
+  { ungetc(c,f);
+    return 0;
+  }
+  magic[0]=(char)c;
+  if (fread(magic+1,1,7,f)!=7) return -1;
+  if (memcmp(magic,PAGSOL_BATCH_MAGIC,8)==0) return PAGSOL_BATCH;
+  if (memcmp(magic,PAGSOL_MAGIC,8)!=0) return -1;
+  if (!pagsol_getvar(f,&n) || n==0 || n>1000000000UL) return -1;
+  return (int)n;
+}
+
+
+/* Read the k nonzero entries of a solution into vec of length n */
+
+static inline int pagsol_getvec(FILE *f, int *vec, int n, unsigned long k)
+{ unsigned long e,v;
+  long i;
+
+  for (i=0; i<n; ++i) vec[i]=0;
+  i=-1;
+  while (k-- > 0)
+  { if (!pagsol_getvar(f,&e)) return -1;
+    i+=(long)(e >> 1)+1;
+    v=1;
+    if ((e & 1) && !pagsol_getvar(f,&v)) return -1;
+    if (i>=n) return -1;
+    vec[i]=(int)v;
+  }
+  return 1;
+}
+
+
+/* Read the next solution into vec of length n. Returns 1 if a solution
+   was read, 0 at the end of the file and -1 for a damaged file. */
+
+static inline int pagsol_get(FILE *f, int *vec, int n)
+{ unsigned long k;
+
+  if (!pagsol_getvar(f,&k)) return 0;
+  return pagsol_getvec(f,vec,n,k);
+}
+
+
+/* Read the next entry of a batch file. Returns 1 for a solution of the
+   current system in vec, 2 if system *id with vectors of length *n
+   starts, 0 at the end of the file and -1 for a damaged file. vec must
+   have room for n entries, where n is at most nmax. */
+
+static inline int pagsol_batch_get(FILE *f, int *vec, int *id, int *n, int nmax)
+{ unsigned long k,v;
+
+  if (!pagsol_getvar(f,&k)) return 0;
+  if (k>0) return (*n>0 && pagsol_getvec(f,vec,*n,k-1)==1) ? 1 : -1;
+  if (!pagsol_getvar(f,&v) || v>1000000000UL) return -1;
+  *id=(int)v;
+  if (!pagsol_getvar(f,&v) || v==0 || v>(unsigned long)nmax) return -1;
+  *n=(int)v;
+  return 2;
+}
+
+#endif
@@ -0,0 +1,152 @@
+/*
+    PAGSYS.H
+
+    Binary format for the linear systems of solvecm, solvelibexact and
+    solvediophant, read by memory mapping the file. All numbers are
+    32-bit little-endian integers:
+
+      "PAGSYS\001\n"            8 bytes
+      m n 1 flags               rows, columns, number of right-hand sides,
+                                bit 0: compatibility matrix, bit 1: bounds
+      rhs[m]                    right-hand side
+      colptr[n+1]               the nonzeros of column i are
+      rowind[colptr[n]]           rowind/coef[colptr[i]..colptr[i+1]-1],
+      coef[colptr[n]]             with increasing row indices
+      bound[n]                  upper bounds of the variables (bit 1)
+      padding to a multiple of 8 bytes
+      cm[n][8*ceil(n/64)]       compatibility matrix (bit 0): bit j%8 of
+                                byte j/8 of row i is entry (i,j)
+
+    The rows of the compatibility matrix are little-endian 64-bit words
+    and can be used in place.
+
+    A batch file holds several systems one after another, each padded
+    to a multiple of 8 bytes. pagsys_map() maps the first system and
+    pagsys_next() moves to the following ones.
+*/
+
+#ifndef PAGSYS_H
+#define PAGSYS_H
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define PAGSYS_MAGIC	"PAGSYS\001\n"
+#define PAGSYS_CM	1
+#define PAGSYS_BOUNDS	2
+
+typedef struct pagsys {
+  int m,n,flags;
+  const int *rhs;
+  const int *colptr,*rowind,*coef;
+  const int *bound;             /* NULL without bounds */
+  const unsigned char *cm;      /* NULL without compatibility matrix */
+  size_t cmrow;                 /* Bytes in a row of cm */
+  void *map;
+  size_t size;
+  size_t next;                  /* Offset of the next system in the file */
+} PAGSYS;
+
+
+/* Check the system at offset off of the mapped file. Returns 1 if it is
+   valid, 0 if there is no system at off and -1 for a damaged one. */
+
+static inline int pagsys_record(PAGSYS *s, size_t off)
+{ int i,k;
+  const int *h;
+  size_t words,end,size;
+
+  size=s->size-off;
+  if (off>=s->size || size<8) return 0;
+  if (memcmp((const char *)s->map+off,PAGSYS_MAGIC,8)!=0) return -1;
+  if (size<24) return -1;
+
+  /* Check the header and the sizes of the sections */
+
+  h=(const int *)((const char *)s->map+off+8);
+  s->m=h[0];
+  s->n=h[1];
+  s->flags=h[3];
+  s->cm=NULL;
+  if (s->m<1 || s->n<1 || h[2]!=1) return -1;
+  words=6+(size_t)s->m+s->n+1;
+  if (words*4>size) return -1;
+  s->rhs=h+4;
+  s->colptr=s->rhs+s->m;
+  if (s->colptr[0]!=0 || s->colptr[s->n]<0) return -1;
+  words+=2*(size_t)s->colptr[s->n];
+  if (s->flags & PAGSYS_BOUNDS) words+=s->n;
+  if (words*4>size) return -1;
+  s->rowind=s->colptr+s->n+1;
+  s->coef=s->rowind+s->colptr[s->n];
+  s->bound = (s->flags & PAGSYS_BOUNDS) ? s->coef+s->colptr[s->n] : NULL;
+  s->cmrow=8*(((size_t)s->n+63)/64);
+  end=(words*4+7)/8*8;
+  if (s->flags & PAGSYS_CM)
+  { if (end+s->n*s->cmrow>size) return -1;
+    s->cm=(const unsigned char *)s->map+off+end;
+    end+=s->n*s->cmrow;
+  }
+  s->next=off+end;
+
+  /* Columns with increasing row indices */
+
+  for (i=0; i<s->n; ++i)
+  { if (s->colptr[i+1]<s->colptr[i] || s->colptr[i+1]>s->colptr[s->n]) return -1;
+    for (k=s->colptr[i]; k<s->colptr[i+1]; ++k)
+      if (s->rowind[k]<0 || s->rowind[k]>=s->m || (k>s->colptr[i] && s->rowind[k]<=s->rowind[k-1])) return -1;
+  }
+  return 1;
+}
+
+
+/* Map the file name. Returns 1 for a binary system, 0 if the file cannot
+   be opened or is not binary (it is then read as text) and -1 for a
+   damaged binary file. */
+
+static inline int pagsys_map(const char *name, PAGSYS *s)
+{ int fd;
+  struct stat st;
+  char magic[8];
+
+  memset(s,0,sizeof(PAGSYS));
+  fd=open(name,O_RDONLY);
+  if (fd<0) return 0;
+  if (read(fd,magic,8)!=8 || memcmp(magic,PAGSYS_MAGIC,8)!=0 || fstat(fd,&st)!=0)
+  { close(fd);
+    return 0;
+  }
+  s->size=st.st_size;
+  if (s->size<24)
+  { close(fd);
+    return -1;
+  }
+  s->map=mmap(NULL,s->size,PROT_READ,MAP_PRIVATE,fd,0);
+  close(fd);
+  if (s->map==MAP_FAILED)
+  { s->map=NULL;
+    return -1;
+  }
+  madvise(s->map,s->size,MADV_SEQUENTIAL);
+  return pagsys_record(s,0)==1 ? 1 : -1;
+}
+
+
+/* Move to the next system of a batch file. Returns 1 if there is one,
+   0 at the end of the file and -1 for a damaged system. */
+
+static inline int pagsys_next(PAGSYS *s)
+{ return pagsys_record(s,s->next);
+}
+
+
+static inline void pagsys_unmap(PAGSYS *s)
+{ if (s->map!=NULL) munmap(s->map,s->size);
+  s->map=NULL;
+}
+
+#endif
@@ -0,0 +1,318 @@
+/*
+    PRESOLVE.H
+
+    Presolve of the systems A x = rhs, 0 <= x <= upperb of solvediophant
+    before the lattice is built. Repeated until nothing changes:
+
+      - columns with upper bound 0 are removed,
+      - every row is divided by the gcd of its coefficients,
+      - a row with a single variable fixes it,
+      - in a row with nonnegative coefficients, a variable with a
+        coefficient larger than the right-hand side is fixed to 0, and
+        a variable that is needed at its upper bound to reach the
+        right-hand side is fixed to the upper bound,
+      - if row j is coefficientwise at most row k and both have the same
+        right-hand side, the variables where row k is larger are fixed
+        to 0 and row k is removed as a duplicate of row j.
+
+    Fixed variables are moved to the right-hand side and removed together
+    with the empty rows. The removed columns and their values are given to
+    diophant() to complete the solutions, see fixed_values. The number of
+    independent blocks of the reduced system is reported, and
+    presolve_split() labels them so that solvediophant can solve them
+    one by one.
+*/
+
+#ifndef PRESOLVE_H
+#define PRESOLVE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#define PRESOLVE_INF LONG_MAX   /* Bound of an unbounded variable */
+
+typedef struct presolve {
+  long **a,*b;                  /* Copy of the system */
+  long *u;                      /* Upper bounds */
+  int m,n;
+  int *row;                     /* Row j is still in the system */
+  long *value;                  /* Value of a fixed column, -1 if not fixed */
+  int changed;
+} PRESOLVE;
+
+
+static long presolve_gcd(long a, long b)
+{ long t;
+
+  if (a<0) a=-a;
+  if (b<0) b=-b;
+  while (b!=0)
+  { t=a%b;
+    a=b;
+    b=t;
+  }
+  return a;
+}
+
+
+/* Fix column i to v. Returns 0 if the right-hand side would overflow,
+   the column is then left in the system. */
+
+static int presolve_fix(PRESOLVE *P, int i, long v)
+{ int j;
+  long t;
+
+  for (j=0; j<P->m; ++j) if (P->row[j])
+    if (__builtin_mul_overflow(P->a[j][i],v,&t) || __builtin_sub_overflow(P->b[j],t,&t)) return 0;
+  for (j=0; j<P->m; ++j) if (P->row[j]) P->b[j]-=P->a[j][i]*v;
+  P->value[i]=v;
+  P->changed=1;
+  return 1;
+}
+
+
+/* Apply the single row rules to row j. Returns 0 if it has no solution. */
+
+static int presolve_row(PRESOLVE *P, int j)
+{ long *a,b,g,s,r,t;
+  int i,k,last,nonneg;
+
+  a=P->a[j];
+  g=0;
+  k=last=0;
+  nonneg=1;
+  for (i=0; i<P->n; ++i) if (P->value[i]<0 && a[i]!=0)
+  { g=presolve_gcd(g,a[i]);
+    if (a[i]<0) nonneg=0;
+    last=i;
+    ++k;
+  }
+
+  /* Empty row */
+
+  if (k==0)
+  { if (P->b[j]!=0) return 0;
+    P->row[j]=0;
+    P->changed=1;
+    return 1;
+  }
+
+  if (P->b[j]%g!=0) return 0;
+  if (g>1)
+  { for (i=0; i<P->n; ++i) if (P->value[i]<0) a[i]/=g;
+    P->b[j]/=g;
+    P->changed=1;
+  }
+  b=P->b[j];
+
+  /* A single variable, its coefficient is now 1 or -1 */
+
+  if (k==1)
+  { t = a[last]>0 ? b : -b;
+    if (t<0 || t>P->u[last]) return 0;
+    presolve_fix(P,last,t);
+    return 1;
+  }
+
+  if (!nonneg) return 1;
+  if (b<0) return 0;
+
+  /* Coefficients larger than the right-hand side, largest value of the row */
+
+  s=0;
+  for (i=0; i<P->n; ++i) if (P->value[i]<0 && a[i]>0)
+  { if (a[i]>b)
+    { presolve_fix(P,i,0);
+      continue;
+    }
+    if (s==PRESOLVE_INF) continue;
+    if (P->u[i]==PRESOLVE_INF || __builtin_mul_overflow(a[i],P->u[i],&t) || __builtin_add_overflow(s,t,&s)) s=PRESOLVE_INF;
+  }
+  if (s==PRESOLVE_INF) return 1;
+  if (s<b) return 0;
+
+  /* Variables that are needed at their upper bound. Fixing one of them
+     lowers s and b by the same amount, so the test stays valid. */
+
+  for (i=0; i<P->n; ++i) if (P->value[i]<0 && a[i]>0)
+  { r=s-a[i]*P->u[i];
+    if (r<b && (b-r+a[i]-1)/a[i]>=P->u[i]) presolve_fix(P,i,P->u[i]);
+  }
+  return 1;
+}
+
+
+/* Compare all pairs of rows. Returns 0 if the system has no solution. */
+
+static int presolve_pairs(PRESOLVE *P)
+{ int i,j,k,lo,hi,le,ge;
+
+  for (j=0; j<P->m; ++j) if (P->row[j])
+    for (k=j+1; k<P->m; ++k) if (P->row[k])
+    { le=ge=1;
+      for (i=0; i<P->n && (le || ge); ++i) if (P->value[i]<0)
+      { if (P->a[j][i]>P->a[k][i]) le=0;
+        if (P->a[j][i]<P->a[k][i]) ge=0;
+      }
+      if (le && ge)
+      { if (P->b[j]!=P->b[k]) return 0;
+        P->row[k]=0;
+        P->changed=1;
+      }
+      else if (le || ge)
+      { /* With x>=0 the smaller row has the smaller right-hand side */
+
+        lo = le ? j : k;
+        hi = le ? k : j;
+        if (P->b[lo]>P->b[hi]) return 0;
+        if (P->b[lo]==P->b[hi])
+          for (i=0; i<P->n; ++i) if (P->value[i]<0 && P->a[hi][i]>P->a[lo][i]) presolve_fix(P,i,0);
+      }
+    }
+  return 1;
+}
+
+
+static int presolve_find(int *parent, int i)
+{ while (parent[i]!=i) i=parent[i]=parent[parent[i]];
+  return i;
+}
+
+
+/* Number of independent blocks of the remaining system */
+
+static int presolve_blocks(PRESOLVE *P)
+{ int *parent,i,j,first,blocks;
+
+  parent=(int *)calloc(P->n,sizeof(int));
+  for (i=0; i<P->n; ++i) parent[i]=i;
+  for (j=0; j<P->m; ++j) if (P->row[j])
+  { first=-1;
+    for (i=0; i<P->n; ++i) if (P->value[i]<0 && P->a[j][i]!=0)
+    { if (first<0) first=presolve_find(parent,i);
+      else parent[presolve_find(parent,i)]=first;
+    }
+  }
+  blocks=0;
+  for (i=0; i<P->n; ++i) if (P->value[i]<0 && presolve_find(parent,i)==i) ++blocks;
+  free(parent);
+  return blocks;
+}
+
+
+/* Independent blocks of the system A with m rows and n columns, numbered
+   in the order of their first column. Column i is in block colblock[i]
+   and row j in block rowblock[j]; a row without nonzero entries gets -1
+   and a column without them is a block of its own. Returns the number
+   of blocks. */
+
+static int presolve_split(long **A, int m, int n, int *rowblock, int *colblock)
+{ int *parent,i,j,first,blocks;
+
+  parent=(int *)calloc(n,sizeof(int));
+  for (i=0; i<n; ++i) parent[i]=i;
+  for (j=0; j<m; ++j)
+  { first=-1;
+    for (i=0; i<n; ++i) if (A[j][i]!=0)
+    { if (first<0) first=presolve_find(parent,i);
+      else parent[presolve_find(parent,i)]=first;
+    }
+  }
+  blocks=0;
+  for (i=0; i<n; ++i) colblock[i]=-1;
+  for (i=0; i<n; ++i)
+  { j=presolve_find(parent,i);
+    if (colblock[j]<0) colblock[j]=blocks++;
+    colblock[i]=colblock[j];
+  }
+  for (j=0; j<m; ++j)
+  { rowblock[j]=-1;
+    for (i=0; i<n && rowblock[j]<0; ++i) if (A[j][i]!=0) rowblock[j]=colblock[i];
+  }
+  free(parent);
+  return blocks;
+}
+
+
+/* Presolve the system with m rows and n columns. upperb is NULL for 0/1
+   variables; otherwise the first nbounded columns have upper bounds and
+   the others are unbounded (all are 0/1 if nbounded is 0).
+   value gets the values of the fixed columns and -1 for the others.
+   Returns -1 if the system has no solution, 0 if it is left unchanged
+   and 1 if A, rhs, upperb, m, n and nbounded were replaced by the
+   reduced system. */
+
+static int presolve(long **A, long *rhs, long *upperb, int *m, int *n, int *nbounded, long *value)
+{ PRESOLVE P;
+  int i,j,k,rows,columns,bounded,feasible,reduced,res;
+
+  P.m=*m;
+  P.n=*n;
+  P.value=value;
+  P.row=(int *)calloc(P.m,sizeof(int));
+  P.a=(long **)calloc(P.m,sizeof(long *));
+  P.b=(long *)calloc(P.m,sizeof(long));
+  P.u=(long *)calloc(P.n,sizeof(long));
+  for (j=0; j<P.m; ++j)
+  { P.a[j]=(long *)calloc(P.n,sizeof(long));
+    for (i=0; i<P.n; ++i) P.a[j][i]=A[j][i];
+    P.b[j]=rhs[j];
+    P.row[j]=1;
+  }
+  for (i=0; i<P.n; ++i)
+  { value[i]=-1;
+    if (upperb==NULL || *nbounded==0) P.u[i]=1;
+    else P.u[i] = i<*nbounded ? upperb[i] : PRESOLVE_INF;
+  }
+
+  feasible=1;
+  reduced=0;
+  do
+  { P.changed=0;
+    for (i=0; i<P.n; ++i) if (value[i]<0 && P.u[i]==0) presolve_fix(&P,i,0);
+    for (j=0; j<P.m && feasible; ++j) if (P.row[j]) feasible=presolve_row(&P,j);
+    if (feasible && !P.changed) feasible=presolve_pairs(&P);
+    reduced|=P.changed;
+  } while (feasible && P.changed);
+
+  res = feasible ? reduced : -1;
+  if (res>0)
+  { rows=columns=bounded=0;
+    for (j=0; j<P.m; ++j) rows+=P.row[j];
+    for (i=0; i<P.n; ++i) if (value[i]<0)
+    { ++columns;
+      if (i<*nbounded) ++bounded;
+    }
+
+    /* diophant() needs a nonempty system, and nbounded=0 means 0/1 */
+
+    if (rows==0 || columns==0 || (*nbounded>0 && bounded==0))
+    { printf("Presolve: the reduced system would be empty, it is not used\n");
+      res=0;
+    }
+  }
+  if (res==0) for (i=0; i<P.n; ++i) value[i]=-1;
+
+  if (res>0)
+  { printf("Presolve: %d rows and %d columns removed, %d independent blocks\n",
+      P.m-rows,P.n-columns,presolve_blocks(&P));
+    for (j=k=0; j<P.m; ++j) if (P.row[j])
+    { for (i=columns=0; i<P.n; ++i) if (value[i]<0) A[k][columns++]=P.a[j][i];
+      rhs[k++]=P.b[j];
+    }
+    if (upperb!=NULL)
+      for (i=columns=0; i<P.n; ++i) if (value[i]<0) upperb[columns++]=upperb[i];
+    *m=rows;
+    *n=columns;
+    if (*nbounded>0) *nbounded=bounded;
+  }
+  for (j=0; j<P.m; ++j) free(P.a[j]);
+  free(P.a);
+  free(P.b);
+  free(P.u);
+  free(P.row);
+  return res;
+}
+
+#endif
@@ -2,6 +2,8 @@
     SOL2GAP.C
 
     Trasform solution vectors from 'solvediophant' to GAP format.
+    Reads text files and the binary format of pagsol.h. The solutions
+    of a batch file are written as a list with one list for each system.
 
     Vedran Krcadinac (krcko@math.hr), 28.4.2022.
 
@@ -11,6 +13,92 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include "pagsol.h"
+
+
+/* An entry with value v is listed v times */
+
+void printsolution(int *vec, int n)
+{ int i,k,first;
+
+  printf("[");
+  first=1;
+  for (i=0; i<n; ++i) for (k=0; k<vec[i]; ++k)
+  { if (first) first=0;
+    else printf(",");
+    printf("%d",i+1);
+  }
+  printf("]");
+}
+
+
+/* Binary solution file */
+
+void binarysolutions(int n)
+{ int ok,*vec,firstrow;
+
+  vec = (int *)malloc(n*sizeof(int));
+  if (vec==NULL)
+  { printf("Out of memory!\n");
+    exit(0);
+  }
+  firstrow=1;
+  while ((ok=pagsol_get(stdin,vec,n))==1)
+  { if (firstrow) firstrow=0;
+    else printf(",\n");
+    printsolution(vec,n);
+  }
+  if (ok<0)
+  { printf("Error - damaged binary solution file!\n");
+    exit(0);
+  }
+  free(vec);
+}
+
+
+/* Batch solution file: the systems are numbered 0, 1, ... */
+
+#define MAXLENGTH	10000000
+
+void batchsolutions(void)
+{ int ok,*vec,id,next,n,maxn,firstrow;
+
+  vec=NULL;
+  maxn=0;
+  n=0;
+  next=0;
+  firstrow=1;
+  while ((ok=pagsol_batch_get(stdin,vec,&id,&n,MAXLENGTH))>0)
+  { if (ok==2)
+    { if (id!=next)
+      { printf("Error - damaged binary solution file!\n");
+        exit(0);
+      }
+      if (next>0) printf(" ],\n");
+      printf("[ ");
+      ++next;
+      firstrow=1;
+      if (n>maxn)
+      { maxn=n;
+        vec = (int *)realloc(vec,n*sizeof(int));
+        if (vec==NULL)
+        { printf("Out of memory!\n");
+          exit(0);
+        }
+      }
+      continue;
+    }
+    if (firstrow) firstrow=0;
+    else printf(",\n  ");
+    printsolution(vec,n);
+  }
+  if (ok<0)
+  { printf("Error - damaged binary solution file!\n");
+    exit(0);
+  }
+  if (next>0) printf(" ]");
+  free(vec);
+}
 
 /****************/
 /* Main program */
@@ -22,7 +110,13 @@ int main(int argc,char *argv[])
 
   /* Command line arguments */
 
-  for(i=1; i<argc; ++i)
+  for(i=1; i<argc; ++i) if (argv[i][0] != '-')
+  { if (freopen(argv[i],"rb",stdin)==NULL)
+    { printf("Cannot open file '%s'!\n",argv[i]);
+      exit(0);
+    }
+  }
+  else
   { j = 0;
     while (argv[i][j] != '\0')
     { /* if (argv[i][j] == 'p') mask |= 1;
@@ -30,8 +124,8 @@ int main(int argc,char *argv[])
     
       /* Help */
       if ((argv[i][j] == 'h') || (argv[i][j] == 'H') || (argv[i][j] == '?'))
-      { printf("Usage: sol2gap\n");
-        printf("Solution vectors are taken from stdin.\n");
+      { printf("Usage: sol2gap [solution_file]\n");
+        printf("Solution vectors are taken from the file or from stdin.\n");
         printf("\n");
 	exit(0);
       }
@@ -40,6 +134,21 @@ int main(int argc,char *argv[])
   }
 
   printf("return [\n");
+  rowlength=pagsol_check(stdin);
+  if (rowlength<0)
+  { printf("Error - damaged binary solution file!\n");
+    exit(0);
+  }
+  if (rowlength==PAGSOL_BATCH)
+  { batchsolutions();
+    printf("\n];\n");
+    exit(0);
+  }
+  if (rowlength>0)
+  { binarysolutions(rowlength);
+    printf("\n];\n");
+    exit(0);
+  }
   ok=1; 
   rowlength=0;
   count=0;
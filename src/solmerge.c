@@ -0,0 +1,292 @@
+/*
+    SOLMERGE.C
+
+    Merges solution files written by the solvers, e.g. the outputs of
+    runs with the option -shardI/N. Checks that all lines are solution
+    vectors of the same length and removes repeated solutions. Text files
+    and the binary format of pagsol.h can be mixed.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pagsol.h"
+
+
+/****************/
+/* Global stuff */
+/****************/
+
+char **table;                 /* Hash table of the solutions written so far */
+long tablesize,nsolutions;
+int binary=0;                 /* Write the binary format */
+int *vec;                     /* The current solution */
+size_t vecsize;
+
+
+void *allocate(size_t size)
+{ void *p;
+
+  p = calloc(size,1);
+  if (p==NULL)
+  { printf("Out of memory!\n");
+    exit(0);
+  }
+  return p;
+}
+
+
+unsigned long hash(char *s)
+{ unsigned long h;
+
+  h=14695981039346656037UL;
+  while (*s) h=(h^(unsigned char)*s++)*1099511628211UL;
+  return h;
+}
+
+
+/* Insert a solution, returns 0 if it was already there */
+
+int insert(char *key)
+{ long i,j,k;
+  char **old;
+
+  if (2*(nsolutions+1)>tablesize)
+  { old=table;
+    k=tablesize;
+    tablesize = tablesize ? 2*tablesize : 1024;
+    table = (char **)allocate(tablesize*sizeof(char *));
+    for (i=0; i<k; ++i) if (old[i]!=NULL)
+    { j=hash(old[i])%tablesize;
+      while (table[j]!=NULL) j=(j+1)%tablesize;
+      table[j]=old[i];
+    }
+    free(old);
+  }
+
+  i=hash(key)%tablesize;
+  while (table[i]!=NULL)
+  { if (strcmp(table[i],key)==0) return 0;
+    i=(i+1)%tablesize;
+  }
+  table[i] = (char *)allocate(strlen(key)+1);
+  strcpy(table[i],key);
+  ++nsolutions;
+  return 1;
+}
+
+
+/* Normalize a solution line to a comma separated list of entries.
+   Lines without spaces are 0-1 vectors written without separators.
+   Returns the number of entries, or -1 if the line is not a solution. */
+
+int normalize(char *line, char *key)
+{ int len,spaces;
+  char *p,*q;
+
+  spaces = strchr(line,' ')!=NULL;
+  len=0;
+  p=line;
+  q=key;
+  while (*p)
+  { if (*p==' ') { ++p; continue; }
+    if (*p<'0' || *p>'9') return -1;
+    if (len>0) *q++=',';
+    if (spaces) while (*p>='0' && *p<='9') *q++=*p++;
+    else *q++=*p++;
+    ++len;
+  }
+  *q='\0';
+  return len;
+}
+
+
+/* Parse a normalized solution into vec */
+
+void parsekey(char *key, int len)
+{ int i;
+  char *p;
+
+  if (vecsize<(size_t)len+1)
+  { vecsize=2*len+1;
+    free(vec);
+    vec = (int *)allocate(vecsize*sizeof(int));
+  }
+  p=key;
+  for (i=0; i<len; ++i)
+  { vec[i]=(int)strtol(p,&p,10);
+    if (*p==',') ++p;
+  }
+}
+
+
+/* Write vec: digits without separators if all entries are digits */
+
+void writesolution(FILE *outfile, int len)
+{ int i,small;
+
+  if (binary)
+  { if (nsolutions==1) pagsol_header(outfile,len);
+    pagsol_put(outfile,vec,len);
+    return;
+  }
+  small=1;
+  for (i=0; i<len; ++i) small &= vec[i]>=0 && vec[i]<=9;
+  for (i=0; i<len; ++i)
+    if (small) fputc('0'+vec[i],outfile);
+    else fprintf(outfile,"%d ",vec[i]);
+  fputc('\n',outfile);
+}
+
+
+/****************/
+/* Main program */
+/****************/
+
+int main(int argc,char *argv[])
+{ int i,j,len,rowlength,nfiles,bin,ok;
+  long lineno,total,duplicates,counted,k;
+  char *outfilename, *line=NULL, *key=NULL;
+  size_t linesize=0,keysize=0;
+  FILE *infile, *outfile;
+
+  outfilename="solutions";
+
+  /* Command line arguments */
+
+  nfiles=0;
+  for(i=1; i<argc; ++i) if (argv[i][0] != '-') ++nfiles;
+  else
+  { j = 0;
+    while (argv[i][j] != '\0')
+    { /* Help */
+      if ((argv[i][j] == 'h') || (argv[i][j] == 'H') || (argv[i][j] == '?'))
+      { printf("Usage: solmerge [options] solution_files\n");
+        printf("Options:\n");
+        printf("-oFILENAME  Output file name (default: %s).\n",outfilename);
+        printf("-b          Write the solutions in binary format (default no).\n");
+        printf("\n");
+        exit(0);
+      }
+      if (argv[i][j] == 'b') binary=1;
+      if (argv[i][j] == 'o')
+      { outfilename=argv[i]+j+1;
+        while (argv[i][j] != '\0') ++j;
+        --j;
+      }
+      ++j;
+    }
+  }
+
+  if (nfiles==0)
+  { printf("No input files!\n");
+    exit(0);
+  }
+
+  outfile = fopen(outfilename,"w");
+  if (outfile==0)
+  { printf("Cannot open output file '%s'!\n",outfilename);
+    exit(0);
+  }
+  if (binary) pagsol_start(outfile,0,0);
+
+  rowlength=-1;
+  total=duplicates=counted=0;
+  for (i=1; i<argc; ++i) if (argv[i][0] != '-')
+  { infile = fopen(argv[i],"r");
+    if (infile==0)
+    { printf("Cannot open file '%s'!\n",argv[i]);
+      exit(0);
+    }
+    lineno=0;
+
+    /* Binary file */
+
+    bin=pagsol_check(infile);
+    if (bin<0)
+    { printf("File '%s' is a damaged binary solution file!\n",argv[i]);
+      exit(0);
+    }
+    if (bin==PAGSOL_BATCH)
+    { printf("File '%s' is a batch solution file, which cannot be merged!\n",argv[i]);
+      exit(0);
+    }
+    if (bin>0)
+    { if (rowlength==-1) rowlength=bin;
+      else if (bin!=rowlength)
+      { printf("File '%s': vectors of length %d instead of %d!\n",argv[i],bin,rowlength);
+        exit(0);
+      }
+      if (vecsize<(size_t)bin+1)
+      { vecsize=bin+1;
+        free(vec);
+        vec = (int *)allocate(vecsize*sizeof(int));
+      }
+      if (keysize<(size_t)12*bin+1)
+      { keysize=12*bin+1;
+        free(key);
+        key = (char *)allocate(keysize);
+      }
+      while ((ok=pagsol_get(infile,vec,bin))==1)
+      { ++lineno;
+        for (j=len=0; j<bin; ++j) len+=sprintf(key+len,j>0 ? ",%d" : "%d",vec[j]);
+        ++total;
+        if (insert(key)) writesolution(outfile,bin);
+        else ++duplicates;
+      }
+      if (ok<0)
+      { printf("File '%s' is a damaged binary solution file after %ld solutions!\n",argv[i],lineno);
+        exit(0);
+      }
+      fclose(infile);
+      continue;
+    }
+
+    while (getline(&line,&linesize,infile)!=-1)
+    { ++lineno;
+      line[strcspn(line,"\r\n")]='\0';
+      if (line[0]=='\0' || strcmp(line,"SILENT")==0) continue;
+
+      /* Solution counts written with the option -silent */
+
+      if (sscanf(line,"%ld solutions",&k)==1 && strstr(line,"solutions")!=NULL)
+      { counted+=k;
+        continue;
+      }
+
+      if (keysize<2*strlen(line)+1)
+      { keysize=2*strlen(line)+1;
+        free(key);
+        key = (char *)allocate(keysize);
+      }
+      len=normalize(line,key);
+      if (len<0)
+      { printf("File '%s', line %ld is not a solution vector!\n",argv[i],lineno);
+        exit(0);
+      }
+      if (rowlength==-1) rowlength=len;
+      else if (len!=rowlength)
+      { printf("File '%s', line %ld: vector of length %d instead of %d!\n",argv[i],lineno,len,rowlength);
+        exit(0);
+      }
+      ++total;
+      if (insert(key))
+      { if (binary)
+        { parsekey(key,len);
+          writesolution(outfile,len);
+        }
+        else fprintf(outfile,"%s\n",line);
+      }
+      else ++duplicates;
+    }
+    fclose(infile);
+  }
+
+  if (counted>0 && !binary) fprintf(outfile,"%ld solutions\n",counted);
+  fclose(outfile);
+
+  printf("Files: %d\n",nfiles);
+  printf("Solutions read: %ld\n",total);
+  printf("Repeated solutions removed: %ld\n",duplicates);
+  printf("Total number of solutions: %ld\n",nsolutions+counted);
+}
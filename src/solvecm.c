@@ -8,83 +8,1252 @@
 */
 
 
-#define MAXM		5000
-#define MAXN		20000
 #define UPDATEFREQ	10000
+#define MAXTHREADS	256
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "pagsol.h"
+#include "pagsys.h"
+
+
+typedef unsigned long long WORD;   /* Bitsets are packed into 64-bit words */
+#define WORDBITS	64
 
 
 /****************/
 /* Global stuff */
 /****************/
 
-int A[MAXM][MAXN], b[MAXM];   /* The linear system */
-char cm[MAXN][MAXN];          /* The compatibility matrix */
+int *b;                       /* The right-hand side */
+int *orbit;                   /* The last row of the system: orbit sizes */
+int *colptr,*rowind,*coef;    /* Nonzeros of the other rows, column-wise:
+                                 column i has rowind/coef[colptr[i]..colptr[i+1]-1] */
+int *rownz;                   /* Number of nonzeros in each row */
+WORD *cm;                     /* The compatibility matrix, n rows of nw words */
 int m,n,x=-1;                 /* Dimensions */
-int psum[MAXM],tree[MAXN],sol[MAXN],solvec[MAXN],maxdepth;
-int count,update;
+int nw;                       /* Number of words in a bitset of n columns */
+int maxlevel;                 /* Maximal number of columns in a solution */
+WORD *rowbits;                /* Columns with a positive coefficient in row j, nw words per row */
+int *reach,*reachptr;         /* reach[reachptr[j]+d]: largest start column from which
+                                 row j can still gain d, or -1 */
 FILE *outfile;
 
+int nthreads=1;               /* Number of worker threads */
+int splitdepth=3;             /* Depth at which the tree is split into subproblems */
+int shard=0,nshards=1;        /* Search only the subproblems with index = shard mod nshards */
+int splitmode;                /* The tree is split into subproblems */
+
+char *ckfilename=0;           /* Checkpoint file */
+int ckinterval=600;           /* Seconds between checkpoints */
+time_t lastck;
+int nargs;                    /* Command line, saved in the checkpoint */
+char **args;
+
+long ckoffset;                /* Checkpoint being resumed: length of the output file, */
+int cklevels,*cktree;         /* tree counters, */
+int ckcount,ckmaxdepth;       /* solutions and depth, */
+int resumedepth,*resumesol;   /* path to the node where the search stopped, */
+int ckntasks,ckndone,*ckdone; /* or the finished subproblems in parallel mode */
+
+char *done;                   /* Finished subproblems */
+int *donetree,donecount;      /* and their counters */
+
+
+int nprobes=0;                /* Only estimate the size of the search tree from this many probes */
+double starttime;             /* Start of the search, for the progress report */
+int *children;                /* Children of a node in a probe */
+
 
 int mask = 0;	/* An integer mask for options */
 /* Meaning of the bits:
   0 - read compatibility matrix
+  1 - branch on the most constrained row
+  2 - print progress lines
+  3 - write the solutions in the binary format of pagsol.h
+  4 - the input is a batch of binary systems
 */
 
-void writemat(int *mat, int m, int n)
-{ int i,j;
+/* State of one search: the main thread or a worker */
 
-  for (i=0; i<m; ++i)
-  { for (j=0; j<n; ++j) printf("%d ",*(mat+MAXN*i+j));
+typedef struct state {
+  int *psum,*tree,*sol,*solvec;
+  WORD *cand;                 /* Columns compatible with sol[0..d-1], nw words per depth d.
+                                 With row branching: the columns still available at depth d */
+  int *limit,*limrow;         /* Last column usable at depth d and the row that forces it */
+  int maxdepth,count,update;
+  int split;                  /* Record subproblems at splitdepth instead of descending */
+  int replay;                 /* Replaying the path of a resumed checkpoint */
+  int *mark,markcount;        /* Counters at the start of the current subproblem */
+  char *buf;                  /* Solutions of the current subproblem */
+  size_t buflen,bufsize;
+} STATE;
+
+/* tree, maxdepth and count are written only by the owner of the state,
+   but read by the other threads for the progress lines */
+
+#define LOADCOUNTER(x) __atomic_load_n(&(x),__ATOMIC_RELAXED)
+#define STORECOUNTER(x,v) __atomic_store_n(&(x),(v),__ATOMIC_RELAXED)
+
+/* A subproblem: the search below the partial solution sol[0..depth-1] */
+
+typedef struct task {
+  int depth,start,remaining;
+  int *sol;
+  WORD *avail;                /* Available columns, with row branching */
+} TASK;
+
+/* Double-ended queue of subproblems owned by a worker */
+
+typedef struct deque {
+  int *task;
+  int head,tail;
+  pthread_mutex_t lock;
+} DEQUE;
+
+STATE mainstate, *worker[MAXTHREADS];
+TASK *task;
+int ntasks,maxtasks;
+DEQUE deque[MAXTHREADS];
+pthread_mutex_t outlock = PTHREAD_MUTEX_INITIALIZER;
+
+
+void *allocate(size_t size)
+{ void *p;
+
+  p = calloc(size,1);
+  if (p==NULL)
+  { printf("Out of memory!\n");
+    exit(0);
+  }
+  return p;
+}
+
+
+void setupstate(STATE *st)
+{ int i;
+
+  st->psum = (int *)allocate(m*sizeof(int));
+  st->tree = (int *)allocate((n+1)*sizeof(int));
+  st->sol = (int *)allocate((n+1)*sizeof(int));
+  st->solvec = (int *)allocate((n+1)*sizeof(int));
+  st->limit = (int *)allocate((maxlevel+2)*sizeof(int));
+  st->limrow = (int *)allocate((maxlevel+2)*sizeof(int));
+  st->mark = (int *)allocate((maxlevel+2)*sizeof(int));
+  st->update = UPDATEFREQ;
+  if (mask & 3)
+  { st->cand = (WORD *)allocate((size_t)(maxlevel+1)*nw*sizeof(WORD));
+    for (i=0; i<n; ++i) st->cand[i/WORDBITS] |= (WORD)1 << (i%WORDBITS);
+  }
+}
+
+
+STATE *newstate(void)
+{ STATE *st;
+
+  st = (STATE *)allocate(sizeof(STATE));
+  setupstate(st);
+  return st;
+}
+
+
+/* Free the arrays of a state and clear its counters */
+
+void freestate(STATE *st)
+{ free(st->psum);
+  free(st->tree);
+  free(st->sol);
+  free(st->solvec);
+  free(st->limit);
+  free(st->limrow);
+  free(st->mark);
+  free(st->cand);
+  free(st->buf);
+  memset(st,0,sizeof(STATE));
+}
+
+
+/* Wall clock time in seconds */
+
+double seconds(void)
+{ struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+
+/* Print the per-depth tree counters summed over all states.
+   With -p also a progress line of the form
+   progress: time=T nodes=N nodes_per_sec=R solutions=S solutions_per_sec=Q depth=D branching=B1,B2,...
+   where Bi is the ratio of the numbers of nodes at depths i and i-1. */
+
+void printtree(void)
+{ int i,k,maxdepth,count,sum,prev;
+  double nodes,t;
+
+  maxdepth=LOADCOUNTER(mainstate.maxdepth);
+  count=LOADCOUNTER(mainstate.count);
+  for (k=1; k<nthreads; ++k) if (worker[k]!=NULL)
+  { if (LOADCOUNTER(worker[k]->maxdepth)>maxdepth) maxdepth=LOADCOUNTER(worker[k]->maxdepth);
+    count+=LOADCOUNTER(worker[k]->count);
+  }
+  printf("tree: ");
+  for (i=0; i<maxdepth; ++i)
+  { sum=LOADCOUNTER(mainstate.tree[i]);
+    for (k=1; k<nthreads; ++k) if (worker[k]!=NULL) sum+=LOADCOUNTER(worker[k]->tree[i]);
+    printf("%d ",sum);
+  }
+  printf("(%d solutions)\n",count);
+
+  if (mask & 4)
+  { nodes=0;
+    for (i=0; i<=maxdepth; ++i)
+    { nodes+=LOADCOUNTER(mainstate.tree[i]);
+      for (k=1; k<nthreads; ++k) if (worker[k]!=NULL) nodes+=LOADCOUNTER(worker[k]->tree[i]);
+    }
+    t=seconds()-starttime;
+    if (t<1e-6) t=1e-6;
+    printf("progress: time=%.1f nodes=%.0f nodes_per_sec=%.0f solutions=%d solutions_per_sec=%.2f depth=%d branching=",
+      t,nodes,nodes/t,count,count/t,maxdepth);
+    prev=0;
+    for (i=0; i<=maxdepth; ++i)
+    { sum=LOADCOUNTER(mainstate.tree[i]);
+      for (k=1; k<nthreads; ++k) if (worker[k]!=NULL) sum+=LOADCOUNTER(worker[k]->tree[i]);
+      if (i>0) printf("%s%.2f",i>1?",":"",prev ? (double)sum/prev : 0.0);
+      prev=sum;
+    }
     printf("\n");
   }
-  /* printf("\n"); */
   fflush(stdout);
 }
 
 
-void search(int depth, int start, int remaining)
-{ int i,j,ok;
+void addtask(STATE *st, int depth, int start, int remaining)
+{ int i;
 
-  if (depth>maxdepth) maxdepth=depth;
-  ++tree[depth];
-  --update;
-  if (update==0)
-  { update=UPDATEFREQ;
-    printf("tree: ");
-    for (i=0; i<maxdepth; ++i) printf("%d ",tree[i]);
-    printf("(%d solutions)\n",count);
-    fflush(stdout);
+  if (ntasks==maxtasks)
+  { maxtasks = maxtasks ? 2*maxtasks : 1024;
+    task = (TASK *)realloc(task,maxtasks*sizeof(TASK));
+    if (task==NULL)
+    { printf("Out of memory!\n");
+      exit(0);
+    }
   }
+  task[ntasks].depth=depth;
+  task[ntasks].start=start;
+  task[ntasks].remaining=remaining;
+  task[ntasks].sol=(int *)allocate((depth+1)*sizeof(int));
+  for (i=0; i<depth; ++i) task[ntasks].sol[i]=st->sol[i];
+  if (mask & 2)
+  { task[ntasks].avail=(WORD *)allocate(nw*sizeof(WORD));
+    for (i=0; i<nw; ++i) task[ntasks].avail[i]=st->cand[(size_t)depth*nw+i];
+  }
+  ++ntasks;
+}
+
+
+/* First column >=i compatible with the columns chosen at depths <depth */
+
+int nextcand(STATE *st, int depth, int i)
+{ WORD *c,w;
+  int k;
+
+  if (!(mask & 1)) return i;
+  if (i>=n) return n;
+  c=st->cand+(size_t)depth*nw;
+  k=i/WORDBITS;
+  w=c[k] & (~(WORD)0 << (i%WORDBITS));
+  while (w==0)
+  { if (++k==nw) return n;
+    w=c[k];
+  }
+  return k*WORDBITS+__builtin_ctzll(w);
+}
+
+
+/* Candidates at depth+1: AND of the candidates at depth and the row of column i.
+   Only columns >i are used further down, so the lower words are skipped. */
+
+void choose(STATE *st, int depth, int i)
+{ WORD *c,*d,*r;
+  int k;
+
+  st->sol[depth]=i;
+  if (!(mask & 1)) return;
+  c=st->cand+(size_t)depth*nw;
+  d=c+nw;
+  r=cm+(size_t)i*nw;
+  for (k=(i+1)/WORDBITS; k<nw; ++k) d[k]=c[k] & r[k];
+}
+
+
+/*************************/
+/* Reachability pruning */
+/*************************/
+
+/* Build the reach table from the suffix sums of each row.
+   The last row is bounded by b[m-1], the others by b[j]. */
+
+void setupreach(void)
+{ int i,j,k,d,r;
+  int *sum;
+
+  reachptr = (int *)allocate((m+1)*sizeof(int));
+  for (j=0; j<m; ++j) reachptr[j+1]=reachptr[j]+b[j]+1;
+  reach = (int *)allocate(reachptr[m]*sizeof(int));
+  for (k=0; k<reachptr[m]; ++k) reach[k]=-1;
+  sum = (int *)allocate(m*sizeof(int));
+
+  for (i=n-1; i>=0; --i)
+  { for (k=colptr[i]; k<=colptr[i+1]; ++k)
+    { if (k<colptr[i+1])
+      { j=rowind[k];
+        d=coef[k];
+      }
+      else
+      { j=m-1;
+        d=orbit[i];
+      }
+      if (d<=0) continue;
+      for (r=sum[j]+1; r<=sum[j]+d && r<=b[j]; ++r) reach[reachptr[j]+r]=i;
+      sum[j]+=d;
+    }
+  }
+  free(sum);
+}
+
+
+/* Last column from which row j can still gain d (n if nothing is missing) */
+
+int reachable(int j, int d)
+{ if (d<=0) return n;
+  if (d>b[j]) d=b[j];
+  return reach[reachptr[j]+d];
+}
+
+
+/* What row j still needs with partial sum p. With -x a row below x
+   needs to reach x, a row above x needs to reach b[j]. */
+
+int deficit(int j, int p)
+{ if (x!=-1 && x<b[j] && p<=x) return x-p;
+  return b[j]-p;
+}
+
+
+/* Compute limit[depth] from all rows */
+
+void fulllimit(STATE *st, int depth)
+{ int j,t;
+
+  st->limit[depth]=n;
+  st->limrow[depth]=-1;
+  for (j=0; j<m-1; ++j)
+  { t=reachable(j,deficit(j,st->psum[j]));
+    if (t<st->limit[depth])
+    { st->limit[depth]=t;
+      st->limrow[depth]=j;
+    }
+  }
+}
+
+
+/* Compute limit[depth+1] after adding column i at depth. Only the rows of
+   column i change, unless the row forcing limit[depth] is one of them. */
+
+void nextlimit(STATE *st, int depth, int i)
+{ int k,t;
+
+  for (k=colptr[i]; k<colptr[i+1]; ++k) if (rowind[k]==st->limrow[depth])
+  { fulllimit(st,depth+1);
+    return;
+  }
+  st->limit[depth+1]=st->limit[depth];
+  st->limrow[depth+1]=st->limrow[depth];
+  for (k=colptr[i]; k<colptr[i+1]; ++k)
+  { t=reachable(rowind[k],deficit(rowind[k],st->psum[rowind[k]]));
+    if (t<st->limit[depth+1])
+    { st->limit[depth+1]=t;
+      st->limrow[depth+1]=rowind[k];
+    }
+  }
+}
+
+
+/* Last column usable at depth: bounded by the rows and by the orbit row */
+
+int lastcolumn(STATE *st, int depth, int remaining)
+{ int t;
+
+  t=reachable(m-1,remaining);
+  return t<st->limit[depth] ? t : st->limit[depth];
+}
+
+
+/* Remove the columns of a saturated row from a bitset */
+
+void clearrow(WORD *c, int j)
+{ int k;
+  WORD *r;
+
+  r=rowbits+(size_t)j*nw;
+  for (k=0; k<nw; ++k) c[k] &= ~r[k];
+}
+
+
+/***************/
+/* Checkpoints */
+/***************/
+
+/* Write the search frontier: in serial mode the path to the current node,
+   in parallel mode the finished subproblems. The file is replaced atomically.
+   Called with outlock held. */
+
+void checkpoint(STATE *st, int depth)
+{ FILE *f;
+  char *tmpname;
+  int i,k,*tree,count,maxdepth;
+
+  tmpname = (char *)allocate(strlen(ckfilename)+5);
+  sprintf(tmpname,"%s.tmp",ckfilename);
+  f = fopen(tmpname,"w");
+  if (f==0)
+  { printf("Cannot write checkpoint file '%s'!\n",tmpname);
+    free(tmpname);
+    return;
+  }
+
+  if (!splitmode)
+  { tree=st->tree;
+    count=st->count;
+    maxdepth=st->maxdepth;
+  }
+  else
+  { tree=donetree;
+    count=donecount;
+    maxdepth=LOADCOUNTER(mainstate.maxdepth);
+    for (k=1; k<nthreads; ++k) if (worker[k]!=NULL && LOADCOUNTER(worker[k]->maxdepth)>maxdepth)
+      maxdepth=LOADCOUNTER(worker[k]->maxdepth);
+  }
+
+  fprintf(f,"solvecm checkpoint\n%d\n",nargs);
+  for (i=0; i<nargs; ++i) fprintf(f,"%s\n",args[i]);
+  fflush(outfile);
+  fprintf(f,"offset %ld\n",ftell(outfile));
+  fprintf(f,"count %d\nmaxdepth %d\ntree %d",count,maxdepth,maxlevel+1);
+  for (i=0; i<=maxlevel; ++i) fprintf(f," %d",tree[i]);
+  fprintf(f,"\n");
+  if (!splitmode)
+  { fprintf(f,"path %d",depth);
+    for (i=0; i<depth; ++i) fprintf(f," %d",st->sol[i]);
+  }
+  else
+  { for (i=k=0; i<ntasks; ++i) k+=done[i];
+    fprintf(f,"tasks %d %d",ntasks,k);
+    for (i=0; i<ntasks; ++i) if (done[i]) fprintf(f," %d",i);
+  }
+  fprintf(f,"\n");
+
+  if (fclose(f)!=0 || rename(tmpname,ckfilename)!=0)
+    printf("Cannot write checkpoint file '%s'!\n",ckfilename);
+  free(tmpname);
+  lastck=time(NULL);
+}
+
+
+/* Read a checkpoint: the saved command line and the search frontier */
+
+void readcheckpoint(char *name)
+{ FILE *f;
+  char line[4096],word[16];
+  int i,ok;
+
+  f = fopen(name,"r");
+  if (f==0)
+  { printf("Cannot open checkpoint file '%s'!\n",name);
+    exit(0);
+  }
+  ok = fgets(line,sizeof(line),f)!=NULL && strcmp(line,"solvecm checkpoint\n")==0;
+  ok = ok && fscanf(f,"%d",&nargs)==1 && nargs>0;
+  if (ok)
+  { fgets(line,sizeof(line),f);
+    args = (char **)allocate((nargs+1)*sizeof(char *));
+    for (i=0; ok && i<nargs; ++i)
+    { ok = fgets(line,sizeof(line),f)!=NULL;
+      line[strcspn(line,"\n")]='\0';
+      args[i] = (char *)allocate(strlen(line)+1);
+      strcpy(args[i],line);
+    }
+  }
+  ok = ok && fscanf(f," offset %ld",&ckoffset)==1;
+  ok = ok && fscanf(f," count %d maxdepth %d tree %d",&ckcount,&ckmaxdepth,&cklevels)==3;
+  if (ok)
+  { cktree = (int *)allocate((cklevels+1)*sizeof(int));
+    for (i=0; ok && i<cklevels; ++i) ok = fscanf(f,"%d",cktree+i)==1;
+  }
+  ok = ok && fscanf(f," %15s",word)==1;
+  if (ok && strcmp(word,"path")==0)
+  { ok = fscanf(f,"%d",&resumedepth)==1;
+    resumesol = (int *)allocate((resumedepth+1)*sizeof(int));
+    for (i=0; ok && i<resumedepth; ++i) ok = fscanf(f,"%d",resumesol+i)==1;
+  }
+  else if (ok && strcmp(word,"tasks")==0)
+  { ok = fscanf(f,"%d %d",&ckntasks,&ckndone)==2;
+    ckdone = (int *)allocate((ckndone+1)*sizeof(int));
+    for (i=0; ok && i<ckndone; ++i) ok = fscanf(f,"%d",ckdone+i)==1;
+  }
+  else ok=0;
+  fclose(f);
+
+  if (!ok)
+  { printf("Error reading checkpoint file '%s'!\n",name);
+    exit(0);
+  }
+}
+
+
+/* Count a node of the search tree */
+
+void visit(STATE *st, int depth)
+{ if (depth>st->maxdepth) STORECOUNTER(st->maxdepth,depth);
+  STORECOUNTER(st->tree[depth],st->tree[depth]+1);
+  --st->update;
+  if (st->update==0)
+  { st->update=UPDATEFREQ;
+    pthread_mutex_lock(&outlock);
+    printtree();
+    if (ckfilename && !st->split && time(NULL)-lastck>=ckinterval) checkpoint(st,depth);
+    pthread_mutex_unlock(&outlock);
+  }
+}
+
+
+/* Can column i be added without exceeding a row? */
+
+int fits(STATE *st, int i, int remaining)
+{ int k,ok;
+
+  ok=remaining>=orbit[i];
+  for (k=colptr[i]; ok && k<colptr[i+1]; ++k) ok &= (st->psum[rowind[k]]+coef[k])<=b[rowind[k]];
+  return ok;
+}
+
+
+/* Are all rows met? */
+
+int rowsmet(STATE *st)
+{ int j,ok;
+
+  ok=1;
+  if (x!=-1) for (j=0; ok && j<m-1; ++j) ok &= (st->psum[j]==b[j] || st->psum[j]==x);
+  else for (j=0; ok && j<m-1; ++j) ok &= st->psum[j]==b[j];
+  return ok;
+}
+
+
+/* Write a solution vector. Called with outlock held. */
+
+void writesolution(int *vec)
+{ int i;
+
+  if (mask & 16) pagsol_batch_put(outfile,vec,n);
+  else if (mask & 8) pagsol_put(outfile,vec,n);
+  else
+  { for (i=0; i<n; ++i) fprintf(outfile,"%d",vec[i]);
+    fprintf(outfile,"\n");
+    fflush(outfile);
+  }
+}
+
+
+/* Check the rows at a leaf and write out the solution.
+   Solutions above the split depth belong to shard 0. */
+
+void leaf(STATE *st, int depth)
+{ int i;
+
+  if (st->split && shard!=0) return;
+  if (rowsmet(st))
+  { for (i=0; i<n; ++i) st->solvec[i]=0;
+    for (i=0; i<depth; ++i) ++st->solvec[st->sol[i]];
+    STORECOUNTER(st->count,st->count+1);
+
+    /* With checkpoints in parallel mode the solutions are written when the subproblem is finished.
+       Solutions above the split depth are written at once, and on resume they are already in the file. */
+
+    if (st->split && ckdone!=NULL) return;
+    if (ckfilename && splitmode && !st->split)
+    { if (st->buflen+n+1>st->bufsize)
+      { st->bufsize = 2*st->bufsize+n+1;
+        st->buf = (char *)realloc(st->buf,st->bufsize);
+        if (st->buf==NULL)
+        { printf("Out of memory!\n");
+          exit(0);
+        }
+      }
+      for (i=0; i<n; ++i) st->buf[st->buflen++]='0'+st->solvec[i];
+      st->buf[st->buflen++]='\n';
+      return;
+    }
+    pthread_mutex_lock(&outlock);
+    writesolution(st->solvec);
+    pthread_mutex_unlock(&outlock);
+  }
+}
+
+
+void search(STATE *st, int depth, int start, int remaining)
+{ int i,k,last;
+
+  if (st->split && depth==splitdepth)
+  { addtask(st,depth,start,remaining);
+    return;
+  }
+
+  /* Nodes on the path of a resumed checkpoint are already counted,
+     the columns before the path are finished */
+
+  if (st->replay)
+  { if (depth<resumedepth) start=resumesol[depth];
+    else st->replay=0;
+  }
+  else visit(st,depth);
+  if (remaining==0) leaf(st,depth);
+  else for (i=nextcand(st,depth,start), last=lastcolumn(st,depth,remaining); i<=last && i<n; i=nextcand(st,depth,i+1))
+  { if (fits(st,i,remaining))
+	{ for (k=colptr[i]; k<colptr[i+1]; ++k) st->psum[rowind[k]]+=coef[k];
+	  choose(st,depth,i);
+	  nextlimit(st,depth,i);
+	  if (lastcolumn(st,depth+1,remaining-orbit[i])>i) search(st,depth+1,i+1,remaining-orbit[i]);
+	  for (k=colptr[i]; k<colptr[i+1]; ++k) st->psum[rowind[k]]-=coef[k];
+    }
+    st->replay=0;
+  }
+
+}
+
+
+/*****************************************/
+/* Branching on the most constrained row */
+/*****************************************/
+
+/* Build the bitsets of the rows */
+
+void setuprowbits(void)
+{ int i,k;
+
+  rowbits = (WORD *)allocate((size_t)m*nw*sizeof(WORD));
+  for (i=0; i<n; ++i)
+    for (k=colptr[i]; k<colptr[i+1]; ++k) if (coef[k]>0)
+      rowbits[(size_t)rowind[k]*nw+i/WORDBITS] |= (WORD)1 << (i%WORDBITS);
+}
+
+
+/* Pick the row with a positive deficit and the fewest available columns,
+   ties broken by the larger deficit. Returns -1 if all rows are met and
+   -2 if some row cannot be met any more. */
+
+int pickrow(STATE *st, WORD *c)
+{ int j,k,d,cnt,best,bestcnt,bestdef;
+  WORD *r;
+
+  best=-1;
+  bestcnt=bestdef=0;
+  for (j=0; j<m-1; ++j)
+  { d=deficit(j,st->psum[j]);
+    if (d<=0) continue;
+    r=rowbits+(size_t)j*nw;
+    cnt=0;
+    for (k=0; k<nw; ++k) cnt+=__builtin_popcountll(r[k] & c[k]);
+    if (cnt==0) return -2;
+    if (best==-1 || cnt<bestcnt || (cnt==bestcnt && d>bestdef))
+    { best=j;
+      bestcnt=cnt;
+      bestdef=d;
+    }
+  }
+  return best;
+}
+
+
+/* Every solution below the node contains a column of the chosen row.
+   Its columns are tried in turn, each one is removed from the available
+   columns of the later siblings. If all rows are met the search goes on
+   through all available columns until the orbit row is met. */
+
+void rowsearch(STATE *st, int depth, int remaining)
+{ int i,j,k,row,first;
+  WORD *c,*d,*r,w;
+
+  if (st->split && depth==splitdepth)
+  { addtask(st,depth,0,remaining);
+    return;
+  }
+  first=0;
+  if (st->replay)
+  { if (depth<resumedepth) first=resumesol[depth];
+    else st->replay=0;
+  }
+  else visit(st,depth);
   if (remaining==0)
-  { ok=1;
-    if (x!=-1) for (j=0; ok && j<m-1; ++j) ok &= (psum[j]==b[j] || psum[j]==x);
-    if (ok)
-	{ ++count;
-      for (i=0; i<n; ++i) solvec[i]=0;
-	  for (i=0; i<depth; ++i) ++solvec[sol[i]];
-	  for (i=0; i<n; ++i) fprintf(outfile,"%d",solvec[i]);
-	  fprintf(outfile,"\n"); 
-	  fflush(outfile);
-	}
+  { leaf(st,depth);
+    return;
+  }
+  c=st->cand+(size_t)depth*nw;
+  d=c+nw;
+  row=pickrow(st,c);
+  if (row==-2) return;
+  r = row>=0 ? rowbits+(size_t)row*nw : c;
+
+  for (k=0; k<nw; ++k)
+  while ((w=r[k] & c[k])!=0)
+  { i=k*WORDBITS+__builtin_ctzll(w);
+    c[k] &= ~((WORD)1 << (i%WORDBITS));
+    if (i<first) continue;
+    if (fits(st,i,remaining))
+    { st->sol[depth]=i;
+      if (mask & 1) for (j=0; j<nw; ++j) d[j]=c[j] & cm[(size_t)i*nw+j];
+      else for (j=0; j<nw; ++j) d[j]=c[j];
+      for (j=colptr[i]; j<colptr[i+1]; ++j)
+      { st->psum[rowind[j]]+=coef[j];
+        if (st->psum[rowind[j]]==b[rowind[j]]) clearrow(d,rowind[j]);
+      }
+      rowsearch(st,depth+1,remaining-orbit[i]);
+      for (j=colptr[i]; j<colptr[i+1]; ++j) st->psum[rowind[j]]-=coef[j];
+    }
+    st->replay=0;
+  }
+}
+
+
+/***********************************/
+/* Estimating the size of the tree */
+/***********************************/
+
+/* Follow one random path from the root (Knuth's estimator). The product of
+   the numbers of children along the path estimates the number of nodes at
+   each depth; they are added to est[], their sum is stored in *nodes.
+   The length of the path is added to *pathlen.
+   The path goes through the same nodes as search() or rowsearch().
+   Returns the estimated number of solutions. */
+
+double probe(STATE *st, double *est, double *nodes, long *pathlen)
+{ int i,j,k,nc,depth,start,remaining,last,row;
+  double weight;
+  WORD *c,*d,*r,below;
+
+  for (j=0; j<m; ++j) st->psum[j]=0;
+  if (mask & 3)
+  { for (k=0; k<nw; ++k) st->cand[k]=0;
+    for (i=0; i<n; ++i) st->cand[i/WORDBITS] |= (WORD)1 << (i%WORDBITS);
+  }
+  if (!(mask & 2)) fulllimit(st,0);
+  remaining=b[m-1];
+  start=0;
+  weight=1;
+  *nodes=0;
+
+  for (depth=0; ; ++depth)
+  { est[depth]+=weight;
+    *nodes+=weight;
+    ++*pathlen;
+    if (remaining==0) return rowsmet(st) ? weight : 0;
+
+    /* Children of the node */
+
+    nc=0;
+    c=st->cand+(size_t)depth*nw;
+    r=c;
+    if (!(mask & 2))
+    { for (i=nextcand(st,depth,start), last=lastcolumn(st,depth,remaining); i<=last && i<n; i=nextcand(st,depth,i+1))
+      if (fits(st,i,remaining))
+      { for (k=colptr[i]; k<colptr[i+1]; ++k) st->psum[rowind[k]]+=coef[k];
+        nextlimit(st,depth,i);
+        if (lastcolumn(st,depth+1,remaining-orbit[i])>i) children[nc++]=i;
+        for (k=colptr[i]; k<colptr[i+1]; ++k) st->psum[rowind[k]]-=coef[k];
+      }
+    }
+    else
+    { row=pickrow(st,c);
+      if (row==-2) return 0;
+      if (row>=0) r=rowbits+(size_t)row*nw;
+      for (i=0; i<n; ++i)
+        if (((r[i/WORDBITS] & c[i/WORDBITS]) >> (i%WORDBITS)) & 1 && fits(st,i,remaining)) children[nc++]=i;
+    }
+    if (nc==0) return 0;
+
+    /* Descend to a random child */
+
+    i=children[(int)(drand48()*nc)%nc];
+    weight*=nc;
+    for (k=colptr[i]; k<colptr[i+1]; ++k) st->psum[rowind[k]]+=coef[k];
+    if (!(mask & 2))
+    { choose(st,depth,i);
+      nextlimit(st,depth,i);
+      start=i+1;
+    }
+    else
+    { /* The earlier siblings and the chosen column are not available below */
+
+      d=c+nw;
+      for (k=0; k<nw; ++k)
+      { if (k<i/WORDBITS) below=~(WORD)0;
+        else if (k==i/WORDBITS) below=((WORD)2 << (i%WORDBITS))-1;
+        else below=0;
+        d[k]=c[k] & ~(r[k] & below);
+        if (mask & 1) d[k] &= cm[(size_t)i*nw+k];
+      }
+      for (k=colptr[i]; k<colptr[i+1]; ++k)
+        if (st->psum[rowind[k]]==b[rowind[k]]) clearrow(d,rowind[k]);
+    }
+    remaining-=orbit[i];
+  }
+}
+
+
+/* Estimate the search tree from nprobes random paths. The time is the
+   estimated number of nodes times the time per node on the probed paths.
+   The result is written to the output file as a GAP record. */
+
+void estimate(char *outfilename)
+{ int i,p,depth;
+  long pathlen;
+  double *est,nodes,sols,sum,sumsq,dev,t;
+
+  est = (double *)allocate((maxlevel+2)*sizeof(double));
+  children = (int *)allocate((n+1)*sizeof(int));
+  srand48(1);
+  sum=sumsq=sols=0;
+  pathlen=0;
+  t=seconds();
+  for (p=0; p<nprobes; ++p)
+  { sols+=probe(&mainstate,est,&nodes,&pathlen);
+    sum+=nodes;
+    sumsq+=nodes*nodes;
+  }
+  t=seconds()-t;
+  for (i=0; i<=maxlevel; ++i) est[i]/=nprobes;
+  for (depth=maxlevel; depth>0 && est[depth]==0; --depth);
+  sum/=nprobes;
+  sols/=nprobes;
+  dev = nprobes>1 ? sqrt((sumsq/nprobes-sum*sum)/(nprobes-1)) : 0;
+  if (dev!=dev) dev=0;
+  t = t*sum/pathlen;
+
+  printf("Probes: %d\n",nprobes);
+  printf("Estimated nodes: %.0f (standard error %.0f)\n",sum,dev);
+  printf("Estimated solutions: %.0f\n",sols);
+  printf("Estimated time: %.1f seconds\n",t);
+  printf("Estimated tree: ");
+  for (i=0; i<=depth; ++i) printf("%.0f ",est[i]);
+  printf("\n");
+
+  outfile = fopen(outfilename,"w");
+  if (outfile==0)
+  { printf("Cannot open output file '%s'!\n",outfilename);
+    exit(0);
+  }
+  fprintf(outfile,"return rec( Probes:=%d, Nodes:=%.0f, StdErr:=%.0f, Solutions:=%.0f, Time:=%.1f, NodesAtDepth:=[ ",
+    nprobes,sum,dev,sols,t);
+  for (i=0; i<=depth; ++i) fprintf(outfile,"%s%.0f",i>0?", ":"",est[i]);
+  fprintf(outfile," ] );\n");
+  fclose(outfile);
+  free(est);
+  free(children);
+}
+
+
+/*****************************/
+/* Reading the linear system */
+/*****************************/
+
+/* Take the system from a mapped binary file. The nonzeros are already
+   stored column-wise, only the orbit row is taken out. The compatibility
+   matrix is used in place. */
+
+void binarysystem(PAGSYS *s, char *name)
+{ int i,j,k,nnz;
+
+  m=s->m;
+  n=s->n;
+  b = (int *)allocate(m*sizeof(int));
+  orbit = (int *)allocate(n*sizeof(int));
+  rownz = (int *)allocate(m*sizeof(int));
+  colptr = (int *)allocate((n+1)*sizeof(int));
+  rowind = (int *)allocate((s->colptr[n]+1)*sizeof(int));
+  coef = (int *)allocate((s->colptr[n]+1)*sizeof(int));
+  for (j=0; j<m; ++j) b[j]=s->rhs[j];
+
+  nnz=0;
+  for (i=0; i<n; ++i)
+  { for (k=s->colptr[i]; k<s->colptr[i+1]; ++k) if (s->coef[k]!=0)
+    { j=s->rowind[k];
+      ++rownz[j];
+      if (j==m-1) orbit[i]=s->coef[k];
+      else
+      { rowind[nnz]=j;
+        coef[nnz]=s->coef[k];
+        ++nnz;
+      }
+    }
+    colptr[i+1]=nnz;
+  }
+
+  nw=(n+WORDBITS-1)/WORDBITS;
+  if (mask & 1)
+  { if (s->cm==NULL)
+    { printf("No compatibility matrix in '%s'!\n",name);
+      exit(0);
+    }
+    cm=(WORD *)s->cm;
+  }
+}
+
+
+/* Read the coefficients row by row and store the nonzeros column-wise */
+
+void readsystem(FILE *infile)
+{ int i,j,k,nnz,maxnnz;
+  int *trow,*tcol,*tval;
+
+  b = (int *)allocate(m*sizeof(int));
+  orbit = (int *)allocate(n*sizeof(int));
+  rownz = (int *)allocate(m*sizeof(int));
+  colptr = (int *)allocate((n+1)*sizeof(int));
+
+  nnz=0;
+  maxnnz=n;
+  trow = (int *)malloc(maxnnz*sizeof(int));
+  tcol = (int *)malloc(maxnnz*sizeof(int));
+  tval = (int *)malloc(maxnnz*sizeof(int));
+  for (i=0; i<m; ++i)
+  { for (j=0; j<n; ++j)
+    { fscanf(infile,"%d",&k);
+      if (k==0) continue;
+      ++rownz[i];
+      if (i==m-1)
+      { orbit[j]=k;
+        continue;
+      }
+      if (nnz==maxnnz)
+      { maxnnz*=2;
+        trow = (int *)realloc(trow,maxnnz*sizeof(int));
+        tcol = (int *)realloc(tcol,maxnnz*sizeof(int));
+        tval = (int *)realloc(tval,maxnnz*sizeof(int));
+      }
+      if (trow==NULL || tcol==NULL || tval==NULL)
+      { printf("Out of memory!\n");
+        exit(0);
+      }
+      trow[nnz]=i;
+      tcol[nnz]=j;
+      tval[nnz]=k;
+      ++nnz;
+      ++colptr[j+1];
+    }
+    fscanf(infile,"%d",&b[i]);
+  }
+
+  /* Counting sort of the nonzeros by column */
+
+  for (j=0; j<n; ++j) colptr[j+1]+=colptr[j];
+  rowind = (int *)allocate((nnz+1)*sizeof(int));
+  coef = (int *)allocate((nnz+1)*sizeof(int));
+  for (k=0; k<nnz; ++k)
+  { j=colptr[tcol[k]]++;
+    rowind[j]=trow[k];
+    coef[j]=tval[k];
   }
-  else for (i=start; i<n; ++i)
-  { ok=remaining>=A[m-1][i];
-    for (j=0; ok && j<m-1; ++j) ok &= (psum[j]+A[j][i])<=b[j];
-	if (mask & 1) for (j=0; ok && j<depth; ++j) ok &= cm[sol[j]][i]; 
+  for (j=n; j>0; --j) colptr[j]=colptr[j-1];
+  colptr[0]=0;
+
+  free(trow);
+  free(tcol);
+  free(tval);
+}
+
+
+/****************************/
+/* Work-stealing subsolvers */
+/****************************/
+
+/* Take a subproblem from the own deque, or steal one from another worker */
+
+int gettask(int w)
+{ int k,v,t;
+
+  t=-1;
+  pthread_mutex_lock(&deque[w].lock);
+  if (deque[w].head<deque[w].tail) t=deque[w].task[--deque[w].tail];
+  pthread_mutex_unlock(&deque[w].lock);
 
-	if (ok)
-	{ for (j=0; j<m-1; ++j) psum[j]+=A[j][i];
-	  sol[depth]=i; 
-	  search(depth+1,i+1,remaining-A[m-1][i]);
-	  for (j=0; j<m-1; ++j) psum[j]-=A[j][i];
+  for (k=1; t==-1 && k<nthreads; ++k)
+  { v=(w+k)%nthreads;
+    pthread_mutex_lock(&deque[v].lock);
+    if (deque[v].head<deque[v].tail) t=deque[v].task[deque[v].head++];
+    pthread_mutex_unlock(&deque[v].lock);
+  }
+  return t;
+}
+
+
+void *work(void *arg)
+{ int w,t,i,j,k;
+  STATE *st;
+
+  w=(int)(long)arg;
+  st=worker[w];
+  while ((t=gettask(w))!=-1)
+  { for (i=0; i<=maxlevel; ++i) st->mark[i]=st->tree[i];
+    st->markcount=st->count;
+    for (j=0; j<m-1; ++j) st->psum[j]=0;
+    for (i=0; i<task[t].depth; ++i)
+    { choose(st,i,task[t].sol[i]);
+      for (k=colptr[st->sol[i]]; k<colptr[st->sol[i]+1]; ++k) st->psum[rowind[k]]+=coef[k];
+    }
+    if (mask & 2)
+    { for (i=0; i<nw; ++i) st->cand[(size_t)task[t].depth*nw+i]=task[t].avail[i];
+      rowsearch(st,task[t].depth,task[t].remaining);
+      free(task[t].avail);
+    }
+    else
+    { fulllimit(st,task[t].depth);
+      search(st,task[t].depth,task[t].start,task[t].remaining);
     }
+    free(task[t].sol);
+
+    /* The subproblem is finished */
+
+    pthread_mutex_lock(&outlock);
+    if (st->buflen>0 && (mask & 8))
+    { for (k=0; k<(int)st->buflen; k+=n+1)
+      { for (i=0; i<n; ++i) st->solvec[i]=st->buf[k+i]-'0';
+        writesolution(st->solvec);
+      }
+      st->buflen=0;
+    }
+    else if (st->buflen>0)
+    { fwrite(st->buf,1,st->buflen,outfile);
+      fflush(outfile);
+      st->buflen=0;
+    }
+    for (i=0; i<=maxlevel; ++i) donetree[i]+=st->tree[i]-st->mark[i];
+    donecount+=st->count-st->markcount;
+    done[t]=1;
+    pthread_mutex_unlock(&outlock);
   }
+  return NULL;
+}
 
-} 
+
+/* Search from the root with the main state */
+
+void startsearch(void)
+{ if (mask & 2) rowsearch(&mainstate,0,b[m-1]);
+  else
+  { fulllimit(&mainstate,0);
+    search(&mainstate,0,0,b[m-1]);
+  }
+}
+
+
+void parallelsearch(void)
+{ pthread_t thread[MAXTHREADS];
+  int i,k,splitcount;
+
+  /* Split the tree into subproblems */
+
+  mainstate.split=1;
+  startsearch();
+  mainstate.split=0;
+  splitcount=mainstate.count;
+  printf("Subproblems at depth %d: %d\n",splitdepth,ntasks);
+  fflush(stdout);
+
+  /* Subproblems finished before the checkpoint */
+
+  done=(char *)allocate(ntasks+1);
+  donetree=(int *)allocate((maxlevel+2)*sizeof(int));
+  donecount=splitcount;
+  if (ckdone!=NULL)
+  { if (ckntasks!=ntasks)
+    { printf("The checkpoint has %d subproblems instead of %d!\n",ckntasks,ntasks);
+      exit(0);
+    }
+    for (i=0; i<ckndone; ++i) if (ckdone[i]>=0 && ckdone[i]<ntasks) done[ckdone[i]]=1;
+    for (i=0; i<cklevels && i<=maxlevel; ++i)
+    { donetree[i]=cktree[i];
+      mainstate.tree[i]+=cktree[i];
+    }
+    /* The count of the checkpoint includes the solutions above the split depth */
+
+    donecount=ckcount;
+    mainstate.count+=ckcount-splitcount;
+    if (ckmaxdepth>mainstate.maxdepth) mainstate.maxdepth=ckmaxdepth;
+    printf("Finished subproblems: %d\n",ckndone);
+    fflush(stdout);
+  }
+
+  /* Deal the subproblems to the workers */
+
+  for (k=0; k<nthreads; ++k)
+  { deque[k].task=(int *)allocate((ntasks/nthreads+1)*sizeof(int));
+    deque[k].head=0;
+    deque[k].tail=0;
+    pthread_mutex_init(&deque[k].lock,NULL);
+  }
+  for (i=k=0; i<ntasks; ++i) if (done[i] || i%nshards!=shard)
+  { free(task[i].sol);
+    if (mask & 2) free(task[i].avail);
+  }
+  else
+  { deque[k].task[deque[k].tail++]=i;
+    k=(k+1)%nthreads;
+  }
+
+  /* The main thread works as worker 0 */
+
+  worker[0]=&mainstate;
+  for (k=1; k<nthreads; ++k) worker[k]=newstate();
+  for (k=1; k<nthreads; ++k)
+    if (pthread_create(&thread[k],NULL,work,(void *)(long)k)!=0)
+    { printf("Cannot create thread!\n");
+      exit(0);
+    }
+  work((void *)0);
+  for (k=1; k<nthreads; ++k) pthread_join(thread[k],NULL);
+
+  /* Merge the counters */
+
+  for (k=1; k<nthreads; ++k)
+  { for (i=0; i<=n; ++i) mainstate.tree[i]+=worker[k]->tree[i];
+    if (worker[k]->maxdepth>mainstate.maxdepth) mainstate.maxdepth=worker[k]->maxdepth;
+    mainstate.count+=worker[k]->count;
+    freestate(worker[k]);
+    free(worker[k]);
+    worker[k]=NULL;
+  }
+  for (k=0; k<nthreads; ++k)
+  { free(deque[k].task);
+    pthread_mutex_destroy(&deque[k].lock);
+  }
+  free(task);
+  free(done);
+  free(donetree);
+  task=NULL;
+  ntasks=maxtasks=0;
+  donecount=0;
+}
+
+
+/**********************/
+/* Analyse the system */
+/**********************/
+
+/* Check the system and prepare the search. Returns 0 if an equation
+   does not allow solutions. */
+
+int setupsystem(void)
+{ int i,k,ok;
+
+  printf("Linear system: %d x %d\n",m,n);
+  if (mask & 1) printf("Compatibility matrix: yes\n");
+  else printf("Compatibility matrix: no\n");
+  if (mask & 2) printf("Branching: most constrained row\n");
+
+  /* Search for inconsistent equations */
+
+  ok=1;
+  for (i=0; ok && i<m; ++i) if (b[i] && x!=0)
+    ok = rownz[i]>0;
+
+  if (!ok)
+  { printf("Equation #%d does not allow solutions\n",i);
+    return 0;
+  }
+
+  if (rownz[m-1]<n || b[m-1]==0)
+  { printf("Last row must contain orbit sizes.\n");
+    exit(0);
+  }
+  k=orbit[0];
+  for (i=1; i<n; ++i) if (orbit[i]<k) k=orbit[i];
+  if (k<1) k=1;
+  maxlevel=b[m-1]/k;
+  if (maxlevel>n) maxlevel=n;
+
+  setupreach();
+  if (mask & 2) setuprowbits();
+  setupstate(&mainstate);
+  return 1;
+}
+
+
+/* Free the arrays of the current system */
+
+void freesystem(void)
+{ free(b);
+  free(orbit);
+  free(rownz);
+  free(colptr);
+  free(rowind);
+  free(coef);
+  free(reach);
+  free(reachptr);
+  free(rowbits);
+  b=orbit=rownz=colptr=rowind=coef=reach=reachptr=NULL;
+  rowbits=NULL;
+  freestate(&mainstate);
+}
+
+
+/********************/
+/* Batch of systems */
+/********************/
+
+/* Solve all systems of a batch file one after another. The solutions
+   are written to one file in the batch format of pagsol.h and tagged
+   with the number of their system. */
+
+void solvebatch(PAGSYS *s, char *infilename, char *outfilename)
+{ int id,k;
+  long total;
+
+  outfile = fopen(outfilename,"w");
+  if (outfile==0)
+  { printf("Cannot open output file '%s'!\n",outfilename);
+    exit(0);
+  }
+  pagsol_batch_start(outfile);
+  total=0;
+  for (id=0, k=1; k==1; ++id, k=pagsys_next(s))
+  { printf("System %d\n",id);
+    binarysystem(s,infilename);
+    pagsol_batch_system(outfile,id,n);
+    if (setupsystem())
+    { lastck=time(NULL);
+      starttime=seconds();
+      if (splitmode) parallelsearch();
+      else startsearch();
+      printtree();
+      total+=mainstate.count;
+    }
+    freesystem();
+  }
+  if (k<0)
+  { printf("Damaged system %d in '%s'!\n",id,infilename);
+    exit(0);
+  }
+  fclose(outfile);
+  printf("Systems: %d\n",id);
+  printf("Total number of solutions: %ld\n",total);
+}
 
 
 /****************/
@@ -92,22 +1261,55 @@ void search(int depth, int start, int remaining)
 /****************/
 
 int main(int argc,char *argv[])
-{ int i,j,k,ok;  
-  char *infilename=0, *outfilename;
-  FILE *infile;   
+{ int i,j,k;
+  char *infilename=0, *outfilename, *resumefilename=0, *shardarg;
+  FILE *infile;
+  PAGSYS sys;
   time_t t;
 
   outfilename="solutions";
 
+  /* Resume a checkpoint: its saved command line replaces ours */
+
+  for (i=1; i<argc; ++i) if (strcmp(argv[i],"-resume")==0)
+  { if (i+1==argc)
+    { printf("No checkpoint file!\n");
+      exit(0);
+    }
+    resumefilename=argv[i+1];
+    readcheckpoint(resumefilename);
+    argc=nargs;
+    argv=args;
+    break;
+  }
+  nargs=argc;
+  args=argv;
+
   /* Command line arguments */
 
-  for(i=1; i<argc; ++i) if (argv[i][0] != '-') infilename = argv[i];
+  for(i=1; i<argc; ++i) if (strncmp(argv[i],"-shard",6)==0)
+  { shardarg = argv[i]+6;
+    if (*shardarg=='\0' && i+1<argc) shardarg=argv[++i];
+    if (sscanf(shardarg,"%d/%d",&shard,&nshards)!=2 || nshards<1 || shard<0 || shard>=nshards)
+    { printf("Wrong shard '%s', use -shardI/N with 0<=I<N.\n",shardarg);
+      exit(0);
+    }
+  }
+  else if (argv[i][0] != '-') infilename = argv[i];
   else
   { j = 0;
     while (argv[i][j] != '\0')
     { if (argv[i][j] == 'c') mask |= 1;
       if (argv[i][j] == 'C') mask &= ~1;
+      if (argv[i][j] == 'r') mask |= 2;
       if (argv[i][j] == 'x') sscanf(argv[i]+j+1,"%d",&x);
+      if (argv[i][j] == 'j') sscanf(argv[i]+j+1,"%d",&nthreads);
+      if (argv[i][j] == 'd') sscanf(argv[i]+j+1,"%d",&splitdepth);
+      if (argv[i][j] == 't') sscanf(argv[i]+j+1,"%d",&ckinterval);
+      if (argv[i][j] == 'e') sscanf(argv[i]+j+1,"%d",&nprobes);
+      if (argv[i][j] == 'p') mask |= 4;
+      if (argv[i][j] == 'b') mask |= 8;
+      if (argv[i][j] == 'm') mask |= 16;
       /* Help */
       if ((argv[i][j] == 'h') || (argv[i][j] == 'H') || (argv[i][j] == '?'))
       { printf("Usage: solvecm [options] input_file_name\n");
@@ -115,128 +1317,166 @@ int main(int argc,char *argv[])
         printf("-oFILENAME  Output file name (default: %s).\n",outfilename);
 	printf("-c          Read compatibility matrix (default no).\n");
 	printf("-xN         Alternative RHS=N - for quasi-symmetric designs (default no).\n");
+	printf("-r          Branch on the most constrained row (default no).\n");
+	printf("-jN         Search in parallel with N threads (default N=%d).\n",nthreads);
+	printf("-dN         Split the search tree into subproblems at depth N (default N=%d).\n",splitdepth);
+	printf("-shardI/N   Search only the subproblems with index I mod N.\n");
+	printf("-kFILENAME  Write checkpoints to this file (default no).\n");
+	printf("-tN         Seconds between checkpoints (default N=%d).\n",ckinterval);
+	printf("-resume FILENAME  Continue the search from a checkpoint.\n");
+	printf("-eN         Only estimate the search tree from N random probes.\n");
+	printf("-p          Print progress lines with rates and branching factors.\n");
+	printf("-b          Write the solutions in binary format (default no).\n");
+	printf("-m          The input is a batch of binary systems (default no).\n");
         printf("\n");
 	exit(0);
       }
-      if (argv[i][j] == 'o') 
+      if (argv[i][j] == 'o')
       { outfilename=argv[i]+j+1;
 	while (argv[i][j] != '\0') ++j;
 	--j;
       }
+      else if (argv[i][j] == 'k')
+      { ckfilename=argv[i]+j+1;
+	while (argv[i][j] != '\0') ++j;
+	--j;
+      }
       ++j;
     }
-  }  
+  }
 
   if (infilename==0)
   { printf("No input file!\n");
     exit(0);
   }
+  if (nthreads<1 || nthreads>MAXTHREADS)
+  { printf("Number of threads must be between 1 and %d.\n",MAXTHREADS);
+    exit(0);
+  }
+  if (splitdepth<1) splitdepth=1;
+  splitmode = nthreads>1 || nshards>1;
 
   /**********************/
   /* Read linear system */
   /**********************/
-  
-  infile = fopen(infilename,"r");
-  
-  if (infile==0)
-  { printf("Cannot open file '%s'!\n",infilename);
-    exit(0);
-  }
 
-  /* Read dimensions */
-  
-  fscanf(infile,"%d",&m);
-  fscanf(infile,"%d",&n);
-  fscanf(infile,"%d",&i);
-  if (m > MAXM)
-  { printf("Increase MAXM!\n");
-    exit(0);
-  }
-  if (n > MAXN)
-  { printf("Increase MAXN!\n");
-    exit(0);
-  }
-  if (i!=1)
-  { printf("Works only for single RHS.\n");
+  /* A binary system is mapped, the compatibility matrix is used in place */
+
+  k=pagsys_map(infilename,&sys);
+  if (k<0)
+  { printf("Damaged binary input file '%s'!\n",infilename);
     exit(0);
   }
 
-  /* Read coefficients */
+  /* A batch is solved system by system, without checkpoints */
 
-  for (i=0; i<m; ++i)
-  { for (j=0; j<n; ++j) fscanf(infile,"%d",&A[i][j]);
-    fscanf(infile,"%d",&b[i]);
+  if (mask & 16)
+  { if (k==0 || ckfilename || resumefilename || nprobes>0)
+    { printf("A batch must be a binary file and cannot be used with -k, -resume or -e.\n");
+      exit(0);
+    }
+    solvebatch(&sys,infilename,outfilename);
+    pagsys_unmap(&sys);
+    return 0;
   }
+  if (k==1) binarysystem(&sys,infilename);
+  else
+  { infile = fopen(infilename,"r");
 
-  /* writemat(A[0],m,n);
-  writemat(b,1,m); */
+    if (infile==0)
+    { printf("Cannot open file '%s'!\n",infilename);
+      exit(0);
+    }
 
-  /* Read compatibility matrix */
+    /* Read dimensions */
 
-  if (mask & 1)
-  { for (i=0; i<n; ++i) for (j=0; j<n; ++j) fscanf(infile,"%d",&cm[i][j]);
-    /* printf("CM:\n");
-    for (i=0; i<n; ++i)
-    { for (j=0; j<n; ++j) printf("%d",cm[i][j]);
-      printf("\n");
-    } */
-  }
+    fscanf(infile,"%d",&m);
+    fscanf(infile,"%d",&n);
+    fscanf(infile,"%d",&i);
+    if (m<1 || n<1)
+    { printf("Wrong dimensions %d x %d!\n",m,n);
+      exit(0);
+    }
+    if (i!=1)
+    { printf("Works only for single RHS.\n");
+      exit(0);
+    }
 
-  fclose(infile);
+    /* Read coefficients */
 
-  printf("Linear system: %d x %d\n",m,n);
-  if (mask & 1) printf("Compatibility matrix: yes\n");
-  else printf("Compatibility matrix: no\n");
+    readsystem(infile);
 
-  /*************************************/
-  /* Search for inconsistent equations */
-  /*************************************/
+    /* Read compatibility matrix */
 
-  ok=1;
-  for (i=0; ok && i<m; ++i) if (b[i] && x!=0)
-  { k=1;
-    for (j=0; k && j<n; ++j) if (A[i][j]) k=0;
-	ok = !k;
+    nw=(n+WORDBITS-1)/WORDBITS;
+    if (mask & 1)
+    { cm = (WORD *)allocate((size_t)n*nw*sizeof(WORD));
+      for (i=0; i<n; ++i) for (j=0; j<n; ++j)
+      { fscanf(infile,"%d",&k);
+        if (k) cm[(size_t)i*nw+j/WORDBITS] |= (WORD)1 << (j%WORDBITS);
+      }
+    }
+
+    fclose(infile);
   }
 
-  if (!ok)
-  { printf("Equation #%d does not allow solutions\n",i);
-    printf("Total number of solutions: 0\n");
+  if (!setupsystem())
+  { printf("Total number of solutions: 0\n");
     outfile = fopen(outfilename,"w");
 	fclose(outfile);
     exit(0);
   }
 
-  /**********************/
-  /* Analyse the system */
-  /**********************/
-
-  i=0;
-  while (A[m-1][i]!=0 && i<n) ++i;
-  if (i<n || b[m-1]==0)
-  { printf("Last row must contain orbit sizes.\n");
-    exit(0);
-  }
-
   /**************************/
   /* Start backtrack search */
   /**************************/
 
-  for (i=0; i<m; ++i) psum[i]=0;
+  if (nprobes>0)
+  { estimate(outfilename);
+    return 0;
+  }
   t=time(&t);
   printf("Starting search: %s",ctime(&t));
-  update=UPDATEFREQ;
-  maxdepth=0;
-  outfile = fopen(outfilename,"w");
+  if (nthreads>1) printf("Threads: %d\n",nthreads);
+  if (nshards>1) printf("Shard: %d/%d\n",shard,nshards);
+  lastck=time(NULL);
+  starttime=seconds();
 
-  search(0,0,b[m-1]); 
+  if (resumefilename)
+  { printf("Resuming from checkpoint '%s'\n",resumefilename);
+    if (ckdone==NULL && splitmode)
+    { printf("The checkpoint was written by a serial search!\n");
+      exit(0);
+    }
+    if (ckdone==NULL)
+    { for (i=0; i<cklevels && i<=maxlevel; ++i) mainstate.tree[i]=cktree[i];
+      mainstate.count=ckcount;
+      mainstate.maxdepth=ckmaxdepth;
+      mainstate.replay=1;
+    }
+
+    /* Drop the solutions written after the checkpoint */
+
+    if (truncate(outfilename,ckoffset)!=0)
+    { printf("Cannot truncate output file '%s'!\n",outfilename);
+      exit(0);
+    }
+    outfile = fopen(outfilename,"a");
+  }
+  else outfile = fopen(outfilename,"w");
+  if (outfile==0)
+  { printf("Cannot open output file '%s'!\n",outfilename);
+    exit(0);
+  }
+  if (mask & 8) pagsol_start(outfile,n,resumefilename==0);
+
+  if (splitmode) parallelsearch();
+  else startsearch();
 
   fclose(outfile);
-  printf("tree: ");
-  for (i=0; i<maxdepth; ++i) printf("%d ",tree[i]);
-  printf("(%d solutions)\n",count);
+  printtree();
   t=time(&t);
   printf("Finished search: %s",ctime(&t));
-  printf("Total number of solutions: %d\n",count);
+  printf("Total number of solutions: %d\n",mainstate.count);
 
 }
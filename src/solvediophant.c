@@ -12,6 +12,11 @@
 #include <unistd.h> 
 
 #include "diophant.h"
+#include "pagsol.h"
+#include "pagsys.h"
+#if !defined(MPREC)
+#include "presolve.h"
+#endif
 
 /*:6*/
 #line 105 "solvediophant.w"
@@ -91,6 +96,191 @@ print_delta_time_tps(l,os_ticks_per_second(),str);
 #line 153 "solvediophant.w"
 ;
 
+/* The solutions of a batch are written by the callback of diophant_solve()
+   to one file in the batch format of pagsol.h */
+typedef struct batch_output{
+FILE*f;
+int*vec;
+int n;                          /* Length of the vectors of the system */
+}BATCH_OUTPUT;
+
+int batch_solution(const long*x,int n,void*data){
+BATCH_OUTPUT*out= (BATCH_OUTPUT*)data;
+int i;
+
+for(i= 0;i<out->n;i++)out->vec[i]= (i<n)?(int)x[i]:0;
+pagsol_batch_put(out->f,out->vec,out->n);
+return DIOPHANT_CONTINUE;
+}
+
+#if !defined(MPREC)
+/* Independent blocks of the presolved system are solved one after
+   another. Their solutions are kept and combined in every possible
+   way, so the number of solutions is the product of the numbers of
+   the blocks. */
+typedef struct block_solutions{
+int n;                          /* Columns of the block, */
+int*cols;                       /*   their indices in the system */
+long count,size;                /* Solutions kept and allocated */
+long*x;                         /* count solutions of n entries */
+}BLOCK_SOLUTIONS;
+
+int block_solution(const long*x,int n,void*data){
+BLOCK_SOLUTIONS*bs= (BLOCK_SOLUTIONS*)data;
+int i;
+
+if(bs->count==bs->size){
+bs->size= 2*bs->size+16;
+bs->x= (long*)realloc(bs->x,bs->size*bs->n*sizeof(long));
+if(bs->x==NULL){
+fprintf(stderr,"Out of memory\n");
+exit(1);
+}
+}
+for(i= 0;i<bs->n;i++)bs->x[bs->count*bs->n+i]= (i<n)?x[i]:0;
+bs->count++;
+return DIOPHANT_CONTINUE;
+}
+
+/* Solutions found during the reduction are reported again by the
+   enumeration, so the solutions of a block are sorted and the
+   duplicates removed */
+static int block_width;
+
+int block_compare(const void*a,const void*b){
+const long*x= (const long*)a,*y= (const long*)b;
+int i;
+
+for(i= 0;i<block_width;i++)if(x[i]!=y[i])return(x[i]<y[i])?-1:1;
+return 0;
+}
+
+void block_unique(BLOCK_SOLUTIONS*bs){
+long k,l;
+
+if(bs->count<2)return;
+block_width= bs->n;
+qsort(bs->x,bs->count,bs->n*sizeof(long),block_compare);
+for(k= l= 1;k<bs->count;k++)
+if(block_compare(bs->x+(k-1)*bs->n,bs->x+k*bs->n)!=0){
+if(l<k)memcpy(bs->x+l*bs->n,bs->x+k*bs->n,bs->n*sizeof(long));
+l++;
+}
+bs->count= l;
+}
+
+/* Solve the system block by block and write the combined solutions
+   like diophant_solve() does. original_columns and opt->fixed_values
+   map the columns of the system to the original ones. Returns the
+   number of solutions or the error of a block. */
+long solve_blocks(long**A,long*rhs,long*upperb,int no_rows,int no_columns,
+int nblocks,int*rowblock,int*colblock,int*original_columns,int no_original_columns,
+const DIOPHANT_OPTIONS*opt,BATCH_OUTPUT*batch_out){
+BLOCK_SOLUTIONS*bs;
+DIOPHANT_OPTIONS o;
+long**a,*b,*u,*x,*pos,total,res,k;
+int*orig,*vec;
+int i,j,l,r,zeroone;
+
+printf("Solving %d independent blocks separately\n",nblocks);
+fflush(stdout);
+bs= (BLOCK_SOLUTIONS*)calloc(nblocks,sizeof(BLOCK_SOLUTIONS));
+total= 1;
+for(l= 0;l<nblocks&&total> 0;l++){
+bs[l].cols= (int*)calloc(no_columns,sizeof(int));
+for(i= 0;i<no_columns;i++)if(colblock[i]==l)bs[l].cols[bs[l].n++]= i;
+for(j= r= 0;j<no_rows;j++)if(rowblock[j]==l)r++;
+a= (long**)calloc(r,sizeof(long*));
+b= (long*)calloc(r,sizeof(long));
+u= (upperb!=NULL)?(long*)calloc(bs[l].n,sizeof(long)):NULL;
+for(j= r= 0;j<no_rows;j++)if(rowblock[j]==l){
+a[r]= (long*)calloc(bs[l].n,sizeof(long));
+for(i= 0;i<bs[l].n;i++)a[r][i]= A[j][bs[l].cols[i]];
+b[r++]= rhs[j];
+}
+if(u!=NULL)for(i= 0;i<bs[l].n;i++)u[i]= upperb[bs[l].cols[i]];
+
+printf("Block %d: %d rows, %d columns\n",l+1,r,bs[l].n);
+fflush(stdout);
+o= *opt;
+o.nboundedvars= bs[l].n;
+o.original_columns= NULL;
+o.no_original_columns= bs[l].n;
+o.fixed_values= NULL;
+o.solfile= NULL;
+o.solution= opt->silent?NULL:block_solution;
+o.data= bs+l;
+res= diophant_solve(a,b,u,bs[l].n,r,&o);
+for(j= 0;j<r;j++)free(a[j]);
+free(a);
+free(b);
+free(u);
+if(res<0){
+total= res;
+break;
+}
+if(!opt->silent)block_unique(bs+l);
+k= opt->silent?res:bs[l].count;
+if(__builtin_mul_overflow(total,k,&total)){
+fprintf(stderr,"The number of solutions is too large\n");
+total= DIOPHANT_ERROR;
+break;
+}
+}
+if(total> 0&&opt->stop_after_solutions> 0&&total> opt->stop_after_solutions)
+total= opt->stop_after_solutions;
+
+/* Write the combinations */
+
+if(total> 0&&!opt->silent){
+orig= (int*)calloc(no_columns,sizeof(int));
+for(i= k= 0;i<no_original_columns;i++)if(original_columns[i]!=0)orig[k++]= i;
+x= (long*)calloc(no_original_columns,sizeof(long));
+for(i= 0;i<no_original_columns;i++)
+if(original_columns[i]==0&&opt->fixed_values!=NULL)x[i]= opt->fixed_values[i];
+vec= (int*)calloc(no_original_columns,sizeof(int));
+pos= (long*)calloc(nblocks,sizeof(long));
+zeroone= 1;
+if(upperb!=NULL)for(i= 0;i<no_columns;i++)if(upperb[i]> 1)zeroone= 0;
+if(opt->solfile!=NULL&&opt->binary)pagsol_header(opt->solfile,no_original_columns);
+for(k= 0;k<total;k++){
+for(l= 0;l<nblocks;l++)
+for(i= 0;i<bs[l].n;i++)x[orig[bs[l].cols[i]]]= bs[l].x[pos[l]*bs[l].n+i];
+if(batch_out!=NULL)batch_solution(x,no_original_columns,batch_out);
+else if(opt->solfile!=NULL&&opt->binary){
+for(i= 0;i<no_original_columns;i++)vec[i]= (int)x[i];
+pagsol_put(opt->solfile,vec,no_original_columns);
+}else if(opt->solfile!=NULL){
+for(i= 0;i<no_original_columns;i++){
+fprintf(opt->solfile,"%ld",x[i]);
+if(!zeroone)fprintf(opt->solfile," ");
+}
+fprintf(opt->solfile,"\n");
+}
+for(l= nblocks-1;l>=0&&++pos[l]==bs[l].count;l--)pos[l]= 0;
+}
+free(orig);
+free(x);
+free(vec);
+free(pos);
+}
+if(opt->solfile!=NULL){
+if(opt->silent)fprintf(opt->solfile,"SILENT\n%ld solutions\n",total> 0?total:0);
+fflush(opt->solfile);
+}
+if(total>=0){
+printf("Total number of solutions: %ld\n",total);
+fflush(stdout);
+}
+for(l= 0;l<nblocks;l++){
+free(bs[l].cols);
+free(bs[l].x);
+}
+free(bs);
+return total;
+}
+#endif
+
 /*:7*/
 #line 106 "solvediophant.w"
 ;
@@ -125,7 +315,7 @@ long stop_after_solutions;
 long stop_after_loops;
 int cut_after;
 int free_RHS;
-FILE*txt;
+FILE*txt= NULL;
 char*inputfile_name,*rowp;
 
 char zeile[zlength];
@@ -144,6 +334,22 @@ char solfilename[1024];
 #line 277 "solvediophant.w"
 
 char suffix[1024];
+PAGSYS sys;
+int binary_input;
+int use_presolve= 1;
+long*column_values;
+DIOPHANT_OPTIONS opt;
+char*profile_name= NULL;
+long nosolutions= 0;
+int batch= 0;
+int system_no= 0;
+int allocated_rows;
+long total_solutions= 0;
+BATCH_OUTPUT batch_out;
+#if !defined(MPREC)
+int nblocks= 0;
+int*rowblock= NULL,*colblock= NULL;
+#endif
 
 /*:14*//*24:*/
 #line 568 "solvediophant.w"
@@ -159,6 +365,7 @@ int k,l;
 #line 263 "solvediophant.w"
 
 strcpy(solfilename,"solutions");
+diophant_options_init(&opt);
 iterate= -1;
 bkz_beta_input= bkz_p_input= -1;
 factor_input= norm_input= 0;
@@ -170,6 +377,39 @@ for(i= 1;i<argc;i++){
 if(strcmp(argv[i],"-silent")==0){
 silent= 1;
 fprintf(stderr,"No output of solutions, just counting.\n");
+}else if(strcmp(argv[i],"-binary")==0){
+opt.binary= 1;
+}else if(strcmp(argv[i],"-batch")==0){
+batch= 1;
+}else if(strcmp(argv[i],"-nopresolve")==0){
+use_presolve= 0;
+}else if(strncmp(argv[i],"-shard",6)==0){
+if(argv[i][6]=='\0'&&i+1<argc-1)strcpy(suffix,argv[++i]);
+else strcpy(suffix,argv[i]+6);
+if(sscanf(suffix,"%d/%d",&opt.shard_no,&opt.shard_total)!=2||
+opt.shard_total<1||opt.shard_no<0||opt.shard_no>=opt.shard_total){
+fprintf(stderr,"Wrong shard '%s', use -shardI/N with 0<=I<N.\n",suffix);
+exit(1);
+}
+}else if(strncmp(argv[i],"-split",6)==0){
+strcpy(suffix,argv[i]+6);
+opt.shard_split= atoi(suffix);
+}else if(strncmp(argv[i],"-savelattice",12)==0){
+if(argv[i][12]=='\0'&&i+1<argc-1)opt.save_lattice= argv[++i];
+else opt.save_lattice= argv[i]+12;
+}else if(strncmp(argv[i],"-loadlattice",12)==0){
+if(argv[i][12]=='\0'&&i+1<argc-1)opt.load_lattice= argv[++i];
+else opt.load_lattice= argv[i]+12;
+}else if(strncmp(argv[i],"-kernel",7)==0){
+opt.kernel= argv[i]+7;
+}else if(strncmp(argv[i],"-extreme",8)==0){
+strcpy(suffix,argv[i]+8);
+opt.prune_trials= atoi(suffix);
+if(opt.prune_trials<1)opt.prune_trials= 1;
+}else if(strncmp(argv[i],"-threads",8)==0){
+strcpy(suffix,argv[i]+8);
+opt.threads= atoi(suffix);
+if(opt.threads<1)opt.threads= 1;
 }else if(strncmp(argv[i],"-iterate",8)==0){
 strcpy(suffix,argv[i]+8);
 iterate_no= atoi(suffix);
@@ -179,6 +419,9 @@ iterate= 0;
 }else if(strncmp(argv[i],"-beta",5)==0){
 strcpy(suffix,argv[i]+5);
 bkz_beta_input= atoi(suffix);
+}else if(strncmp(argv[i],"-profile",8)==0){
+if(argv[i][8]=='\0'&&i+1<argc-1)profile_name= argv[++i];
+else profile_name= argv[i]+8;
 }else if(strncmp(argv[i],"-p",2)==0){
 strcpy(suffix,argv[i]+2);
 bkz_p_input= atoi(suffix);
@@ -206,6 +449,8 @@ strcpy(solfilename,argv[i]+2);
 }else if(strcmp(argv[i],"-?")==0||strcmp(argv[i],"-h")==0){
 fprintf(stderr,"\nsolvediophant");
 fprintf(stderr," -iterate*|(-bkz -beta* -p*) [-c*] [-maxnorm*] [-time*] [-silent] [-o*]");
+fprintf(stderr," [-shard*/*] [-split*] [-threads*] [-extreme*] [-kernel*] [-binary]");
+fprintf(stderr," [-savelattice file] [-loadlattice file] [-profile file] [-nopresolve] [-batch]");
 fprintf(stderr," inputfile\n\n");
 exit(1);
 }
@@ -251,6 +496,10 @@ zstrtoz("1",&norm_input);
 norm_input= 1;
 #endif
 }
+if(batch&&(silent||profile_name!=NULL||opt.save_lattice!=NULL||opt.load_lattice!=NULL)){
+fprintf(stderr,"-batch cannot be used with -silent, -profile, -savelattice or -loadlattice.\n");
+exit(1);
+}
 /*:16*/
 #line 272 "solvediophant.w"
 ;
@@ -271,17 +520,49 @@ if(maxruntime> 0)alarm(maxruntime);
 /*18:*/
 #line 364 "solvediophant.w"
 
+flag= 0;
+free_RHS= 0;
+stop_after_loops= 0;
+stop_after_solutions= 0;
+cut_after= -1;
+
+/* A binary system of pagsys.h is mapped instead of read */
+binary_input= pagsys_map(inputfile_name,&sys);
+if(binary_input<0){
+printf("Damaged binary input file '%s'!\n",inputfile_name);
+fflush(stdout);
+exit(1);
+}
+
+/* A batch is a binary file with several systems, they are solved one
+   after another and their solutions go to one file */
+if(batch){
+if(!binary_input){
+printf("The batch file '%s' has to be a binary file!\n",inputfile_name);
+fflush(stdout);
+exit(1);
+}
+batch_out.f= fopen(solfilename,"w");
+if(batch_out.f==NULL){
+fprintf(stderr,"Could not open solution file %s\n",solfilename);
+exit(1);
+}
+pagsol_batch_start(batch_out.f);
+time_0= os_ticks();
+}
+next_system:
+if(batch)printf("System %d\n",system_no);
+if(binary_input){
+no_rows= sys.m;
+no_columns= sys.n;
+flag= 1;
+}else{
 txt= fopen(inputfile_name,"r");
 if(txt==NULL){
 printf("Could not open file '%s'!\n",inputfile_name);
 fflush(stdout);
 exit(1);
 }
-flag= 0;
-free_RHS= 0;
-stop_after_loops= 0;
-stop_after_solutions= 0;
-cut_after= -1;
 do{
 fgets(zeile,zlength,txt);
 if(strstr(zeile,"% stopafter")!=NULL){
@@ -299,6 +580,7 @@ free_RHS= 1;
 }
 while(zeile[0]=='%');
 sscanf(zeile,"%d%d%d",&no_rows,&no_columns,&flag);
+}
 
 /*:18*/
 #line 114 "solvediophant.w"
@@ -325,6 +607,7 @@ for(i= 0;i<no_columns;i++)A[j][i]= 0;
 rhs= (long*)calloc(no_rows,sizeof(long));
 for(i= 0;i<no_rows;i++)rhs[i]= 0;
 #endif  
+allocated_rows= no_rows;
 
 /*:19*/
 #line 115 "solvediophant.w"
@@ -332,6 +615,43 @@ for(i= 0;i<no_rows;i++)rhs[i]= 0;
 /*20:*/
 #line 415 "solvediophant.w"
 
+if(binary_input){
+for(i= 0;i<no_columns;i++)
+for(k= sys.colptr[i];k<sys.colptr[i+1];k++){
+#if defined(MPREC)
+zintoz(sys.coef[k],&(A[sys.rowind[k]][i]));
+#else
+A[sys.rowind[k]][i]= sys.coef[k];
+#endif
+}
+for(j= 0;j<no_rows;j++){
+#if defined(MPREC)
+zintoz(sys.rhs[j],&(rhs[j]));
+#else
+rhs[j]= sys.rhs[j];
+#endif
+}
+upperb= NULL;
+nboundedvars= no_columns;
+if(sys.bound!=NULL){
+#if defined(MPREC)
+upperb= (verylong*)calloc(no_columns,sizeof(verylong));
+for(i= 0;i<no_columns;i++){
+upperb[i]= 0;
+zintoz(sys.bound[i],&(upperb[i]));
+}
+#else
+upperb= (long*)calloc(no_columns,sizeof(long));
+for(i= 0;i<no_columns;i++)upperb[i]= sys.bound[i];
+#endif
+}
+no_original_columns= no_columns;
+original_columns= (int*)calloc(no_original_columns,sizeof(int));
+for(i= 0;i<no_original_columns;i++)original_columns[i]= 1;
+if(!batch)pagsys_unmap(&sys);
+goto input_done;
+}
+
 #if defined(MPREC)
 for(j= 0;j<no_rows;j++){
 for(i= 0;i<no_columns;i++){
@@ -502,6 +822,7 @@ fclose(txt);
 /*:22*/
 #line 118 "solvediophant.w"
 ;
+input_done:
 /*23:*/
 #line 523 "solvediophant.w"
 
@@ -553,14 +874,160 @@ fprintf(stderr,"cols=%d\n",nboundedvars);
 #line 119 "solvediophant.w"
 ;
 
+/* Presolve, the removed columns are completed by diophant() */
+#if !defined(MPREC)
+if(use_presolve&&!free_RHS){
+column_values= (long*)calloc(no_columns,sizeof(long));
+res= presolve(A,rhs,upperb,&no_rows,&no_columns,&nboundedvars,column_values);
+if(res<0){
+printf("Presolve: the system has no solutions\n");
+if(batch){
+pagsol_batch_system(batch_out.f,system_no,no_original_columns);
+printf("Total number of solutions: 0\n");
+free(column_values);
+goto system_done;
+}
 solfile= fopen(solfilename,"w");
-time_0= os_ticks();
-diophant(A,rhs,upperb,no_columns,no_rows,
-factor_input,norm_input,silent,iterate,iterate_no,bkz_beta_input,bkz_p_input,
-stop_after_solutions,stop_after_loops,
-free_RHS,original_columns,no_original_columns,cut_after,nboundedvars,solfile);
-time_1= os_ticks();
+if(solfile!=NULL){
+if(silent)fprintf(solfile,"SILENT\n0 solutions\n");
 fclose(solfile);
+}
+printf("Total number of solutions: 0\n");
+fflush(stdout);
+return 0;
+}
+if(res> 0){
+opt.fixed_values= (long*)calloc(no_original_columns,sizeof(long));
+for(i= k= 0;i<no_original_columns;i++)if(original_columns[i]==1){
+if(column_values[k]>=0){
+original_columns[i]= 0;
+opt.fixed_values[i]= column_values[k];
+}
+k++;
+}
+}
+free(column_values);
+
+/* Independent blocks are solved separately if nothing else needs
+   the whole system */
+if(nboundedvars==no_columns&&no_columns> 0&&cut_after==-1
+&&profile_name==NULL&&opt.save_lattice==NULL&&opt.load_lattice==NULL
+&&opt.shard_total<=1){
+rowblock= (int*)calloc(no_rows,sizeof(int));
+colblock= (int*)calloc(no_columns,sizeof(int));
+nblocks= presolve_split(A,no_rows,no_columns,rowblock,colblock);
+/* Every block needs an equation, and every equation a block */
+for(j= 0;j<no_rows&&nblocks> 1;j++)if(rowblock[j]<0)nblocks= 0;
+for(l= 0;l<nblocks;l++){
+for(j= 0;j<no_rows&&rowblock[j]!=l;j++);
+if(j==no_rows)nblocks= 0;
+}
+}
+}
+#endif
+
+if(batch){
+solfile= NULL;
+batch_out.n= no_original_columns;
+batch_out.vec= (int*)calloc(no_original_columns,sizeof(int));
+pagsol_batch_system(batch_out.f,system_no,no_original_columns);
+opt.solution= batch_solution;
+opt.data= &batch_out;
+}else{
+solfile= fopen(solfilename,"w");
+if(solfile==NULL){
+fprintf(stderr,"Could not open solution file %s\n",solfilename);
+exit(1);
+}
+}
+#if defined(MPREC)
+zcopy(factor_input,&opt.factor);
+zcopy(norm_input,&opt.maxnorm);
+#else
+opt.factor= factor_input;
+opt.maxnorm= norm_input;
+#endif
+opt.iterate= iterate;
+opt.iterate_no= iterate_no;
+opt.bkz_beta= bkz_beta_input;
+opt.bkz_p= bkz_p_input;
+opt.silent= silent;
+opt.stop_after_solutions= stop_after_solutions;
+opt.stop_after_loops= stop_after_loops;
+opt.free_RHS= free_RHS;
+opt.cut_after= cut_after;
+opt.nboundedvars= nboundedvars;
+opt.original_columns= original_columns;
+opt.no_original_columns= no_original_columns;
+opt.solfile= solfile;
+opt.log= stdout;
+if(profile_name!=NULL){
+opt.profile= fopen(profile_name,"w");
+if(opt.profile==NULL){
+fprintf(stderr,"Could not open profile file %s\n",profile_name);
+exit(1);
+}
+}
+if(opt.binary&&!silent&&solfile!=NULL)setvbuf(solfile,NULL,_IOFBF,1<<20);
+if(!batch)time_0= os_ticks();
+#if !defined(MPREC)
+if(nblocks> 1)
+nosolutions= solve_blocks(A,rhs,upperb,no_rows,no_columns,nblocks,rowblock,colblock,
+original_columns,no_original_columns,&opt,batch?&batch_out:NULL);
+else
+#endif
+nosolutions= diophant_solve(A,rhs,upperb,no_columns,no_rows,&opt);
+#if !defined(MPREC)
+free(rowblock);
+free(colblock);
+rowblock= colblock= NULL;
+nblocks= 0;
+#endif
+time_1= os_ticks();
+if(solfile!=NULL)fclose(solfile);
+if(opt.profile!=NULL)fclose(opt.profile);
+if(nosolutions==DIOPHANT_OVERFLOW)exit(2);
+if(nosolutions<0)exit(1);
+
+/* Free the system and continue with the next one of the batch */
+system_done:
+if(batch){
+if(nosolutions> 0)total_solutions+= nosolutions;
+for(j= 0;j<allocated_rows;j++){
+#if defined(MPREC)
+for(i= 0;i<no_original_columns;i++)zfree(&(A[j][i]));
+#endif
+free(A[j]);
+}
+free(A);
+#if defined(MPREC)
+for(j= 0;j<allocated_rows;j++)zfree(&(rhs[j]));
+#endif
+free(rhs);
+free(upperb);
+free(original_columns);
+free(opt.fixed_values);
+opt.fixed_values= NULL;
+free(batch_out.vec);
+batch_out.vec= NULL;
+nosolutions= 0;
+res= pagsys_next(&sys);
+if(res<0){
+printf("Damaged system %d in the batch file '%s'!\n",system_no+1,inputfile_name);
+fflush(stdout);
+exit(1);
+}
+if(res==1){
+system_no++;
+goto next_system;
+}
+time_1= os_ticks();
+fclose(batch_out.f);
+pagsys_unmap(&sys);
+printf("Systems: %d\n",system_no+1);
+printf("Total number of solutions: %ld\n",total_solutions);
+fflush(stdout);
+}
 
 /*11:*/
 #line 213 "solvediophant.w"
@@ -3,45 +3,794 @@
 
     Calls libexact by Petteri Kaski and Olli Pottonen, see 
     https://pottonen.kapsi.fi/libexact.html
+    Systems with other nonnegative integer coefficients than 0-1 are
+    solved by the multicover search of mcover.h.
 
     Vedran Krcadinac (krcko@math.hr), 15.10.2024.
     Department of Mathematics, University of Zagreb, Croatia
 */
 
+#define UPDATEFREQ	10000
+#define MAXTHREADS	256
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "exact.h"
+#include "mcover.h"
+#include "pagsol.h"
+#include "pagsys.h"
 
 int mask = 0;   /* An integer mask for options */
 /* Meaning of the bits:
+  0 - report found solutions
+  1 - print progress lines
+  2 - write the solutions in the binary format of pagsol.h
+  3 - the input is a batch of binary systems
+  4 - read compatibility matrix
+  5 - only count the solutions
 */
 
+long int count=0;             /* Number of solutions */
+FILE *outfile;
+int freq=1;                   /* Report every freq-th solution */
+
+int m,n;                      /* The system: dimensions, */
+int *rhs;                     /* right-hand side, */
+int *entry,nentries,maxentries;  /* row and column of the nonzero coefficients, */
+int *coef;                    /* the coefficients */
+int binary;                   /* All coefficients are 0-1 */
+int *row;                     /* Solution vector */
+const unsigned char *cm;      /* Compatibility matrix in the layout of pagsys.h, */
+size_t cmrow;                 /* bytes in a row */
+
+typedef struct instance {     /* A search instance of the system: */
+  exact_t *e;                 /* libexact if all coefficients are 0-1, */
+  MCOVER *mc;                 /* the multicover search of mcover.h otherwise */
+} INSTANCE;
+
+int nthreads=1;               /* Number of threads */
+
+int splitdepth=3;             /* Depth at which the tree is split into subproblems */
+int shard=0,nshards=1;        /* Search only the subproblems with index = shard mod nshards */
+long shardindex=0;            /* Index of the next subproblem */
+
+char *ckfilename=0;           /* Checkpoint file */
+int ckinterval=600;           /* Seconds between checkpoints */
+time_t lastck;
+int update=UPDATEFREQ;
+int nargs;                    /* Command line, saved in the checkpoint */
+char **args;
+
+long ckoffset;                /* Checkpoint being resumed: length of the output file, */
+int resumedepth=-1;           /* path to the node where the search stopped */
+int *resumesol;
+char *reached;                /* Levels at which the path has been reached */
+
+long *tree;                   /* Nodes at each level, for the progress report */
+int maxdepth;
+double starttime;
+
+char *zddfilename=0;          /* Diagram of the solutions when counting */
+size_t memlimit=1024;         /* Megabytes for the stored residual problems when counting */
+
+int nprobes=0;                /* Only estimate the size of the search tree from this many probes */
+int *path,pathlen;            /* Path of the current probe */
+int *children,nchildren;      /* Children of its last node */
+long calls;                   /* Calls of the level function by the probes */
+
+
+void *allocate(size_t size)
+{ void *p;
+
+  p = calloc(size,1);
+  if (p==NULL)
+  { printf("Out of memory!\n");
+    exit(0);
+  }
+  return p;
+}
+
+
+/***************/
+/* Checkpoints */
+/***************/
+
+/* Write the path to the current node of the search.
+   The file is replaced atomically. */
+
+void checkpoint(int lvl, const int *stack)
+{ FILE *f;
+  char *tmpname;
+  int i;
+
+  tmpname = (char *)allocate(strlen(ckfilename)+5);
+  sprintf(tmpname,"%s.tmp",ckfilename);
+  f = fopen(tmpname,"w");
+  if (f==0)
+  { printf("Cannot write checkpoint file '%s'!\n",tmpname);
+    free(tmpname);
+    return;
+  }
+  fprintf(f,"solvelibexact checkpoint\n%d\n",nargs);
+  for (i=0; i<nargs; ++i) fprintf(f,"%s\n",args[i]);
+  fflush(outfile);
+  fprintf(f,"offset %ld\n",ftell(outfile));
+  fprintf(f,"count %ld\n",count);
+  fprintf(f,"index %ld\n",shardindex);
+  fprintf(f,"path %d",lvl);
+  for (i=0; i<lvl; ++i) fprintf(f," %d",stack[i]);
+  fprintf(f,"\n");
+
+  if (fclose(f)!=0 || rename(tmpname,ckfilename)!=0)
+    printf("Cannot write checkpoint file '%s'!\n",ckfilename);
+  free(tmpname);
+  lastck=time(NULL);
+}
+
+
+/* Read a checkpoint: the saved command line and the path */
+
+void readcheckpoint(char *name)
+{ FILE *f;
+  char line[4096];
+  int i,ok;
+
+  f = fopen(name,"r");
+  if (f==0)
+  { printf("Cannot open checkpoint file '%s'!\n",name);
+    exit(0);
+  }
+  ok = fgets(line,sizeof(line),f)!=NULL && strcmp(line,"solvelibexact checkpoint\n")==0;
+  ok = ok && fscanf(f,"%d",&nargs)==1 && nargs>0;
+  if (ok)
+  { fgets(line,sizeof(line),f);
+    args = (char **)allocate((nargs+1)*sizeof(char *));
+    for (i=0; ok && i<nargs; ++i)
+    { ok = fgets(line,sizeof(line),f)!=NULL;
+      line[strcspn(line,"\n")]='\0';
+      args[i] = (char *)allocate(strlen(line)+1);
+      strcpy(args[i],line);
+    }
+  }
+  ok = ok && fscanf(f," offset %ld count %ld index %ld path %d",&ckoffset,&count,&shardindex,&resumedepth)==4;
+  ok = ok && resumedepth>=0;
+  if (ok)
+  { resumesol = (int *)allocate((resumedepth+1)*sizeof(int));
+    reached = (char *)allocate(resumedepth+1);
+    for (i=0; ok && i<resumedepth; ++i) ok = fscanf(f,"%d",resumesol+i)==1;
+  }
+  fclose(f);
+
+  if (!ok)
+  { printf("Error reading checkpoint file '%s'!\n",name);
+    exit(0);
+  }
+}
+
+
+/* Wall clock time in seconds */
+
+double seconds(void)
+{ struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+
+/* Print a progress line of the form
+   progress: time=T nodes=N nodes_per_sec=R solutions=S solutions_per_sec=Q depth=D branching=B1,B2,...
+   where Bi is the ratio of the numbers of nodes at levels i and i-1. */
+
+void progress(void)
+{ int i;
+  double nodes,t;
+
+  nodes=0;
+  for (i=0; i<=maxdepth; ++i) nodes+=tree[i];
+  t=seconds()-starttime;
+  if (t<1e-6) t=1e-6;
+  printf("progress: time=%.1f nodes=%.0f nodes_per_sec=%.0f solutions=%ld solutions_per_sec=%.2f depth=%d branching=",
+    t,nodes,nodes/t,count,count/t,maxdepth);
+  for (i=1; i<=maxdepth; ++i) printf("%s%.2f",i>1?",":"",tree[i-1] ? (double)tree[i]/tree[i-1] : 0.0);
+  printf("\n");
+  fflush(stdout);
+}
+
+
+/* Level function, called by libexact on every node of the search.
+   When resuming, the nodes before the saved path in the search order are cut:
+   a sibling of a node on the path is visited before the path if the path
+   has not been reached at its level yet. With shards the nodes at the split
+   depth are numbered and only those of our shard are searched. */
+
+int level(void *p, int lvl, const int *stack)
+{ int i;
+
+  if (resumedepth>=0)
+  { for (i=0; i<lvl-1 && i<resumedepth; ++i) if (stack[i]!=resumesol[i]) break;
+    if (lvl<=resumedepth && (lvl==0 || i==lvl-1))
+    { if (lvl==0 || stack[lvl-1]==resumesol[lvl-1])
+      { reached[lvl]=1;
+        if (lvl==resumedepth) resumedepth=-1;
+        return 1;
+      }
+      if (!reached[lvl]) return 0;
+    }
+  }
+
+  if (nshards>1 && lvl==splitdepth && (shardindex++)%nshards!=shard) return 0;
+  if (mask & 2)
+  { ++tree[lvl];
+    if (lvl>maxdepth) maxdepth=lvl;
+  }
+  if (--update==0)
+  { update=UPDATEFREQ;
+    if (mask & 2) progress();
+    if (ckfilename && time(NULL)-lastck>=ckinterval) checkpoint(lvl,stack);
+  }
+  return 1;
+}
+
+
+/*************************/
+/* The system to be solved */
+/*************************/
+
+/* Store the coefficient c of row i and column j. Returns 0 if it
+   is negative. */
+
+int addentry(int i, int j, int c)
+{ if (c==0) return 1;
+  if (c<0)
+  { printf("System matrix entries must be nonnegative!\n");
+    return 0;
+  }
+  if (nentries==maxentries)
+  { maxentries = maxentries ? 2*maxentries : 1024;
+    entry = (int *)realloc(entry,2*maxentries*sizeof(int));
+    coef = (int *)realloc(coef,maxentries*sizeof(int));
+    if (entry==NULL || coef==NULL)
+    { printf("Out of memory!\n");
+      exit(0);
+    }
+  }
+  entry[2*nentries]=i;
+  entry[2*nentries+1]=j;
+  coef[nentries]=c;
+  if (c!=1) binary=0;
+  ++nentries;
+  return 1;
+}
+
+
+/* Take the system from a mapped binary file. Returns 0 if a coefficient
+   is negative. */
+
+int binarysystem(PAGSYS *s)
+{ int i,j,k;
+
+  m=s->m;
+  n=s->n;
+  free(rhs);
+  rhs = (int *)allocate(m*sizeof(int));
+  for (i=0; i<m; ++i) rhs[i]=s->rhs[i];
+  nentries=0;
+  binary=1;
+  for (j=0; j<n; ++j) for (k=s->colptr[j]; k<s->colptr[j+1]; ++k)
+    if (!addentry(s->rowind[k],j,s->coef[k])) return 0;
+  if (mask & 16)
+  { if (s->cm==NULL)
+    { printf("No compatibility matrix in the binary system!\n");
+      return 0;
+    }
+    cm=s->cm;
+    cmrow=s->cmrow;
+  }
+  return 1;
+}
+
+
+/* Filter function: after a column has been chosen, the columns that are
+   not compatible with it are dropped. The columns chosen before have
+   dropped theirs already. */
+
+int cmfilter(void *p, int lvl, const int *stack, int j)
+{ int i;
+
+  i=stack[lvl-1];
+  return (cm[i*cmrow+j/8]>>(j%8)) & 1;
+}
+
+
+/* A new search instance of the system. The entries are declared in the
+   order they were read, so every instance searches the same tree. */
+
+INSTANCE *newinstance(void)
+{ INSTANCE *s;
+  int i;
+
+  s = (INSTANCE *)allocate(sizeof(INSTANCE));
+  for (i=0; i<m; ++i) if (rhs[i]<1) binary=0;     /* libexact needs positive right-hand sides */
+  if (!binary || (mask & 32))
+  { s->mc = mcover_alloc(m,n,rhs,nentries,entry,coef);
+    if (s->mc==NULL)
+    { printf("Right-hand side must be nonnegative!\n");
+      exit(0);
+    }
+    if (mask & 16) mcover_filter(s->mc, cmfilter, NULL);
+    return s;
+  }
+  s->e = exact_alloc();
+  for (i=0; i<n; ++i) exact_declare_col(s->e, i, 1);
+  for (i=0; i<m; ++i) exact_declare_row(s->e, i, rhs[i]);
+  for (i=0; i<nentries; ++i) exact_declare_entry(s->e, entry[2*i], entry[2*i+1]);
+  if (mask & 16) exact_filter(s->e, cmfilter, NULL);
+  return s;
+}
+
+
+void setlevel(INSTANCE *s, exact_level_t *f, void *p)
+{ if (s->mc!=NULL) mcover_level(s->mc, f, p);
+  else exact_level(s->e, f, p);
+}
+
+
+const int *solveinstance(INSTANCE *s, int *size)
+{ return s->mc!=NULL ? mcover_solve(s->mc, size) : exact_solve(s->e, size);
+}
+
+
+void resetinstance(INSTANCE *s)
+{ if (s->mc!=NULL) mcover_reset(s->mc);
+  else exact_reset_solve(s->e);
+}
+
+
+void freeinstance(INSTANCE *s)
+{ if (s->mc!=NULL) mcover_free(s->mc);
+  else exact_free(s->e);
+  free(s);
+}
+
+
+/* Write a solution vector */
+
+void writesolution(int *vec)
+{ int i;
+
+  if (mask & 8) pagsol_batch_put(outfile,vec,n);
+  else if (mask & 4) pagsol_put(outfile,vec,n);
+  else
+  { for (i=0; i<n; ++i) fprintf(outfile,"%d",vec[i]);
+    fprintf(outfile,"\n");
+    fflush(outfile);
+  }
+}
+
+
+/* Search with one thread */
+
+void serialsolve(INSTANCE *e)
+{ int i,soln_size;
+  const int *soln;
+
+  if (ckfilename || resumedepth>=0 || nshards>1 || (mask & 2)) setlevel(e, level, NULL);
+  while((soln = solveinstance(e, &soln_size)) != NULL) 
+  { if (soln_size<splitdepth && shard!=0) continue;    /* Solutions above the split depth belong to shard 0 */
+    ++count;
+    if ((mask & 1) && (count%freq==0)) printf("Solution #%ld\n",count);
+    for (i=0; i<n; ++i) row[i]=0;
+    for (i=0; i<soln_size; ++i) row[soln[i]]=1;
+    writesolution(row);
+  }
+}
+
+
+/***********************************/
+/* Estimating the size of the tree */
+/***********************************/
+
+/* Level function of a probe: the search follows the path and records
+   the children of its last node without entering them. */
+
+int probelevel(void *p, int lvl, const int *stack)
+{ int i;
+
+  ++calls;
+  if (lvl>pathlen+1) return 0;
+  for (i=0; i<lvl && i<pathlen; ++i) if (stack[i]!=path[i]) return 0;
+  if (lvl<=pathlen) return 1;
+  children[nchildren++]=stack[lvl-1];
+  return 0;
+}
+
+
+/* Estimate the search tree from nprobes random paths (Knuth's estimator).
+   The product of the numbers of children along a path estimates the number
+   of nodes at each level. Every step of a probe restarts the search from
+   the root with the path so far. The time is the estimated number of nodes
+   times the time per level call of the probes. The result is written to the
+   output file as a GAP record. */
+
+void estimate(INSTANCE *e, int n, char *outfilename)
+{ int i,k,depth,soln_size;
+  double *est,weight,nodes,sols,sum,sumsq,dev,t;
+  const int *soln;
+
+  est = (double *)allocate((n+2)*sizeof(double));
+  path = (int *)allocate((n+1)*sizeof(int));
+  children = (int *)allocate((n+1)*sizeof(int));
+  setlevel(e, probelevel, NULL);
+  srand48(1);
+  sum=sumsq=sols=0;
+  t=seconds();
+  for (k=0; k<nprobes; ++k)
+  { pathlen=0;
+    weight=1;
+    nodes=0;
+    for (;;)
+    { est[pathlen]+=weight;
+      nodes+=weight;
+      nchildren=0;
+      resetinstance(e);
+      soln=solveinstance(e, &soln_size);
+      if (soln!=NULL && soln_size==pathlen) sols+=weight;
+      if (nchildren==0 || pathlen==n) break;
+      weight*=nchildren;
+      path[pathlen++]=children[(int)(drand48()*nchildren)%nchildren];
+    }
+    sum+=nodes;
+    sumsq+=nodes*nodes;
+  }
+  resetinstance(e);
+  t=seconds()-t;
+  for (i=0; i<=n; ++i) est[i]/=nprobes;
+  for (depth=n; depth>0 && est[depth]==0; --depth);
+  sum/=nprobes;
+  sols/=nprobes;
+  dev = nprobes>1 ? sqrt((sumsq/nprobes-sum*sum)/(nprobes-1)) : 0;
+  if (dev!=dev) dev=0;
+  t = calls>0 ? t*sum/calls : 0;
+
+  printf("Probes: %d\n",nprobes);
+  printf("Estimated nodes: %.0f (standard error %.0f)\n",sum,dev);
+  printf("Estimated solutions: %.0f\n",sols);
+  printf("Estimated time: %.1f seconds\n",t);
+  printf("Estimated tree: ");
+  for (i=0; i<=depth; ++i) printf("%.0f ",est[i]);
+  printf("\n");
+
+  outfile = fopen(outfilename,"w");
+  if (outfile==0)
+  { printf("Cannot open output file '%s'!\n",outfilename);
+    exit(0);
+  }
+  fprintf(outfile,"return rec( Probes:=%d, Nodes:=%.0f, StdErr:=%.0f, Solutions:=%.0f, Time:=%.1f, NodesAtDepth:=[ ",
+    nprobes,sum,dev,sols,t);
+  for (i=0; i<=depth; ++i) fprintf(outfile,"%s%.0f",i>0?", ":"",est[i]);
+  fprintf(outfile," ] );\n");
+  fclose(outfile);
+  free(est);
+  free(path);
+  free(children);
+}
+
+
+/********************/
+/* Parallel search */
+/********************/
+
+/* Every thread searches its own instance. All of them go through the
+   same levels above the split depth, and the nodes at the split depth
+   are numbered in the same order. A thread searches below the nodes it
+   has claimed from the shared counter nexttask, so the subproblems are
+   dealt out while the search runs. Pushing the path of a node into a
+   fresh instance would not do: the row to branch on is chosen again
+   after the pushed columns, and with right-hand sides larger than 1
+   the same solution could then be found below two nodes. */
+
+typedef struct worker {
+  int id;
+  INSTANCE *e;
+  long index;                 /* Number of nodes at the split depth seen so far */
+  long claim;                 /* The last node claimed */
+  long *tree;                 /* Nodes at each level, for the progress report */
+  int maxdepth,update;
+  int *row;
+} WORKER;
+
+WORKER work[MAXTHREADS];
+long nexttask;
+pthread_mutex_t outlock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* Sum the tree counters of the workers for the progress report. Nodes
+   above the split depth are counted by worker 0 only. */
+
+void sumtree(void)
+{ int i,k;
+
+  maxdepth=0;
+  for (i=0; i<=n; ++i)
+  { tree[i]=0;
+    for (k=0; k<nthreads; ++k) tree[i]+=work[k].tree[i];
+  }
+  for (k=0; k<nthreads; ++k) if (work[k].maxdepth>maxdepth) maxdepth=work[k].maxdepth;
+}
+
+
+/* Level function of a thread */
+
+int parallellevel(void *p, int lvl, const int *stack)
+{ WORKER *w;
+  long i;
+
+  w=(WORKER *)p;
+  if (lvl==splitdepth)
+  { i=w->index++;
+    if (nshards>1)
+    { if (i%nshards!=shard) return 0;
+      i/=nshards;
+    }
+    while (w->claim<i) w->claim=__atomic_fetch_add(&nexttask,1,__ATOMIC_RELAXED);
+    if (w->claim!=i) return 0;
+  }
+  if ((mask & 2) && (lvl>=splitdepth || w->id==0))
+  { ++w->tree[lvl];
+    if (lvl>w->maxdepth) w->maxdepth=lvl;
+  }
+  if (--w->update==0)
+  { w->update=UPDATEFREQ;
+    if ((mask & 2) && w->id==0)
+    { sumtree();
+      progress();
+    }
+  }
+  return 1;
+}
+
+
+void *worksolve(void *arg)
+{ WORKER *w;
+  int i,soln_size;
+  const int *soln;
+
+  w=(WORKER *)arg;
+  setlevel(w->e, parallellevel, w);
+  while((soln = solveinstance(w->e, &soln_size)) != NULL) 
+  { if (soln_size<splitdepth && (shard!=0 || w->id!=0)) continue;
+    for (i=0; i<n; ++i) w->row[i]=0;
+    for (i=0; i<soln_size; ++i) w->row[soln[i]]=1;
+    pthread_mutex_lock(&outlock);
+    ++count;
+    if ((mask & 1) && (count%freq==0)) printf("Solution #%ld\n",count);
+    writesolution(w->row);
+    pthread_mutex_unlock(&outlock);
+  }
+  return NULL;
+}
+
+
+/* Search with nthreads threads. The instances are declared before the
+   threads start. */
+
+void parallelsolve(void)
+{ pthread_t thread[MAXTHREADS];
+  int k;
+
+  nexttask=0;
+  for (k=0; k<nthreads; ++k)
+  { work[k].id=k;
+    work[k].e=newinstance();
+    work[k].index=0;
+    work[k].claim=-1;
+    work[k].tree=(long *)allocate((n+2)*sizeof(long));
+    work[k].maxdepth=0;
+    work[k].update=UPDATEFREQ;
+    work[k].row=(int *)allocate((n+1)*sizeof(int));
+  }
+  for (k=1; k<nthreads; ++k)
+    if (pthread_create(&thread[k],NULL,worksolve,work+k)!=0)
+    { printf("Cannot create thread!\n");
+      exit(0);
+    }
+  worksolve(work);
+  for (k=1; k<nthreads; ++k) pthread_join(thread[k],NULL);
+
+  sumtree();
+  for (k=0; k<nthreads; ++k)
+  { freeinstance(work[k].e);
+    free(work[k].tree);
+    free(work[k].row);
+  }
+}
+
+
+/************/
+/* Counting */
+/************/
+
+/* Write the diagram of the solutions as a GAP record. Node k>=2 is
+   Nodes[k-1] = [column, lo, hi], 0 and 1 are the terminals. */
+
+void writezdd(MCOVER_COUNT *C)
+{ FILE *f;
+  long k;
+
+  f = fopen(zddfilename,"w");
+  if (f==0)
+  { printf("Cannot open output file '%s'!\n",zddfilename);
+    exit(0);
+  }
+  fprintf(f,"return rec( Solutions:=%llu, Root:=%d, Nodes:=[ ",C->count,C->root);
+  for (k=2; k<C->nnodes; ++k) fprintf(f,"%s[%d,%d,%d]",k>2 ? ",\n  " : "",C->col[k]+1,C->lo[k],C->hi[k]);
+  fprintf(f," ] );\n");
+  fclose(f);
+}
+
+
+/* Count the solutions of the system with the multicover search, storing
+   the residual problems, see mcover_count() */
+
+unsigned long long countsystem(void)
+{ INSTANCE *e;
+  MCOVER_COUNT *C;
+  unsigned long long c;
+
+  e = newinstance();
+  C = mcover_count(e->mc,zddfilename!=0,memlimit<<20);
+  if (C->overflow)
+  { printf("The number of solutions does not fit into 64 bits!\n");
+    exit(0);
+  }
+  if (mask & 1)
+  { printf("Stored residual problems: %ld, found again: %ld\n",C->nmemo,C->hits);
+    if (zddfilename) printf("Nodes of the diagram: %ld\n",C->nnodes);
+  }
+  if (zddfilename) writezdd(C);
+  c=C->count;
+  mcover_count_free(C);
+  freeinstance(e);
+  return c;
+}
+
+
+/*******************/
+/* Batch of systems */
+/*******************/
+
+/* Solve all systems of a batch file one after another. The solutions
+   are written to one file in the batch format of pagsol.h and tagged
+   with the number of their system. When counting, the output file is
+   the GAP list of the numbers of solutions. The solution vector, the
+   list of entries and the tree counters are shared by the systems. */
+
+void solvebatch(PAGSYS *s, char *outfilename)
+{ INSTANCE *e;
+  int i,k,id,maxn;
+  unsigned long long c,total;
+
+  outfile = fopen(outfilename,"w");
+  if (outfile==0)
+  { printf("Cannot open output file '%s'!\n",outfilename);
+    exit(0);
+  }
+  if (mask & 32) fprintf(outfile,"return [ ");
+  else pagsol_batch_start(outfile);
+  maxn=0;
+  total=0;
+  starttime=seconds();
+  for (id=0, k=1; k==1; ++id, k=pagsys_next(s))
+  { if (!binarysystem(s)) exit(0);
+    if (n>maxn)
+    { maxn=n;
+      free(row);
+      free(tree);
+      row = (int *)allocate((n+1)*sizeof(int));
+      tree = (long *)allocate((n+2)*sizeof(long));
+    }
+    for (i=0; i<=n+1; ++i) tree[i]=0;
+    maxdepth=0;
+    count=0;
+    shardindex=0;
+    update=UPDATEFREQ;
+
+    if (mask & 1) printf("System %d: %d x %d\n",id,m,n);
+    if (mask & 32)
+    { c=countsystem();
+      fprintf(outfile,"%s%llu",id>0 ? ", " : "",c);
+      if (mask & 1) printf("Number of solutions of system %d: %llu\n",id,c);
+      total+=c;
+      continue;
+    }
+    pagsol_batch_system(outfile,id,n);
+    if (nthreads>1) parallelsolve();
+    else
+    { e = newinstance();
+      serialsolve(e);
+      freeinstance(e);
+    }
+    if (mask & 2) progress();
+    if (mask & 1) printf("Number of solutions of system %d: %ld\n",id,count);
+    total+=count;
+  }
+  if (k<0)
+  { printf("Damaged system %d in the batch file!\n",id);
+    exit(0);
+  }
+  if (mask & 32) fprintf(outfile," ];\n");
+  fclose(outfile);
+  if (mask & 1) printf("Systems: %d\nTotal number of solutions: %llu\n",id,total);
+}
+
 
 /****************/
 /* Main program */
 /****************/
 
 int main(int argc,char *argv[])
-{ int m,n,i,j,ok,freq=1;
-  long int count=0;
-  int *row;
-  exact_t *e;
-  int soln_size;
-  const int *soln;
-  char *infilename=0, *outfilename;
-  FILE *infile, *outfile;
+{ int i,j,ok;
+  char *shardarg;
+  int k;
+  PAGSYS sys;
+  INSTANCE *e;
+  unsigned char *cmbits;
+  unsigned long long c;
+  char *infilename=0, *outfilename, *resumefilename=0;
+  FILE *infile;
 
   outfilename="solutions";
 
+  /* Resume a checkpoint: its saved command line replaces ours */
+
+  for (i=1; i<argc; ++i) if (strcmp(argv[i],"-resume")==0)
+  { if (i+1==argc)
+    { printf("No checkpoint file!\n");
+      exit(0);
+    }
+    resumefilename=argv[i+1];
+    readcheckpoint(resumefilename);
+    argc=nargs;
+    argv=args;
+    break;
+  }
+  nargs=argc;
+  args=argv;
+
   /* Command line arguments */
 
-  for(i=1; i<argc; ++i) if (argv[i][0] != '-') infilename = argv[i];
+  for(i=1; i<argc; ++i) if (strncmp(argv[i],"-shard",6)==0)
+  { shardarg = argv[i]+6;
+    if (*shardarg=='\0' && i+1<argc) shardarg=argv[++i];
+    if (sscanf(shardarg,"%d/%d",&shard,&nshards)!=2 || nshards<1 || shard<0 || shard>=nshards)
+    { printf("Wrong shard '%s', use -shardI/N with 0<=I<N.\n",shardarg);
+      exit(0);
+    }
+  }
+  else if (argv[i][0] != '-') infilename = argv[i];
   else
   { j = 0;
     while (argv[i][j] != '\0')
     { if (argv[i][j] == 'r') mask |= 1;
       if (argv[i][j] == 'R') mask &= ~1;
       if (argv[i][j] == 'f') sscanf(argv[i]+j+1,"%d",&freq);
+      if (argv[i][j] == 't') sscanf(argv[i]+j+1,"%d",&ckinterval);
+      if (argv[i][j] == 'd') sscanf(argv[i]+j+1,"%d",&splitdepth);
+      if (argv[i][j] == 'e') sscanf(argv[i]+j+1,"%d",&nprobes);
+      if (argv[i][j] == 'p') mask |= 2;
+      if (argv[i][j] == 'b') mask |= 4;
+      if (argv[i][j] == 'm') mask |= 8;
+      if (argv[i][j] == 'j') sscanf(argv[i]+j+1,"%d",&nthreads);
+      if (argv[i][j] == 'c') mask |= 16;
+      if (argv[i][j] == 'C') mask &= ~16;
+      if (argv[i][j] == 'n') mask |= 32;
+      if (argv[i][j] == 'l') sscanf(argv[i]+j+1,"%zu",&memlimit);
 	     
       /* Help */
       if ((argv[i][j] == 'h') || (argv[i][j] == 'H') || (argv[i][j] == '?'))
@@ -50,6 +799,20 @@ int main(int argc,char *argv[])
 	printf("-r, -R      Report found solutions (default no)\n"); 
         printf("-fN         Frequency of reporting (default N=%d).\n",freq);
         printf("-oFILENAME  Output file name (default: %s).\n",outfilename);
+        printf("-dN         Split the search tree into subproblems at depth N (default N=%d).\n",splitdepth);
+        printf("-shardI/N   Search only the subproblems with index I mod N.\n");
+        printf("-kFILENAME  Write checkpoints to this file (default no).\n");
+        printf("-tN         Seconds between checkpoints (default N=%d).\n",ckinterval);
+        printf("-resume FILENAME  Continue the search from a checkpoint.\n");
+        printf("-eN         Only estimate the search tree from N random probes.\n");
+        printf("-p          Print progress lines with rates and branching factors.\n");
+        printf("-b          Write the solutions in binary format (default no).\n");
+        printf("-m          The input is a batch of binary systems (default no).\n");
+        printf("-jN         Search in parallel with N threads (default N=%d).\n",nthreads);
+        printf("-c          Read compatibility matrix (default no).\n");
+        printf("-n          Only count the solutions, storing the residual problems.\n");
+        printf("-lN         Megabytes for the stored residual problems (default N=%zu).\n",memlimit);
+        printf("-zFILENAME  With -n, also write a diagram of all solutions.\n");
         printf("\n");
         exit(0);
       }
@@ -58,6 +821,17 @@ int main(int argc,char *argv[])
         while (argv[i][j] != '\0') ++j;
         --j;
       }
+      else if (argv[i][j] == 'k')
+      { ckfilename=argv[i]+j+1;
+        while (argv[i][j] != '\0') ++j;
+        --j;
+      }
+      else if (argv[i][j] == 'z')
+      { zddfilename=argv[i]+j+1;
+        mask |= 32;
+        while (argv[i][j] != '\0') ++j;
+        --j;
+      }
       ++j;
     }
   }
@@ -68,85 +842,166 @@ int main(int argc,char *argv[])
   { printf("No input file!\n");
     ok=0;
   }
+  if (nthreads<1 || nthreads>MAXTHREADS)
+  { printf("Number of threads must be between 1 and %d.\n",MAXTHREADS);
+    exit(0);
+  }
+  if (nthreads>1 && (ckfilename || resumefilename))
+  { printf("Checkpoints are not available with several threads.\n");
+    exit(0);
+  }
+  if ((mask & 32) && (nthreads>1 || nshards>1 || ckfilename || resumefilename || nprobes>0 || (mask & 4)))
+  { printf("Counting cannot be used with -j, -shard, -k, -resume, -e or -b.\n");
+    exit(0);
+  }
+  if (zddfilename && (mask & 8))
+  { printf("The diagram of the solutions is not available for a batch.\n");
+    exit(0);
+  }
 
   /**********************/
   /* Read linear system */
   /**********************/
 
-  infile = fopen(infilename,"r");
+  /* A binary system is mapped */
 
-  if (infile==0)
-  { printf("Cannot open input file '%s'!\n",infilename);
-    ok=0;
+  k=0;
+  if (ok) k=pagsys_map(infilename,&sys);
+  if (k<0)
+  { printf("Damaged binary input file '%s'!\n",infilename);
+    exit(0);
   }
 
-  /* Read dimensions */
-
-  j=1;
-  j&=(fscanf(infile,"%d",&m)==1);
-  j&=(fscanf(infile,"%d",&n)==1);
-  j&=(fscanf(infile,"%d",&i)==1);
+  /* A batch is solved system by system, without checkpoints */
 
-  if (j==0)
-  { printf("Dimensions of the system must be given first.\n");
-    ok=0;
+  if (ok && (mask & 8))
+  { if (k==0 || ckfilename || resumefilename || nprobes>0)
+    { printf("A batch must be a binary file and cannot be used with -k, -resume or -e.\n");
+      exit(0);
+    }
+    solvebatch(&sys,outfilename);
+    pagsys_unmap(&sys);
+    return 0;
   }
+  if (k==1) ok=binarysystem(&sys);
+  else
+  { infile = fopen(infilename,"r");
 
-  if (i!=1)
-  { printf("Works only for single RHS.\n");
-    ok=0;
-  }
+    if (infile==0)
+    { printf("Cannot open input file '%s'!\n",infilename);
+      ok=0;
+    }
 
-  if (ok==0) exit(0);
+    /* Read dimensions */
+
+    j=1;
+    j&=(fscanf(infile,"%d",&m)==1);
+    j&=(fscanf(infile,"%d",&n)==1);
+    j&=(fscanf(infile,"%d",&i)==1);
+
+    if (j==0)
+    { printf("Dimensions of the system must be given first.\n");
+      ok=0;
+    }
+
+    if (i!=1)
+    { printf("Works only for single RHS.\n");
+      ok=0;
+    }
 
-  /* Read coefficients */
+    if (ok==0) exit(0);
 
-  row = (int *)calloc(n,sizeof(int));
-  e = exact_alloc();
-    
-  for (i=0; i<n; ++i) exact_declare_col(e, i, 1); 
+    /* Read coefficients */
 
-  for (i=0; ok && i<m; ++i)
-  { for (j=0; ok && j<=n; ++j) ok&=(fscanf(infile,"%d",row+j)==1);
-    /* for (j=0; j<=n; ++j) printf("%d ",*(row+j));
-    printf("\n"); */
+    row = (int *)allocate((n+1)*sizeof(int));
+    rhs = (int *)allocate(m*sizeof(int));
+    binary=1;
 
-    if (!ok) printf("Error reading coefficients.\n");
-    else
-    { exact_declare_row(e, i, *(row+n));  
-      for (j=0; ok && j<n; ++j)
-      { if (*(row+j)==1) exact_declare_entry(e, i, j); 
-        else if (*(row+j)!=0)
-        { printf("System matrix entries must be 0-1!\n");
-          ok=0;
-        }
+    for (i=0; ok && i<m; ++i)
+    { for (j=0; ok && j<=n; ++j) ok&=(fscanf(infile,"%d",row+j)==1);
+      /* for (j=0; j<=n; ++j) printf("%d ",*(row+j));
+      printf("\n"); */
+
+      if (!ok) printf("Error reading coefficients.\n");
+      else
+      { rhs[i]=*(row+n);
+        for (j=0; ok && j<n; ++j) ok=addentry(i,j,*(row+j));
       }
     }
-  }
 
-  fclose(infile);
+    /* Read compatibility matrix */
+
+    if (ok && (mask & 16))
+    { cmrow=8*(((size_t)n+63)/64);
+      cmbits = (unsigned char *)allocate(n*cmrow);
+      for (i=0; ok && i<n; ++i) for (j=0; ok && j<n; ++j)
+      { ok=(fscanf(infile,"%d",&k)==1);
+        if (k) cmbits[i*cmrow+j/8] |= 1<<(j%8);
+      }
+      if (!ok) printf("Error reading compatibility matrix.\n");
+      cm=cmbits;
+    }
+
+    fclose(infile);
+  }
 
   if (ok==0) exit(0);
+  if (row==NULL) row = (int *)allocate((n+1)*sizeof(int));
+
+  if (nprobes>0)
+  { e = newinstance();
+    estimate(e,n,outfilename);
+    freeinstance(e);
+    return 0;
+  }
+
+  /* Only the number of solutions is written, as a GAP expression */
+
+  if (mask & 32)
+  { outfile = fopen(outfilename,"w");
+    if (outfile==0)
+    { printf("Cannot open output file '%s'!\n",outfilename);
+      exit(0);
+    }
+    c=countsystem();
+    fprintf(outfile,"return %llu;\n",c);
+    fclose(outfile);
+    if (mask & 1) printf("Total number of solutions: %llu\n",c);
+    return 0;
+  }
 
   if (mask & 1) printf("Starting search...\n");
 
-  outfile = fopen(outfilename,"w");
+  if (resumefilename)
+  { if (mask & 1) printf("Resuming from checkpoint '%s'\n",resumefilename);
+
+    /* Drop the solutions written after the checkpoint */
+
+    if (truncate(outfilename,ckoffset)!=0)
+    { printf("Cannot truncate output file '%s'!\n",outfilename);
+      exit(0);
+    }
+    outfile = fopen(outfilename,"a");
+  }
+  else outfile = fopen(outfilename,"w");
 
   if (outfile==0)
   { printf("Cannot open output file '%s'!\n",outfilename);
     exit(0);
   }
-	     
-  while((soln = exact_solve(e, &soln_size)) != NULL) 
-  { ++count;
-    if ((mask & 1) && (count%freq==0)) printf("Solution #%ld\n",count);
-    for (i=0; i<n; ++i) *(row+i)=0;
-    for (i=0; i<soln_size; ++i) *(row+soln[i])=1;
-    for (i=0; i<n; ++i) fprintf(outfile,"%d",*(row+i));
-    fprintf(outfile,"\n"); 
-    fflush(outfile);
+  if (mask & 4) pagsol_start(outfile,n,resumefilename==0);
+
+  lastck=time(NULL);
+  starttime=seconds();
+  tree = (long *)allocate((n+2)*sizeof(long));
+  if (nthreads>1) parallelsolve();
+  else
+  { e = newinstance();
+    serialsolve(e);
+    freeinstance(e);
   }
 
+  if (mask & 2) progress();
   if (mask & 1) printf("Total number of solutions: %ld\n",count);
   fclose(outfile);
 